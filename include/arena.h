@@ -0,0 +1,61 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief An opaque bump allocator.
+ *
+ * Memory is carved out of large chunks and released all at once by
+ * arena_destroy(). An arena is not thread-safe; give each thread its own.
+ */
+typedef struct Arena Arena;
+
+/**
+ * @brief Creates an empty arena.
+ *
+ * @return A pointer to a new Arena, or NULL on failure.
+ * The caller is responsible for freeing it with arena_destroy().
+ */
+Arena *arena_create(void);
+
+/**
+ * @brief Frees every allocation made from the arena, and the arena itself.
+ *
+ * @param arena The arena to destroy.
+ */
+void arena_destroy(Arena *arena);
+
+/**
+ * @brief Allocates uninitialized memory, aligned for any object type.
+ *
+ * @param arena The arena.
+ * @param size The number of bytes to allocate.
+ * @return The memory, or NULL on failure.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Grows an allocation, in place if it is the arena's latest one and
+ * there is room after it; otherwise it is copied to a new allocation (the
+ * old one is only reclaimed by arena_destroy()).
+ *
+ * @param arena The arena.
+ * @param ptr The allocation to grow, from arena_alloc() (NULL allocates).
+ * @param old_size Its current size in bytes.
+ * @param new_size The size needed.
+ * @return The grown allocation, or NULL on failure (ptr is left intact).
+ */
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Copies a string of known length into the arena.
+ *
+ * @param arena The arena.
+ * @param str The string to copy (need not be null-terminated).
+ * @param len The number of bytes to copy.
+ * @return The null-terminated copy, or NULL on failure.
+ */
+char *arena_strndup(Arena *arena, const char *str, size_t len);
+
+#endif // ARENA_H
@@ -1,40 +1,61 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#define MAX_EXTENSIONS 50
-#define MAX_FILENAMES 50
+#include "arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define MAX_STR_LEN 100
 
+// Roles a key can play in a profile's filters
+#define PROFILE_ALLOWED_EXT 0x01
+#define PROFILE_ALLOWED_DOTFILE 0x02
+#define PROFILE_ALLOWED_NAME 0x04
+#define PROFILE_IGNORED_EXT 0x08
+#define PROFILE_IGNORED_NAME 0x10
+
+/**
+ * @brief One key of a profile's lookup table: a file name or an extension,
+ * with every role it was given.
+ */
+typedef struct {
+    const char *key; // NULL marks a free slot
+    size_t key_len;
+    uint64_t hash;
+    uint8_t roles; // PROFILE_* bits
+    int syntax;    // First syntax_map entry for this key, or -1
+} ProfileKey;
+
 /**
  * @brief Holds all configuration settings for a specific language profile.
  *
  * This structure is populated from an .ini file and defines which files
  * to include, which to ignore, and how to map them to syntax highlighting.
+ * Every filter list and the syntax map are compiled into one hash table,
+ * so classifying a file takes one lookup for its name and one for its
+ * extension, whatever the size of the lists. The profile, its table and
+ * the lists' values it points into live in one arena.
  */
 typedef struct {
+    Arena *arena;
     char language_name[MAX_STR_LEN];
-    char *allowed_extensions[MAX_EXTENSIONS];
-    char *allowed_dotfiles[MAX_FILENAMES];
-    char *allowed_filenames[MAX_FILENAMES];
-    char *ignored_extensions[MAX_EXTENSIONS];
-    char *ignored_filenames[MAX_FILENAMES];
-    struct {
-        char *ext; // The file extension or name (e.g., "c" or "Makefile")
-        char *tag; // The markdown syntax tag (e.g., "c" or "makefile")
-    } syntax_map[MAX_EXTENSIONS];
-    int allowed_extensions_count;
-    int allowed_dotfiles_count;
-    int allowed_filenames_count;
-    int ignored_extensions_count;
-    int ignored_filenames_count;
-    int syntax_map_count;
+    ProfileKey *keys; // Open addressing; the capacity is a power of two
+    size_t key_cap;
+    size_t key_count;
+    const char **syntax_tags; // Markdown tags, in syntax_map order
+    int syntax_count;
+    uint64_t max_file_size;  // Larger files are listed but not included (0 = no limit)
+    uint64_t max_total_size; // File bodies stop once the report reaches this (0 = no limit)
 } LanguageProfile;
 
 /**
- * @brief Loads a language profile from a corresponding .ini file.
+ * @brief Loads a language profile.
  *
- * Searches in standard paths (./config, ~/.config/source-map, etc.)
- * for a file named "<language>.ini".
+ * A file named "<language>.ini" in ./config or ~/.config/source-map
+ * overrides the profiles built into the binary (generated from config/ at
+ * build time), which need no file access. Other profiles are searched for
+ * in /usr/local/share/source-map/config.
  *
  * @param language The name of the language profile to load (e.g., "c").
  * @return A pointer to a new LanguageProfile struct, or NULL on failure.
@@ -43,6 +64,25 @@ typedef struct {
  */
 LanguageProfile *load_language_profile(const char *language);
 
+/**
+ * @brief Lists every profile that load_language_profile() can load: the
+ * built-in ones and the .ini files of the search directories.
+ *
+ * @param count Receives the number of names.
+ * @return A newly allocated array of names, sorted and without duplicates
+ * (NULL on allocation failure). The caller is responsible for freeing it
+ * with free_profile_names().
+ */
+char **list_language_profiles(size_t *count);
+
+/**
+ * @brief Frees a list returned by list_language_profiles().
+ *
+ * @param names The names.
+ * @param count The number of names.
+ */
+void free_profile_names(char **names, size_t count);
+
 /**
  * @brief Frees all memory associated with a LanguageProfile struct.
  *
@@ -50,6 +90,29 @@ LanguageProfile *load_language_profile(const char *language);
  */
 void free_language_profile(LanguageProfile *profile);
 
+/**
+ * @brief Checks if a file should be included based on the language profile.
+ *
+ * Ignored names and extensions win over allowed ones. A dotfile is allowed
+ * by allowed_dotfiles as well as by the other allow lists.
+ *
+ * @param profile The language profile.
+ * @param filename The simple filename (e.g., "main.c" or "Makefile").
+ * @return true if the file is allowed, false otherwise.
+ */
+bool profile_allows_file(const LanguageProfile *profile, const char *filename);
+
+/**
+ * @brief Checks if a profile's filter lists name a file by its whole name
+ * (allowed_filenames, allowed_dotfiles or ignored_filenames), rather than
+ * only by its extension.
+ *
+ * @param profile The language profile.
+ * @param filename The simple filename.
+ * @return true if the name is listed.
+ */
+bool profile_lists_name(const LanguageProfile *profile, const char *filename);
+
 /**
  * @brief Gets the correct Markdown syntax tag for a given filename.
  *
@@ -0,0 +1,31 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stddef.h>
+
+#define DETECT_MAX_DIRS 256         // Directories sampled, breadth-first
+#define DETECT_MAX_DIR_FILES 64     // Files sampled per directory
+#define DETECT_MAX_FILES 4096       // Files sampled in all
+#define DETECT_MIN_SHARE_PERCENT 10 // Share of the sample a further profile must add
+
+/**
+ * @brief Picks the language profiles that match a project best.
+ *
+ * Samples the project breadth-first (a bounded number of directories, and
+ * of files per directory), skipping what .gitignore files exclude, and
+ * builds a histogram of file extensions (whole names for files without
+ * one). Every available profile is scored by the files it would include,
+ * each file weighing less the more profiles include it. Profiles are then
+ * picked greedily: the best one, then any other that adds at least
+ * DETECT_MIN_SHARE_PERCENT of the sample not included yet.
+ *
+ * @param root_path The root directory of the project.
+ * @param max_count The most profiles to pick.
+ * @param names Receives the picked names, best first (`max_count` entries).
+ * The caller is responsible for freeing each one.
+ * @return The number of profiles picked, 0 if no profile matches a sampled
+ * file (or on failure).
+ */
+size_t detect_profiles(const char *root_path, size_t max_count, char **names);
+
+#endif // DETECT_H
@@ -2,32 +2,170 @@
 #define FILESYSTEM_H
 
 #include "config.h"
+#include "fstree.h"
+#include "index.h"
+#include "manifest.h"
 #include "markdown.h"
 
 /**
- * @brief Generates a directory tree and appends it to the Markdown file.
+ * @brief How file contents are read.
+ */
+typedef struct {
+    int jobs;             // Reader threads feeding the writer
+    unsigned uring_depth; // io_uring queue depth, or 0 for POSIX reads
+    bool dedup;           // Write each distinct body once
+} ReadOptions;
+
+/**
+ * @brief Counters of the file bodies written so far, over all reports.
+ */
+typedef struct {
+    uint64_t files;    // Bodies written in a code block
+    uint64_t lines;    // Their lines
+    uint64_t binary;   // Bodies skipped as binary
+    uint64_t not_utf8; // Bodies written that are not valid UTF-8
+} ContentStats;
+
+/**
+ * @brief Renders the project tree and appends it to the Markdown file.
+ *
+ * Entries are sorted by name and drawn like the 'tree' command, followed
+ * by a "N directories, M files" summary. Ignored entries and the report
+ * itself are left out.
+ *
+ * @param md The Markdown file handle.
+ * @param tree The scanned project.
+ */
+void generate_directory_tree(MarkdownHandle *md, const FsTree *tree);
+
+/**
+ * @brief Appends the content of every allowed file to the Markdown file.
+ *
+ * Files are written in walk order. With an io_uring queue depth, files
+ * are opened, stat'ed and read in batches of asynchronous requests (falling
+ * back to the next method if io_uring is unavailable). Otherwise `jobs`
+ * reader threads fill a bounded ring of bodies ahead of the writer. The
+ * output is identical to the single-threaded run in every case.
+ *
+ * With deduplication, a body identical (same hash and size) to one already
+ * written is replaced by an "Identical to `<path>`" note. Streamed bodies
+ * are not hashed, so they are always written.
+ *
+ * With a fragment cache, files unchanged since the last report are not
+ * opened: their code blocks are copied from that report. Every code block
+ * written is recorded in the cache's current manifest.
  *
- * Tries to use the system 'tree' command first, respecting .gitignore.
- * Falls back to a native C implementation if 'tree' is not available.
+ * With an index, every body written (and every duplicate note) is listed
+ * in it, with the body's position in the report.
  *
  * @param md The Markdown file handle.
- * @param root_path The root directory of the project to scan.
- * @param output_file The name of the final .md file (to be ignored).
+ * @param index The report's index, or NULL.
+ * @param tree The scanned project.
+ * @param profile The language profile holding the size limits.
+ * @param cache The incremental state, or NULL for a full run.
+ * @param opts How to read the files.
+ */
+void process_project_files(MarkdownHandle *md, ReportIndex *index, const FsTree *tree,
+                           const LanguageProfile *profile, FragmentCache *cache,
+                           const ReadOptions *opts);
+
+/**
+ * @brief Appends the contents of the files of several reports at once.
+ *
+ * Each file is read once, as in process_project_files(), and its code
+ * block is written to every report whose profile includes it, with that
+ * profile's syntax tag and size limits. Reports are deduplicated
+ * separately.
+ *
+ * @param mds The Markdown file handles, one per report.
+ * @param indexes The reports' indexes, one per report (NULL entries for
+ * none).
+ * @param reports The reports the tree was scanned for.
+ * @param count The number of reports.
+ * @param tree The scanned project.
+ * @param opts How to read the files.
  */
-void generate_directory_tree(MarkdownHandle *md, const char *root_path, const char *output_file);
+void process_project_reports(MarkdownHandle *const *mds, ReportIndex *const *indexes,
+                             const ReportSpec *reports, int count, const FsTree *tree,
+                             const ReadOptions *opts);
 
 /**
- * @brief Scans all project files and appends their content to the Markdown file.
+ * @brief A file whose body the report writes in full, identified by the
+ * hash and size of its content.
+ */
+typedef struct {
+    const FsNode *node;
+    uint64_t hash;
+    uint64_t size;
+} FileDigest;
+
+/**
+ * @brief A run of consecutive allowed files (in walk order), written
+ * together, with the state of the size budget before its first file.
+ */
+typedef struct {
+    const FsNode **files;
+    size_t count;
+    uint64_t budget_used;      // Bytes of max_total_size taken by earlier files
+    bool budget_exhausted;     // max_total_size was reached before this span
+    const FileDigest *written; // Bodies of earlier files that later copies refer to
+    size_t written_count;
+} FileSpan;
+
+/**
+ * @brief Splits the allowed files into spans of about `target` bytes of
+ * output each, at file boundaries.
+ *
+ * Sizes are estimated from the scanned file sizes and the size limits. A
+ * file larger than `target` makes a span of its own. There is always at
+ * least one span, empty if the project has no allowed files.
+ *
+ * With deduplication, files sharing their size with another are read and
+ * hashed, so that copies are charged as a single report charges them (not
+ * at all), and each span knows the bodies written before it.
+ *
+ * @param tree The scanned project.
+ * @param profile The language profile holding the size limits.
+ * @param target The output size to aim for, per span.
+ * @param dedup Whether identical bodies are written once.
+ * @param spans Receives the spans. The caller is responsible for freeing
+ * them with free_file_spans().
+ * @return The number of spans, or 0 on allocation failure.
+ */
+size_t split_project_files(const FsTree *tree, const LanguageProfile *profile, uint64_t target,
+                           bool dedup, FileSpan **spans);
+
+/**
+ * @brief Frees the spans returned by split_project_files().
+ *
+ * @param spans The spans.
+ * @param count The number of spans.
+ */
+void free_file_spans(FileSpan *spans, size_t count);
+
+/**
+ * @brief Appends the content of the files of one span to the Markdown
+ * file, as process_project_files() does for the whole project.
  *
- * Traverses the directory, respects .gitignore, and uses the language
- * profile to filter which files to include.
+ * Spans may be written concurrently, each to its own file. Copies of
+ * bodies written by earlier spans are written as notes, and the size
+ * limits continue from the span's budget fields.
  *
  * @param md The Markdown file handle.
- * @param root_path The root directory of the project to scan.
- * @param profile The language profile defining filter rules.
- * @param output_file The name of the final .md file (to be ignored).
+ * @param index The shard's index, or NULL.
+ * @param span The files to write.
+ * @param profile The language profile holding the size limits.
+ * @param opts How to read the files.
+ */
+void process_file_span(MarkdownHandle *md, ReportIndex *index, const FileSpan *span,
+                       const LanguageProfile *profile, const ReadOptions *opts);
+
+/**
+ * @brief Reads the counters of the file bodies written so far
+ * (thread-safe).
+ *
+ * @param stats Receives the counters.
  */
-void process_project_files(MarkdownHandle *md, const char *root_path,
-                           const LanguageProfile *profile, const char *output_file);
+void get_content_stats(ContentStats *stats);
 
-#endif // FILESYSTEM_H
\ No newline at end of file
+#endif // FILESYSTEM_H
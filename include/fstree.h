@@ -0,0 +1,188 @@
+#ifndef FSTREE_H
+#define FSTREE_H
+
+#include "config.h"
+#include "gitrepo.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FS_NODE_IGNORED 0x01 // Matched .gitignore (or is .git): not descended
+#define FS_NODE_OUTPUT 0x02  // The report itself: hidden from both sections
+#define FS_NODE_ALLOWED 0x04 // Regular file whose content some report includes
+#define FS_NODE_REMOVED 0x08 // Dropped by fs_tree_rescan(): no longer in the tree
+
+#define FS_TREE_MAX_REPORTS 16 // Reports one scan can classify files for
+#define REPORT_STDOUT "-"      // Output file name streaming the report to stdout
+
+/**
+ * @brief One report of an export: the profile choosing its files and the
+ * path it is written to (hidden from the scan, with its companion files,
+ * unless it is REPORT_STDOUT).
+ */
+typedef struct {
+    const LanguageProfile *profile;
+    const char *output_file;
+} ReportSpec;
+
+/**
+ * @brief One entry of the scanned project.
+ *
+ * Children are kept in readdir order. Nodes and names live in the tree's
+ * arenas and are released together by fs_tree_free().
+ */
+typedef struct FsNode {
+    const char *name; // Entry name (the root path as given for the root)
+    struct FsNode *parent;
+    struct FsNode *children; // First child
+    struct FsNode *next;     // Next sibling
+    uint64_t size;           // File size, inode and modification time in
+    uint64_t ino;            // nanoseconds: set for FS_NODE_ALLOWED files
+    int64_t mtime_ns;
+    uint32_t name_len;
+    uint8_t kind;     // A WalkKind value
+    uint8_t flags;    // FS_NODE_* bits
+    uint16_t reports; // Bit i: the file goes into report i (FS_NODE_ALLOWED if any)
+} FsNode;
+
+/**
+ * @brief An opaque in-memory model of a project directory.
+ */
+typedef struct FsTree FsTree;
+
+/**
+ * @brief A directory of the tree whose entries changed on disk.
+ */
+typedef struct {
+    const FsNode *dir;
+    bool subtree; // Everything below it may have changed (.gitignore edited, dir replaced)
+} FsTreeChange;
+
+/**
+ * @brief Scans a project once and builds its tree.
+ *
+ * Applies .gitignore files as the walk reaches them, along with the
+ * repository-wide excludes (ignored directories are never opened), marks
+ * the output files (and their companion files) and records which reports
+ * include each file, so several profiles share one scan. Only included
+ * files are stat'ed, for their size, inode and modification time.
+ * With more than one job, directories are scanned by a work-stealing pool;
+ * the resulting tree is the same.
+ *
+ * @param root_path The root directory of the project.
+ * @param reports The reports, whose profiles define the filter rules.
+ * @param report_count The number of reports (1 to FS_TREE_MAX_REPORTS).
+ * @param jobs The number of scanning threads.
+ * @return A pointer to a new FsTree, or NULL if the root cannot be read.
+ * The caller is responsible for freeing it with fs_tree_free().
+ */
+FsTree *fs_tree_build(const char *root_path, const ReportSpec *reports, int report_count,
+                      int jobs);
+
+/**
+ * @brief Builds the tree from the paths tracked in the git index instead
+ * of walking the directories.
+ *
+ * The index of the repository containing `root_path` is parsed directly
+ * (no git binary); untracked files are never seen and .gitignore rules
+ * are not needed. Tracked files a report includes are stat'ed as in
+ * fs_tree_build(); those deleted from the work tree are left out.
+ *
+ * @param root_path The root directory of the project (inside a work tree).
+ * @param reports The reports, whose profiles define the filter rules.
+ * @param report_count The number of reports (1 to FS_TREE_MAX_REPORTS).
+ * @param status Receives why the index could not be used (or
+ * GIT_INDEX_OK).
+ * @return A pointer to a new FsTree, or NULL if there is no readable index.
+ * The caller is responsible for freeing it with fs_tree_free().
+ */
+FsTree *fs_tree_build_from_git_index(const char *root_path, const ReportSpec *reports,
+                                     int report_count, GitIndexStatus *status);
+
+/**
+ * @brief Scans the changed directories of a tree again, in place.
+ *
+ * Each changed directory is listed again, with the same rules as
+ * fs_tree_build(): entries that are still there keep their node (files are
+ * stat'ed again), subdirectories that are still there keep their subtree,
+ * new subdirectories are scanned in full and entries that are gone are
+ * marked FS_NODE_REMOVED. For a subtree change, the directory itself is
+ * dropped and its parent listed again, so its whole subtree is scanned
+ * afresh. Nodes that are not reused stay allocated until fs_tree_free().
+ *
+ * @param tree A tree from fs_tree_build().
+ * @param changes The changed directories (nodes of the tree).
+ * @param count The number of changes.
+ * @param reports The reports the tree was built for.
+ * @param report_count The number of reports.
+ * @return true on success, false if the root cannot be read or on
+ * allocation failure (the tree may be partly updated: build it again).
+ */
+bool fs_tree_rescan(FsTree *tree, const FsTreeChange *changes, size_t count,
+                    const ReportSpec *reports, int report_count);
+
+/**
+ * @brief Lists the directories the last fs_tree_rescan() added to the
+ * tree, each scanned with its whole subtree.
+ *
+ * @param tree The tree.
+ * @param count Receives the number of directories.
+ * @return The directories, valid until the next rescan.
+ */
+const FsNode *const *fs_tree_added(const FsTree *tree, size_t *count);
+
+/**
+ * @brief Frees the tree and every node in it.
+ *
+ * @param tree The tree to free.
+ */
+void fs_tree_free(FsTree *tree);
+
+/**
+ * @brief Returns the root node (a directory named after the root path).
+ *
+ * @param tree The tree.
+ * @return The root node.
+ */
+const FsNode *fs_tree_root(const FsTree *tree);
+
+/**
+ * @brief Returns the next node in pre-order (readdir order within a
+ * directory), without recursion.
+ *
+ * @param node The current node.
+ * @param descend Whether to visit the current node's children.
+ * @return The next node, or NULL after the last one.
+ */
+const FsNode *fs_node_next(const FsNode *node, bool descend);
+
+/**
+ * @brief Computes the depth of a node (0 for children of the root).
+ *
+ * @param node The node (not the root).
+ * @return The depth.
+ */
+int fs_node_depth(const FsNode *node);
+
+/**
+ * @brief Writes a node's full path ("<root>/<relative path>").
+ *
+ * @param node The node.
+ * @param buf The destination buffer (grown with realloc as needed).
+ * @param cap The buffer capacity, updated when the buffer grows.
+ * @return The path length, or (size_t)-1 on allocation failure.
+ */
+size_t fs_node_path(const FsNode *node, char **buf, size_t *cap);
+
+/**
+ * @brief Opens a node by its full path, descending from the root one
+ * component at a time if the path is longer than PATH_MAX.
+ *
+ * @param node The node.
+ * @param path The node's full path, as written by fs_node_path().
+ * @param flags The open() flags (O_CLOEXEC and O_NOCTTY are added).
+ * @return A file descriptor, or -1 on failure. The caller must close it.
+ */
+int fs_node_open(const FsNode *node, const char *path, int flags);
+
+#endif // FSTREE_H
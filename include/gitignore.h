@@ -2,16 +2,29 @@
 #define GITIGNORE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#define GITIGNORE_FILE ".gitignore" // Read in every directory of the project
 
 /**
- * @brief An opaque struct holding compiled gitignore patterns.
+ * @brief An opaque struct holding the repository-wide exclude rules
+ * (.git/info/exclude and core.excludesFile).
+ *
+ * Patterns are compiled at load time by shape: literal names and "*suffix"
+ * patterns go to hash sets, "prefix*" patterns to a trie, and only the
+ * remaining globs are left to fnmatch().
  */
 typedef struct Gitignore Gitignore;
 
 /**
- * @brief Loads and parses .gitignore rules from a base path.
+ * @brief Loads the repository-wide exclude rules of a project.
+ *
+ * When the project root holds a .git directory (or a "gitdir:" file), its
+ * info/exclude and the core.excludesFile named by the repository or user
+ * configuration (by default $XDG_CONFIG_HOME/git/ignore) are loaded.
+ * .gitignore files are read per directory by gitignore_dir_open().
  *
- * @param base_path The directory containing the .gitignore file.
+ * @param base_path The root directory of the project.
  * @return A pointer to a new Gitignore struct, or NULL on failure.
  * The caller is responsible for freeing this memory with
  * gitignore_free().
@@ -26,13 +39,66 @@ Gitignore *gitignore_load(const char *base_path);
 void gitignore_free(Gitignore *gi);
 
 /**
- * @brief Checks if a given path matches any .gitignore rules.
+ * @brief The stack of rule frames that applies to the entries of one
+ * directory: its own .gitignore on top of those of its ancestors and the
+ * repository-wide excludes.
+ *
+ * The directory-dependent part of the matching (how far each anchored
+ * pattern got along the directory's path) is evaluated once, when the
+ * directory is opened, from its parent's state. Matching is read-only, so
+ * threads may share a GitignoreDir. It is reference-counted: a directory
+ * keeps its parent, whose rules it inherits, alive.
+ */
+typedef struct GitignoreDir GitignoreDir;
+
+/**
+ * @brief Pushes the frame of a directory: reads its .gitignore and
+ * advances the inherited frames over the directory's name.
+ *
+ * @param gi The repository-wide rules (may be NULL); only used at the root.
+ * @param parent The parent directory's frames (NULL at the root, or if the
+ * parent had none).
+ * @param dir_fd A descriptor of the directory, to read its .gitignore
+ * (-1 to skip it).
+ * @param name The directory's name, or NULL for the project root.
+ * @return A pointer to a new GitignoreDir, or NULL if no rule can match
+ * (or on allocation failure). The caller is responsible for releasing it
+ * with gitignore_dir_close().
+ */
+GitignoreDir *gitignore_dir_open(const Gitignore *gi, GitignoreDir *parent, int dir_fd,
+                                 const char *name);
+
+/**
+ * @brief Takes an extra reference to a GitignoreDir.
+ *
+ * @param dir The GitignoreDir (may be NULL).
+ * @return dir.
+ */
+GitignoreDir *gitignore_dir_ref(GitignoreDir *dir);
+
+/**
+ * @brief Drops a reference to a GitignoreDir, freeing it (and releasing
+ * its parent) with the last one.
+ *
+ * @param dir The GitignoreDir to release (may be NULL).
+ */
+void gitignore_dir_close(GitignoreDir *dir);
+
+/**
+ * @brief Checks if an entry of the directory is ignored.
+ *
+ * Follows git: a pattern without a '/' (other than a trailing one) matches
+ * the entry name at any depth below its file; any other pattern is
+ * anchored to the directory of its file, where "**" spans any number of
+ * directories. Within a file the last matching pattern decides; deeper
+ * files take precedence over shallower ones, and .gitignore files over
+ * the repository-wide excludes.
  *
- * @param gi The loaded Gitignore struct.
- * @param path The relative path to check (e.g., "src/main.c").
- * @param is_dir Whether the path is a directory.
- * @return true if the path is ignored, false otherwise.
+ * @param dir The directory, from gitignore_dir_open() (NULL matches nothing).
+ * @param name The entry name.
+ * @param is_dir Whether the entry is a directory.
+ * @return true if the entry is ignored, false otherwise.
  */
-bool gitignore_matches_path(const Gitignore *gi, const char *path, bool is_dir);
+bool gitignore_dir_matches(const GitignoreDir *dir, const char *name, bool is_dir);
 
-#endif // GITIGNORE_H
\ No newline at end of file
+#endif // GITIGNORE_H
@@ -0,0 +1,107 @@
+#ifndef GITREPO_H
+#define GITREPO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GIT_MODE_TYPE 0170000
+#define GIT_MODE_FILE 0100000
+#define GIT_MODE_SYMLINK 0120000
+#define GIT_MODE_GITLINK 0160000 // Submodule
+
+/**
+ * @brief Locates the git directory of a work tree: "<work_tree>/.git", or
+ * the target of a "gitdir:" file (linked worktrees and submodules).
+ *
+ * @param work_tree The top directory of the work tree.
+ * @return A newly allocated path, or NULL if it is not a repository.
+ */
+char *git_dir_find(const char *work_tree);
+
+/**
+ * @brief Reads a single-valued key from a git config file.
+ *
+ * Only plain "[section]" headers and "key = value" lines are understood;
+ * section and key names are case-insensitive, and the last value wins.
+ *
+ * @param config_path The config file (may be NULL).
+ * @param section The section name (e.g. "core").
+ * @param key The key name (e.g. "excludesFile").
+ * @return A newly allocated value, or NULL if unset or unreadable.
+ */
+char *git_config_get(const char *config_path, const char *section, const char *key);
+
+/**
+ * @brief Resolves core.excludesFile the way git does: the repository's
+ * config, then ~/.gitconfig, then $XDG_CONFIG_HOME/git/config, and
+ * $XDG_CONFIG_HOME/git/ignore (or ~/.config/git/ignore) when none sets it.
+ *
+ * @param git_dir The repository's git directory.
+ * @return A newly allocated path, or NULL.
+ */
+char *git_excludes_file(const char *git_dir);
+
+/**
+ * @brief Joins two path parts with a '/'.
+ *
+ * @return A newly allocated string, or NULL on allocation failure.
+ */
+char *git_path_join(const char *dir, const char *name);
+
+/**
+ * @brief One tracked path of the index.
+ */
+typedef struct {
+    const char *path; // Relative to the directory the index was loaded for
+    size_t path_len;
+    uint32_t type; // GIT_MODE_FILE, GIT_MODE_SYMLINK or GIT_MODE_GITLINK
+} GitIndexEntry;
+
+/**
+ * @brief An opaque, parsed git index (.git/index, versions 2 to 4).
+ */
+typedef struct GitIndex GitIndex;
+
+/**
+ * @brief Outcome of git_index_load().
+ */
+typedef enum {
+    GIT_INDEX_OK,
+    GIT_INDEX_UNREADABLE, // No repository, or an unreadable or malformed index
+    GIT_INDEX_SPLIT,      // A split index (most entries kept in a shared index)
+} GitIndexStatus;
+
+/**
+ * @brief Reads the index of the repository containing a directory, with a
+ * single read and without running git.
+ *
+ * The repository is searched from `dir` upwards. Only entries below `dir`
+ * are kept, sorted like the index (byte-wise by path). Conflicted paths
+ * appear once; skip-worktree (sparse) entries are left out.
+ *
+ * @param dir The directory to list.
+ * @param status Receives why the index could not be loaded (or
+ * GIT_INDEX_OK).
+ * @return A pointer to a new GitIndex, or NULL if there is no repository,
+ * the index cannot be read or uses an unsupported feature (split index).
+ * The caller is responsible for freeing it with git_index_free().
+ */
+GitIndex *git_index_load(const char *dir, GitIndexStatus *status);
+
+/**
+ * @brief Returns the entries of an index.
+ *
+ * @param index The index.
+ * @param count Receives the number of entries.
+ * @return The entries, valid until git_index_free().
+ */
+const GitIndexEntry *git_index_entries(const GitIndex *index, size_t *count);
+
+/**
+ * @brief Frees an index.
+ *
+ * @param index The index to free (may be NULL).
+ */
+void git_index_free(GitIndex *index);
+
+#endif // GITREPO_H
@@ -0,0 +1,53 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hashes a byte range with 64-bit xxHash (XXH64, seed 0).
+ *
+ * Fast and non-cryptographic: suited to recognizing unchanged or duplicate
+ * file contents, not to resisting crafted collisions.
+ *
+ * @param data The bytes to hash.
+ * @param length The number of bytes.
+ * @return The hash, never 0 (so 0 can mean "not hashed").
+ */
+uint64_t hash_bytes(const void *data, size_t length);
+
+/**
+ * @brief State of a hash computed over bytes that arrive in pieces.
+ */
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t length;           // Bytes hashed so far
+    unsigned char pending[32]; // Bytes not yet folded into the lanes
+    size_t pending_len;
+} HashState;
+
+/**
+ * @brief Starts a hash computed in pieces.
+ *
+ * @param state The state to initialize.
+ */
+void hash_init(HashState *state);
+
+/**
+ * @brief Adds the next bytes to a hash computed in pieces.
+ *
+ * @param state The state.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ */
+void hash_update(HashState *state, const void *data, size_t length);
+
+/**
+ * @brief Finishes a hash computed in pieces.
+ *
+ * @param state The state.
+ * @return The same hash as hash_bytes() of all the bytes at once.
+ */
+uint64_t hash_final(const HashState *state);
+
+#endif // HASH_H
@@ -0,0 +1,65 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INDEX_SUFFIX ".index.jsonl" // Appended to the report name
+#define INDEX_FORMAT "source-map-index"
+#define INDEX_VERSION 1
+#define INDEX_LINES_UNKNOWN UINT64_MAX // A streamed body, whose lines are not counted
+
+/**
+ * @brief One file of a report, as listed in its index.
+ */
+typedef struct {
+    const char *path;         // Full path, as written in the file's header
+    const char *tag;          // Syntax tag of its code block
+    const char *duplicate_of; // The file whose body it is identical to (NULL if written)
+    uint64_t offset;          // Position of the body in the report (inside the fences)
+    uint64_t length;          // Bytes of the body
+    uint64_t lines;           // Lines of the body (or INDEX_LINES_UNKNOWN)
+    uint64_t hash;            // hash_bytes() of the body (0 if it was streamed unread)
+} IndexEntry;
+
+/**
+ * @brief An opaque index being written.
+ */
+typedef struct ReportIndex ReportIndex;
+
+/**
+ * @brief Starts the index of a report.
+ *
+ * The index is a JSON Lines file: one object per file whose body is in the
+ * report (or that is identical to one that is), in report order, then a
+ * footer object giving the format, the report's name and size and the
+ * number of files. A consumer that checks the footer against the report
+ * can map the report and slice any body out of it directly. The index is
+ * written to a temporary file and renamed into place when closed.
+ *
+ * @param path The index file.
+ * @return A pointer to a new ReportIndex, or NULL on failure.
+ */
+ReportIndex *report_index_open(const char *path);
+
+/**
+ * @brief Appends a file to the index.
+ *
+ * @param index The index (NULL is ignored).
+ * @param entry The file.
+ */
+void report_index_add(ReportIndex *index, const IndexEntry *entry);
+
+/**
+ * @brief Writes the footer, closes the index and frees it.
+ *
+ * @param index The index (NULL is ignored).
+ * @param report The report file (only its last component is written).
+ * @param report_size The size of the report, uncompressed.
+ * @param complete false to discard the index (the report failed).
+ * @return true on success, false on a write error.
+ */
+bool report_index_close(ReportIndex *index, const char *report, uint64_t report_size,
+                        bool complete);
+
+#endif // INDEX_H
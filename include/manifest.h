@@ -0,0 +1,148 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define MANIFEST_SUFFIX ".manifest" // Appended to the report name
+#define REPORT_TEMP_SUFFIX ".tmp"   // Report being written in incremental mode
+
+/**
+ * @brief What an incremental run remembers about one rendered file.
+ */
+typedef struct {
+    const char *path; // Full path, as written in the file's header
+    const char *tag;  // Syntax tag the fragment was rendered with
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;   // hash_bytes() of the contents (0 if the body was streamed unread)
+    uint64_t offset; // Position of the code block in the report
+    uint64_t length; // Length of the code block, fences included (0 for a duplicate)
+} ManifestEntry;
+
+/**
+ * @brief An opaque set of manifest entries, looked up by path.
+ */
+typedef struct Manifest Manifest;
+
+/**
+ * @brief The state threaded through an incremental run.
+ */
+typedef struct {
+    const Manifest *previous; // Entries of the last run (may be empty)
+    Manifest *current;        // Entries recorded by this run
+    int report_fd;            // The last report, holding the fragments (-1 if none)
+} FragmentCache;
+
+/**
+ * @brief Creates an empty manifest.
+ *
+ * @return A pointer to a new Manifest, or NULL on failure.
+ * The caller is responsible for freeing it with manifest_free().
+ */
+Manifest *manifest_create(void);
+
+/**
+ * @brief Loads the manifest written by the last run.
+ *
+ * A missing or malformed manifest, or one written for a report of another
+ * size (the report was edited or replaced since), loads as empty.
+ *
+ * @param path The manifest file.
+ * @param report_size The current size of the report it describes.
+ * @return A pointer to a new Manifest, or NULL on allocation failure.
+ * The caller is responsible for freeing it with manifest_free().
+ */
+Manifest *manifest_load(const char *path, uint64_t report_size);
+
+/**
+ * @brief Frees a manifest and its entries.
+ *
+ * @param manifest The manifest to free.
+ */
+void manifest_free(Manifest *manifest);
+
+/**
+ * @brief Finds the entry recorded for a path.
+ *
+ * @param manifest A manifest returned by manifest_load().
+ * @param path The full path.
+ * @return The entry, or NULL if there is none.
+ */
+const ManifestEntry *manifest_find(const Manifest *manifest, const char *path);
+
+/**
+ * @brief Records an entry (its strings are copied).
+ *
+ * Paths containing a tab or a newline are not recorded, since they cannot
+ * be written to the manifest.
+ *
+ * @param manifest The manifest.
+ * @param entry The entry to record.
+ * @return true on success, false on allocation failure.
+ */
+bool manifest_add(Manifest *manifest, const ManifestEntry *entry);
+
+/**
+ * @brief Writes a manifest atomically (to a temporary file, then renamed).
+ *
+ * @param manifest The manifest.
+ * @param path The manifest file.
+ * @param report_size The size of the report it describes.
+ * @return true on success, false on a write error.
+ */
+bool manifest_save(const Manifest *manifest, const char *path, uint64_t report_size);
+
+/**
+ * @brief Checks if a file name is the report or one of its companion files
+ * (its manifest and index, the temporary files they are written to, and
+ * its shards).
+ *
+ * @param name The file name.
+ * @param output_file The report path (only its last component is compared).
+ * @return true if the name belongs to the report.
+ */
+bool manifest_is_report_file(const char *name, const char *output_file);
+
+/**
+ * @brief Removes the shards numbered above `count` left by an earlier run
+ * that wrote more of them, with their companion files (best effort).
+ *
+ * @param output_file The report path.
+ * @param count The number of shards kept.
+ */
+void report_remove_shards(const char *output_file, size_t count);
+
+/**
+ * @brief Builds the path of a variant of the report, named before the
+ * extension ("out/report.c.md" for "out/report.md" and "c").
+ *
+ * @param output_file The report path.
+ * @param variant The name inserted before the extension.
+ * @return A newly allocated path, or NULL on failure.
+ */
+char *report_variant_path(const char *output_file, const char *variant);
+
+/**
+ * @brief Builds the path of one shard of a sharded report, numbered before
+ * the extension ("out/report.002.md" for "out/report.md").
+ *
+ * @param output_file The report path.
+ * @param index The shard number, from 1.
+ * @return A newly allocated path, or NULL on failure.
+ */
+char *report_shard_path(const char *output_file, size_t index);
+
+/**
+ * @brief Copies the inode, size and modification time of a file into an
+ * entry.
+ *
+ * @param entry The entry to fill.
+ * @param st The file status.
+ */
+void manifest_stamp(ManifestEntry *entry, const struct stat *st);
+
+#endif // MANIFEST_H
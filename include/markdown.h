@@ -1,27 +1,78 @@
 #ifndef MARKDOWN_H
 #define MARKDOWN_H
 
-#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MD_BUFFER_DEFAULT (1024 * 1024)  // Output buffer of a Markdown file
+#define MD_BUFFER_MIN (4 * 1024)         // Smallest --write-buffer
+#define MD_BUFFER_MAX (64 * 1024 * 1024) // Largest --write-buffer
+
+#define MD_GZIP_SUFFIX ".gz"  // File name suffix of gzip output
+#define MD_ZSTD_SUFFIX ".zst" // File name suffix of zstd output
 
 /**
  * @brief An opaque struct representing an open Markdown file.
  */
 typedef struct MarkdownHandle MarkdownHandle;
 
+/**
+ * @brief How the output of a Markdown file is compressed.
+ */
+typedef enum {
+    MD_COMPRESS_NONE,
+    MD_COMPRESS_GZIP, // Piped through `gzip -c`
+    MD_COMPRESS_ZSTD, // Piped through `zstd -q -c`
+} MdCompression;
+
+/**
+ * @brief How a Markdown file is written.
+ */
+typedef struct {
+    size_t buffer_size;     // Output buffer in bytes (0 = MD_BUFFER_DEFAULT)
+    bool sync;              // fdatasync() the file on close
+    MdCompression compress; // Compressor the output streams through
+} MarkdownOptions;
+
 /**
  * @brief Opens a new Markdown file for writing.
  *
+ * Output is gathered in a buffer of `buffer_size` bytes; a piece that does
+ * not fit goes out in one writev() together with the buffered bytes,
+ * without being copied.
+ *
+ * With compression, the handle writes into a pipe to a compressor process
+ * whose output is the file. Compression runs alongside the export, in
+ * blocks as the pipe fills, and the uncompressed text is never stored.
+ *
  * @param filename The path to the file to open (will be overwritten).
+ * @param opts The write settings (NULL for the defaults).
+ * @return A pointer to a new MarkdownHandle, or NULL on failure.
+ */
+MarkdownHandle *md_open_file(const char *filename, const MarkdownOptions *opts);
+
+/**
+ * @brief Starts a Markdown file on an open descriptor, which need not be
+ * seekable (a pipe or a terminal), with the same settings as
+ * md_open_file().
+ *
+ * @param fd A writable descriptor, owned by the handle from now on (closed
+ * on failure too).
+ * @param opts The write settings (NULL for the defaults).
  * @return A pointer to a new MarkdownHandle, or NULL on failure.
  */
-MarkdownHandle *md_open_file(const char *filename);
+MarkdownHandle *md_open_fd(int fd, const MarkdownOptions *opts);
 
 /**
- * @brief Closes the Markdown file and frees the handle.
+ * @brief Writes out the buffered output, closes the Markdown file and frees
+ * the handle. A compressor is waited for, and must exit successfully.
  *
  * @param handle The handle to close.
+ * @return true on success, false if any write (or the requested sync)
+ * failed.
  */
-void md_close_file(MarkdownHandle *handle);
+bool md_close_file(MarkdownHandle *handle);
 
 /**
  * @brief Adds a header to the Markdown file.
@@ -33,7 +84,18 @@ void md_close_file(MarkdownHandle *handle);
 void md_add_header(MarkdownHandle *handle, int level, const char *text);
 
 /**
- * @brief Adds a fenced code block to the Markdown file.
+ * @brief Adds a header whose text length is known.
+ *
+ * @param handle The Markdown file handle.
+ * @param level The header level (1 to 6).
+ * @param text The header text.
+ * @param length The number of bytes of text.
+ */
+void md_add_header_len(MarkdownHandle *handle, int level, const char *text, size_t length);
+
+/**
+ * @brief Adds a fenced code block to the Markdown file, with a fence longer
+ * than any run of backticks in the content.
  *
  * @param handle The Markdown file handle.
  * @param language_tag The syntax highlighting tag (e.g., "c", "python").
@@ -41,6 +103,74 @@ void md_add_header(MarkdownHandle *handle, int level, const char *text);
  */
 void md_add_code_block(MarkdownHandle *handle, const char *language_tag, const char *content);
 
+/**
+ * @brief Adds a fenced code block whose content may contain NUL bytes.
+ *
+ * @param handle The Markdown file handle.
+ * @param language_tag The syntax highlighting tag (e.g., "c", "python").
+ * @param content The code content to write inside the block.
+ * @param length The number of bytes of content.
+ * @param fence The number of backticks of the fence, longer than any run of
+ * backticks in the content (see content_scan_fence()); at least 3.
+ */
+void md_add_code_block_len(MarkdownHandle *handle, const char *language_tag, const char *content,
+                           size_t length, size_t fence);
+
+/**
+ * @brief Adds a fenced code block whose content is copied from a file.
+ *
+ * Only the fence lines are buffered. The handle is flushed and the body
+ * moves from fd to the output in the kernel (copy_file_range(), then
+ * sendfile()), or through a fixed-size buffer where neither is supported,
+ * so memory use does not depend on the file size.
+ *
+ * @param handle The Markdown file handle.
+ * @param language_tag The syntax highlighting tag (e.g., "c", "python").
+ * @param fd A readable descriptor; everything from its offset to EOF is
+ * copied.
+ * @param fence The number of backticks of the fence, as for
+ * md_add_code_block_len().
+ * @param hash Receives hash_bytes() of the bytes copied, or NULL. Hashing
+ * makes the body go through the buffer rather than the kernel.
+ * @return true on success, false if the body could not be copied in full
+ * (the block is still closed).
+ */
+bool md_add_code_block_fd(MarkdownHandle *handle, const char *language_tag, int fd, size_t fence,
+                          uint64_t *hash);
+
+/**
+ * @brief Copies a byte range of another file verbatim into the Markdown
+ * file, in-kernel where possible.
+ *
+ * @param handle The Markdown file handle.
+ * @param fd The source file (its offset is not changed).
+ * @param offset The start of the range in the source file.
+ * @param length The number of bytes to copy.
+ * @return true on success, false on a read or write error (or if the
+ * source is shorter than the range).
+ */
+bool md_add_raw_range(MarkdownHandle *handle, int fd, uint64_t offset, uint64_t length);
+
+/**
+ * @brief Tells where the body of the last code block lies in the Markdown
+ * file (inside its fences).
+ *
+ * @param handle The Markdown file handle.
+ * @param offset Receives the position of the body's first byte.
+ * @param length Receives the number of bytes of the body.
+ */
+void md_last_block(MarkdownHandle *handle, uint64_t *offset, uint64_t *length);
+
+/**
+ * @brief Returns the number of bytes written to the Markdown file so far,
+ * buffered ones included (without flushing). With compression, this counts
+ * the uncompressed bytes.
+ *
+ * @param handle The Markdown file handle.
+ * @return The current offset in the file.
+ */
+uint64_t md_tell(MarkdownHandle *handle);
+
 /**
  * @brief Adds raw text (verbatim) to the Markdown file.
  *
@@ -49,4 +179,13 @@ void md_add_code_block(MarkdownHandle *handle, const char *language_tag, const c
  */
 void md_add_raw_text(MarkdownHandle *handle, const char *text);
 
+/**
+ * @brief Adds raw text whose length is known.
+ *
+ * @param handle The Markdown file handle.
+ * @param text The raw text to append (may contain NUL bytes).
+ * @param length The number of bytes of text.
+ */
+void md_add_raw_text_len(MarkdownHandle *handle, const char *text, size_t length);
+
 #endif // MARKDOWN_H
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <stddef.h>
+
+/**
+ * @brief One "Section:key" setting of a built-in profile.
+ */
+typedef struct {
+    const char *key;
+    const char *value;
+} ProfileSetting;
+
+/**
+ * @brief A language profile compiled into the binary from config/<name>.ini
+ * (the table is generated by tools/profiles.awk at build time).
+ */
+typedef struct {
+    const char *name;                // The .ini file's stem (e.g., "c")
+    const ProfileSetting *settings; // In file order
+    size_t count;
+} BuiltinProfile;
+
+extern const BuiltinProfile builtin_profiles[];
+extern const size_t builtin_profile_count;
+
+#endif // PROFILES_H
@@ -0,0 +1,121 @@
+#ifndef READER_H
+#define READER_H
+
+#include "scan.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define READER_BUFFER_MAX (64 * 1024)       // Up to this size: read into a pooled buffer
+#define READER_HEAP_MAX (16 * 1024 * 1024) // Up to this size: read into the heap; above: stream
+
+#define READER_POOL_MIN_SHIFT 12                  // Pooled buffers: 4 KiB, 8 KiB, ...
+#define READER_POOL_CLASSES 6                     // ... up to 128 KiB (READER_BUFFER_MAX + 1)
+#define READER_POOL_CLASS_BYTES (2 * 1024 * 1024) // Idle bytes kept per size class
+
+/**
+ * @brief How a file body is held between reading and emission.
+ */
+typedef enum {
+    BODY_NONE,   // Not loaded (unreadable, or not read yet)
+    BODY_BUFFER, // Read into a heap buffer (small files)
+    BODY_HEAP,   // Read into a buffer of its own (mid-size files)
+    BODY_STREAM, // Not held in memory: streamed in chunks when emitted
+} BodyMode;
+
+/**
+ * @brief A file body loaded by reader_load().
+ */
+typedef struct {
+    BodyMode mode;
+    const char *data; // BODY_BUFFER / BODY_HEAP contents
+    size_t length;    // Bytes of data (the file size for BODY_STREAM)
+    size_t capacity;  // BODY_BUFFER: size of the pooled buffer (0 if not pooled)
+    ContentScan scan; // Binary check, UTF-8, fence and line count of the body
+} FileBody;
+
+/**
+ * @brief Counters of the file buffer pool.
+ */
+typedef struct {
+    size_t allocated; // Buffers obtained from malloc()
+    size_t reused;    // Buffers handed out again from the pool
+} ReaderPoolStats;
+
+/**
+ * @brief Picks the read mode for a file of the given size.
+ *
+ * @param size The file size in bytes.
+ * @return BODY_BUFFER, BODY_HEAP or BODY_STREAM.
+ */
+BodyMode reader_select_mode(uint64_t size);
+
+/**
+ * @brief Loads a file body in the mode suited to its size.
+ *
+ * Small files are read into a pooled buffer (reader_buffer_acquire()),
+ * mid-size ones into a buffer of their fstat() size. Files are read rather
+ * than mapped, so one truncated while it is exported comes out shorter
+ * instead of faulting (SIGBUS) on the pages past its new end. Large files
+ * are not read at all (BODY_STREAM): the caller streams them from a
+ * descriptor at emission time. A small file that grew past its buffer is
+ * read again by its new size, and a mid-size one is streamed, so memory
+ * use never depends on the file size.
+ *
+ * Every loaded body is scanned once (content_scan()). A streamed body is
+ * only scanned as far as SCAN_STREAM_PROBE, through fd without moving its
+ * offset, so that its bytes are read once, by the copy into the report.
+ *
+ * @param body Receives the body; release it with reader_release().
+ * @param fd An open descriptor positioned at the start of the file.
+ * @param size The file size reported by fstat().
+ * @return true on success, false if the file could not be read.
+ */
+bool reader_load(FileBody *body, int fd, uint64_t size);
+
+/**
+ * @brief Frees or unmaps a body loaded by reader_load().
+ *
+ * @param body The body to release (reset to BODY_NONE).
+ */
+void reader_release(FileBody *body);
+
+/**
+ * @brief Takes a buffer of at least `size` bytes from the process-wide pool
+ * of file buffers (thread-safe).
+ *
+ * Buffers come in power-of-two size classes; released ones are kept for
+ * reuse, up to READER_POOL_CLASS_BYTES per class, so reading many small
+ * files settles into a few buffers recycled between reads.
+ *
+ * @param size The bytes needed (at most the largest class).
+ * @param capacity Receives the buffer's size, to pass back on release.
+ * @return The buffer, or NULL if `size` is too large or out of memory.
+ */
+char *reader_buffer_acquire(size_t size, size_t *capacity);
+
+/**
+ * @brief Returns a buffer to the pool (thread-safe).
+ *
+ * @param buffer A buffer from reader_buffer_acquire() (NULL is ignored).
+ * @param capacity The capacity it was acquired with.
+ */
+void reader_buffer_release(char *buffer, size_t capacity);
+
+/**
+ * @brief Frees the idle buffers of the pool.
+ *
+ * @param stats Receives the pool's counters (may be NULL).
+ */
+void reader_pool_drain(ReaderPoolStats *stats);
+
+/**
+ * @brief Parses a size such as "512", "64K", "10M" or "2G".
+ *
+ * @param str The string to parse (surrounding whitespace is not allowed).
+ * @param size Receives the size in bytes.
+ * @return true on success, false if the string is not a valid size.
+ */
+bool reader_parse_size(const char *str, uint64_t *size);
+
+#endif // READER_H
@@ -0,0 +1,97 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCAN_BINARY_PROBE 8192        // A NUL byte within this prefix marks a binary file
+#define SCAN_FENCE_MIN 3              // Backticks of a code fence
+#define SCAN_STREAM_PROBE (64 * 1024) // Bytes of a streamed body that are scanned
+#define SCAN_STREAM_FENCE 16          // Least fence of a body scanned only in part
+
+/**
+ * @brief What a single pass over a file body found out, accumulated across
+ * calls to content_scan_update().
+ */
+typedef struct {
+    uint64_t offset;    // Bytes scanned so far
+    uint64_t lines;     // Lines, counting an unterminated last one
+    size_t longest_run; // Longest run of backticks
+    size_t run;         // Backticks at the end of the bytes scanned so far
+    bool binary;        // A NUL byte within the first SCAN_BINARY_PROBE bytes
+    bool utf8_valid;    // No invalid (or truncated) UTF-8 sequence
+    bool partial_line;  // The last byte scanned was not a newline
+    bool partial;       // Only a prefix was scanned (lines are not counted)
+    uint8_t utf8_need;  // Continuation bytes still expected
+    uint8_t utf8_lo;    // Range of the next continuation byte
+    uint8_t utf8_hi;
+} ContentScan;
+
+/**
+ * @brief Starts a scan.
+ *
+ * @param scan The scan to reset.
+ */
+void content_scan_init(ContentScan *scan);
+
+/**
+ * @brief Scans the next bytes of a body.
+ *
+ * Works through 64-byte blocks, reduced to bitmasks of NUL bytes,
+ * newlines, backticks and non-ASCII bytes with AVX2 or SSE2 where the CPU
+ * has them (plain C otherwise). Only blocks with non-ASCII bytes go
+ * through the UTF-8 validator. Once the body is known to be binary the
+ * rest is not looked at.
+ *
+ * @param scan The scan.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ */
+void content_scan_update(ContentScan *scan, const char *data, size_t length);
+
+/**
+ * @brief Ends a scan: counts an unterminated last line and rejects a
+ * truncated UTF-8 sequence.
+ *
+ * @param scan The scan.
+ */
+void content_scan_finish(ContentScan *scan);
+
+/**
+ * @brief Scans a whole buffer (init, update and finish).
+ *
+ * @param scan Receives the result.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ */
+void content_scan(ContentScan *scan, const char *data, size_t length);
+
+/**
+ * @brief Scans up to `limit` bytes of a file from its start with pread(),
+ * without moving its offset. A binary file is only read as far as
+ * SCAN_BINARY_PROBE.
+ *
+ * A file longer than `limit` is left partly scanned (`partial`): its line
+ * count is 0 and its UTF-8 check and backtick runs cover the prefix only.
+ *
+ * @param scan Receives the result.
+ * @param fd The file.
+ * @param limit The most bytes to read.
+ * @return true on success, false on a read error.
+ */
+bool content_scan_fd(ContentScan *scan, int fd, uint64_t limit);
+
+/**
+ * @brief Returns the number of backticks of a fence no line of the body
+ * can close: one more than its longest run, and at least SCAN_FENCE_MIN.
+ * A partial scan cannot see every run, so its fence is at least
+ * SCAN_STREAM_FENCE: only a line of that many backticks past the scanned
+ * prefix could close it.
+ *
+ * @param scan A finished scan.
+ * @return The fence length.
+ */
+size_t content_scan_fence(const ContentScan *scan);
+
+#endif // SCAN_H
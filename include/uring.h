@@ -0,0 +1,75 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define URING_MIN_DEPTH 2 // A file takes up to two requests per round
+#define URING_DEFAULT_DEPTH 64
+#define URING_MAX_DEPTH 4096
+
+/**
+ * @brief An opaque io_uring instance driven through the raw system calls
+ * (no liburing dependency).
+ *
+ * Not thread-safe: one thread submits and reaps.
+ */
+typedef struct Uring Uring;
+
+/**
+ * @brief Sets up a ring.
+ *
+ * @param depth The submission queue size (rounded up to a power of two by
+ * the kernel).
+ * @return A pointer to a new Uring, or NULL if io_uring is unavailable
+ * (old kernel, seccomp, ...). The caller is responsible for freeing it with
+ * uring_destroy().
+ */
+Uring *uring_create(unsigned depth);
+
+/**
+ * @brief Tears down the ring. Requests still in flight are abandoned.
+ *
+ * @param ring The ring to destroy.
+ */
+void uring_destroy(Uring *ring);
+
+/**
+ * @brief Returns the next free submission entry, zeroed.
+ *
+ * @param ring The ring.
+ * @return The entry to fill, or NULL if the submission queue is full.
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+
+/**
+ * @brief Submits every entry obtained since the last call and waits until
+ * at least `wait_nr` completions are available.
+ *
+ * @param ring The ring.
+ * @param wait_nr The number of completions to wait for.
+ * @return true on success, false on a submission error.
+ */
+bool uring_submit_and_wait(Uring *ring, unsigned wait_nr);
+
+/**
+ * @brief Pops one completion, if any.
+ *
+ * @param ring The ring.
+ * @param user_data Receives the user_data of the completed request.
+ * @param res Receives the result (a negated errno on failure).
+ * @return true if a completion was popped, false if the queue is empty.
+ */
+bool uring_next_cqe(Uring *ring, uint64_t *user_data, int32_t *res);
+
+/**
+ * @brief Counts the requests the kernel has taken whose completions have
+ * not been popped yet.
+ *
+ * @param ring The ring.
+ * @return The number of requests still owed a completion.
+ */
+unsigned uring_in_flight(const Uring *ring);
+
+#endif // URING_H
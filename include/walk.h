@@ -0,0 +1,142 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Reads dirent.d_type where the platform has it; DT_UNKNOWN makes
+ * walk_resolve_kind() fall back to a stat.
+ */
+#ifdef _DIRENT_HAVE_D_TYPE
+#define WALK_DTYPE(entry) ((entry)->d_type)
+#else
+#define WALK_DTYPE(entry) DT_UNKNOWN
+#endif
+
+/**
+ * @brief The kind of a directory entry, after following symbolic links.
+ */
+typedef enum {
+    WALK_FILE,  // Regular file
+    WALK_DIR,   // Directory
+    WALK_OTHER, // FIFO, socket, device, ...
+} WalkKind;
+
+/**
+ * @brief One entry produced by dirwalk_next().
+ *
+ * The strings point into the walker's path buffer and stay valid only until
+ * the next call to dirwalk_next() or dirwalk_descend().
+ */
+typedef struct {
+    const char *path; // Full path: "<root>/<relative path>"
+    size_t path_len;
+    const char *name; // Entry name (points inside path)
+    int depth;        // 0 for direct children of the root
+    WalkKind kind;
+} WalkEntry;
+
+/**
+ * @brief An opaque, iterative (non-recursive) directory walker.
+ *
+ * Entries are produced in pre-order, in readdir order within a directory.
+ * Names are resolved relative to an open directory descriptor and the
+ * entry type is taken from dirent.d_type whenever the filesystem provides
+ * it, so most entries cost no stat call at all.
+ */
+typedef struct DirWalk DirWalk;
+
+/**
+ * @brief Opens a walker rooted at a directory.
+ *
+ * @param root The directory to walk.
+ * @return A pointer to a new DirWalk, or NULL on failure.
+ * The caller is responsible for freeing it with dirwalk_close().
+ */
+DirWalk *dirwalk_open(const char *root);
+
+/**
+ * @brief Closes the walker and releases every open descriptor.
+ *
+ * @param walk The walker to close.
+ */
+void dirwalk_close(DirWalk *walk);
+
+/**
+ * @brief Advances to the next entry.
+ *
+ * Directories are not entered automatically: call dirwalk_descend() right
+ * after a WALK_DIR entry to visit its children next.
+ *
+ * @param walk The walker.
+ * @param entry Receives the entry.
+ * @return true if an entry was produced, false when the walk is finished.
+ */
+bool dirwalk_next(DirWalk *walk, WalkEntry *entry);
+
+/**
+ * @brief Enters the directory most recently returned by dirwalk_next().
+ *
+ * Directories already open higher up the stack (symlink cycles) are
+ * refused.
+ *
+ * @param walk The walker.
+ * @return true if the directory was entered, false otherwise.
+ */
+bool dirwalk_descend(DirWalk *walk);
+
+/**
+ * @brief Opens the file most recently returned by dirwalk_next() for
+ * reading, relative to its parent directory descriptor.
+ *
+ * @param walk The walker.
+ * @return A file descriptor, or -1 on failure. The caller must close it.
+ */
+int dirwalk_open_file(DirWalk *walk);
+
+/**
+ * @brief Stats the entry most recently returned by dirwalk_next(),
+ * following symbolic links, relative to its parent directory descriptor.
+ *
+ * @param walk The walker.
+ * @param st Receives the file status.
+ * @return true on success, false otherwise.
+ */
+bool dirwalk_stat(DirWalk *walk, struct stat *st);
+
+/**
+ * @brief Returns the descriptor of the directory holding the entry most
+ * recently returned by dirwalk_next(). It stays owned by the walker.
+ *
+ * @param walk The walker.
+ * @return The descriptor, or -1 if the directory was closed to bound the
+ * number of open descriptors.
+ */
+int dirwalk_dir_fd(const DirWalk *walk);
+
+/**
+ * @brief Resolves a directory entry type, falling back to fstatat() only
+ * when d_type is unknown or a symbolic link.
+ *
+ * @param dirfd The directory containing the entry.
+ * @param name The entry name.
+ * @param d_type The dirent.d_type value reported by readdir().
+ * @param kind Receives the resolved kind.
+ * @return true on success, false if the entry vanished or cannot be read.
+ */
+bool walk_resolve_kind(int dirfd, const char *name, unsigned char d_type, WalkKind *kind);
+
+/**
+ * @brief Reads the rest of an already open file into a newly allocated,
+ * null-terminated buffer. The descriptor is not closed.
+ *
+ * @param fd The open file descriptor.
+ * @param length Receives the number of bytes read (may be NULL).
+ * @return The file contents, or NULL on failure.
+ */
+char *walk_read_fd(int fd, size_t *length);
+
+#endif // WALK_H
@@ -0,0 +1,79 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "fstree.h"
+#include <stdbool.h>
+
+/**
+ * @brief An opaque inotify watcher over the directories of a project.
+ *
+ * Only directories shown in the report are watched: ignored directories
+ * are never descended, so they cost no watch at all.
+ */
+typedef struct Watcher Watcher;
+
+/**
+ * @brief Creates a watcher with no watches yet.
+ *
+ * @param output_file The report path; events on the report and its
+ * companion files are ignored, so writing the report never triggers
+ * another update.
+ * @return A pointer to a new Watcher, or NULL on failure.
+ * The caller is responsible for freeing it with watcher_free().
+ */
+Watcher *watcher_create(const char *output_file);
+
+/**
+ * @brief Frees the watcher and removes every watch.
+ *
+ * @param watcher The watcher to free.
+ */
+void watcher_free(Watcher *watcher);
+
+/**
+ * @brief Watches every non-ignored directory of a freshly scanned tree.
+ *
+ * Directories already watched keep their watch; directories that left the
+ * tree (or were marked FS_NODE_REMOVED by a rescan) are unwatched when
+ * their next event arrives. The tree must stay alive until the next call.
+ *
+ * @param watcher The watcher.
+ * @param tree The scanned project.
+ * @return true on success, false on allocation failure.
+ */
+bool watcher_sync(Watcher *watcher, const FsTree *tree);
+
+/**
+ * @brief Watches the non-ignored directories of a subtree that a rescan
+ * added to the watched tree (see fs_tree_added()).
+ *
+ * @param watcher The watcher.
+ * @param dir The added directory.
+ * @return true on success, false on allocation failure.
+ */
+bool watcher_add(Watcher *watcher, const FsNode *dir);
+
+/**
+ * @brief Blocks until a relevant change has happened and settled.
+ *
+ * Events are batched: the call returns once no relevant event has arrived
+ * for a short quiet period, or once the first event of the batch is old
+ * enough, so a burst such as a branch checkout leads to a single update.
+ *
+ * @param watcher The watcher.
+ * @return true once the project has changed, false on error.
+ */
+bool watcher_wait(Watcher *watcher);
+
+/**
+ * @brief Returns the directories changed by the batch of the last
+ * watcher_wait(), to pass to fs_tree_rescan().
+ *
+ * @param watcher The watcher.
+ * @param count Receives the number of changes.
+ * @return The changes, or NULL if the whole project must be scanned again
+ * (events were lost, or too many directories changed).
+ */
+const FsTreeChange *watcher_changes(const Watcher *watcher, size_t *count);
+
+#endif // WATCH_H
@@ -0,0 +1,59 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/**
+ * @brief An opaque thread pool that hands out tasks through per-worker
+ * work-stealing deques.
+ *
+ * Each worker pops its own deque LIFO (depth-first, cache friendly) and,
+ * when it runs dry, steals the oldest task from another worker's deque.
+ */
+typedef struct WorkPool WorkPool;
+
+/**
+ * @brief Callback invoked on a worker thread for every task.
+ *
+ * @param pool The pool running the task (follow-up tasks may be pushed).
+ * @param worker The index of the calling worker, in [0, threads).
+ * @param task The task pointer given to workpool_push().
+ * @param ctx The user context given to workpool_create().
+ */
+typedef void (*WorkFn)(WorkPool *pool, int worker, void *task, void *ctx);
+
+/**
+ * @brief Creates a pool and starts its worker threads.
+ *
+ * @param threads The number of worker threads to start (at least 1).
+ * @param fn The callback that processes each task.
+ * @param ctx A user context passed to every callback invocation.
+ * @return A pointer to a new WorkPool, or NULL on failure.
+ * The caller is responsible for freeing it with workpool_destroy().
+ */
+WorkPool *workpool_create(int threads, WorkFn fn, void *ctx);
+
+/**
+ * @brief Queues a task.
+ *
+ * @param pool The pool.
+ * @param worker The calling worker's index, or -1 from outside the pool.
+ * @param task The task to queue (must not be NULL).
+ */
+void workpool_push(WorkPool *pool, int worker, void *task);
+
+/**
+ * @brief Blocks until every queued task, including follow-ups, has finished.
+ *
+ * @param pool The pool.
+ */
+void workpool_wait(WorkPool *pool);
+
+/**
+ * @brief Stops the worker threads and frees the pool.
+ *
+ * Tasks still queued are run before the workers exit.
+ *
+ * @param pool The pool to destroy.
+ */
+void workpool_destroy(WorkPool *pool);
+
+#endif // WORKPOOL_H
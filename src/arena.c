@@ -0,0 +1,137 @@
+#include "arena.h"
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_FIRST_CHUNK_SIZE 1024 // Doubled with each chunk, up to ARENA_CHUNK_SIZE
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+/**
+ * @brief A block of arena memory; chunks form a singly linked list.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size; // Usable bytes after the header
+    size_t used;
+} ArenaChunk;
+
+/**
+ * @brief Internal representation of an arena.
+ */
+struct Arena {
+    ArenaChunk *head;       // Chunk currently being carved
+    size_t next_size;       // Size of the next regular chunk
+    void *last;             // The latest allocation, which can grow in place
+    ArenaChunk *last_chunk; // The chunk holding it
+};
+
+/**
+ * @brief Size of the chunk header, rounded so the data stays aligned.
+ */
+static size_t chunk_header_size(void)
+{
+    return (sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+Arena *arena_create(void)
+{
+    return calloc(1, sizeof(Arena));
+}
+
+void arena_destroy(Arena *arena)
+{
+    if (!arena)
+        return;
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+/**
+ * @brief Carves `size` bytes aligned to `align` (a power of two) out of the
+ * current chunk, starting a new chunk when it does not fit.
+ */
+static void *arena_carve(Arena *arena, size_t size, size_t align)
+{
+    if (!arena)
+        return NULL;
+
+    ArenaChunk *chunk = arena->head;
+    size_t offset = chunk ? (chunk->used + align - 1) & ~(align - 1) : 0;
+    if (!chunk || offset > chunk->size || chunk->size - offset < size) {
+        // Chunks grow geometrically, so small arenas stay small; oversized
+        // requests get a chunk of their own
+        size_t regular = arena->next_size ? arena->next_size : ARENA_FIRST_CHUNK_SIZE;
+        while (regular < ARENA_CHUNK_SIZE && regular / 4 < size)
+            regular *= 2;
+        bool oversized = size > regular / 4;
+        size_t chunk_size = oversized ? size : regular;
+        ArenaChunk *fresh = malloc(chunk_header_size() + chunk_size);
+        if (!fresh)
+            return NULL;
+        fresh->size = chunk_size;
+        fresh->used = 0;
+        if (!oversized)
+            arena->next_size = regular < ARENA_CHUNK_SIZE ? regular * 2 : regular;
+        if (chunk && oversized) {
+            // Keep carving the current chunk afterwards
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+        }
+        else {
+            fresh->next = chunk;
+            arena->head = fresh;
+        }
+        chunk = fresh;
+        offset = 0;
+    }
+
+    chunk->used = offset + size;
+    arena->last = (char *)chunk + chunk_header_size() + offset;
+    arena->last_chunk = chunk;
+    return arena->last;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    return arena_carve(arena, size, ARENA_ALIGN);
+}
+
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr)
+        return arena_alloc(arena, new_size);
+    if (new_size <= old_size)
+        return ptr;
+
+    // The latest allocation is extended where it lies if its chunk has room
+    ArenaChunk *chunk = arena->last_chunk;
+    if (ptr == arena->last) {
+        size_t offset = (size_t)((char *)ptr - ((char *)chunk + chunk_header_size()));
+        if (chunk->size - offset >= new_size) {
+            chunk->used = offset + new_size;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (moved)
+        memcpy(moved, ptr, old_size);
+    return moved;
+}
+
+char *arena_strndup(Arena *arena, const char *str, size_t len)
+{
+    char *copy = arena_carve(arena, len + 1, 1);
+    if (!copy)
+        return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
@@ -1,189 +1,482 @@
-#define _GNU_SOURCE // For strdup() and wordexp()
 #include "config.h"
+#include "hash.h"
 #include "iniparser.h"
+#include "profiles.h"
+#include "reader.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <wordexp.h> // Added for tilde expansion
 
 #define MAX_PATHS 3
+#define OVERRIDE_PATHS 2 // Searched before the built-in profiles
 #define PATH_BUF_SIZE 1024
 
 // Dummy variable, for type-checking in some environments.
 LanguageProfile *dummy = NULL;
 
+#define PROFILE_MIN_CAP 64
+
 /**
- * @brief Parses a comma-separated string into an array of strings.
+ * @brief Finds the slot of a key in the profile's table: its entry, or the
+ * free slot where it would go.
+ */
+static ProfileKey *find_slot(const LanguageProfile *profile, const char *key, size_t len,
+                             uint64_t hash)
+{
+    size_t mask = profile->key_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        ProfileKey *slot = &profile->keys[i];
+        if (!slot->key ||
+            (slot->hash == hash && slot->key_len == len && memcmp(slot->key, key, len) == 0))
+            return slot;
+    }
+}
+
+/**
+ * @brief Looks up a key.
  *
- * @param str The string to parse (e.g., "c,h,md"). This string is modified.
- * @param arr The array to store the resulting string pointers.
- * @param max_count The maximum number of items to store in arr.
- * @return The number of items parsed.
+ * @return The entry, or NULL if no list names the key.
  */
-static int parse_comma_separated_string(char *str, char *arr[], int max_count)
+static const ProfileKey *lookup_key(const LanguageProfile *profile, const char *key)
 {
-    if (!str)
-        return 0;
-    int count = 0;
-    char *token = strtok(str, ",");
-    while (token && count < max_count) {
-        arr[count++] = strdup(token);
-        token = strtok(NULL, ",");
+    if (profile->key_count == 0 || key[0] == '\0')
+        return NULL;
+    size_t len = strlen(key);
+    const ProfileKey *slot = find_slot(profile, key, len, hash_bytes(key, len));
+    return slot->key ? slot : NULL;
+}
+
+/**
+ * @brief Returns the entry of a key, adding it if new.
+ *
+ * The key is not copied: it points into the profile's strings. The table
+ * is sized for every item of the lists up front.
+ *
+ * @return The entry.
+ */
+static ProfileKey *intern_key(LanguageProfile *profile, const char *key, size_t len)
+{
+    uint64_t hash = hash_bytes(key, len);
+    ProfileKey *slot = find_slot(profile, key, len, hash);
+    if (!slot->key) {
+        slot->key = key;
+        slot->key_len = len;
+        slot->hash = hash;
+        slot->syntax = -1;
+        profile->key_count++;
     }
-    return count;
+    return slot;
 }
 
 /**
- * @brief Parses a comma-separated "key:value" string into the syntax_map.
+ * @brief Adds each item of a comma-separated list to the table with a role.
  *
- * @param str The string to parse (e.g., "c:c,h:c,Makefile:makefile").
- * @param profile The profile where the map will be stored.
- * @param max_count The maximum number of items to store.
- * @return The number of key:value pairs parsed.
+ * @param profile The profile being loaded.
+ * @param list The list (e.g., "c,h,md"), in the profile's strings. It is
+ * split in place. Empty items are skipped.
+ * @param role The PROFILE_* bit to give each item.
  */
-static int parse_syntax_map(char *str, LanguageProfile *profile, int max_count)
+static void add_list(LanguageProfile *profile, char *list, uint8_t role)
 {
-    if (!str || !profile)
-        return 0;
-    int count = 0;
-    char *token = strtok(str, ",");
-    while (token && count < max_count) {
-        char *colon = strchr(token, ':');
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        bool last = list[len] == '\0';
+        list[len] = '\0';
+        if (len > 0)
+            intern_key(profile, list, len)->roles |= role;
+        list += last ? len : len + 1;
+    }
+}
+
+/**
+ * @brief Parses a comma-separated "key:value" string into the syntax map.
+ *
+ * The first mapping of a key wins, as when the map was scanned in order.
+ *
+ * @param profile The profile being loaded.
+ * @param list The list (e.g., "c:c,h:c,Makefile:makefile"), in the
+ * profile's strings. It is split in place.
+ */
+static void add_syntax_map(LanguageProfile *profile, char *list)
+{
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        bool last = list[len] == '\0';
+        list[len] = '\0';
+        char *colon = memchr(list, ':', len);
         if (colon) {
             *colon = '\0';
-            profile->syntax_map[count].ext = strdup(token);
-            profile->syntax_map[count].tag = strdup(colon + 1);
-            count++;
+            ProfileKey *entry = intern_key(profile, list, (size_t)(colon - list));
+            profile->syntax_tags[profile->syntax_count] = colon + 1;
+            if (entry->syntax < 0)
+                entry->syntax = profile->syntax_count;
+            profile->syntax_count++;
         }
-        token = strtok(NULL, ",");
+        list += last ? len : len + 1;
     }
-    return count;
 }
 
 /**
- * @brief Helper function to expand tilde (~) paths.
+ * @brief Where a profile's settings come from: an .ini file or a table
+ * compiled into the binary.
+ */
+typedef struct {
+    dictionary *ini;
+    const BuiltinProfile *builtin;
+} ProfileSource;
+
+/**
+ * @brief Retrieves a setting by key (e.g., "Filters:max_file_size").
  *
- * @param path The path string to expand (e.g., "~/.config").
- * @return A new, allocated string with the expanded path.
- * The caller must free the returned string.
+ * @return The value, or `def` if the profile does not set it.
  */
-static char *expand_path(const char *path)
+static const char *source_get(const ProfileSource *source, const char *key, const char *def)
 {
-    wordexp_t p;
-    char *expanded = NULL;
+    if (source->ini)
+        return iniparser_getstring(source->ini, key, def);
+    for (size_t i = 0; i < source->builtin->count; i++)
+        if (strcmp(source->builtin->settings[i].key, key) == 0)
+            return source->builtin->settings[i].value;
+    return def;
+}
 
-    if (wordexp(path, &p, 0) == 0) {
-        if (p.we_wordc > 0) {
-            expanded = strdup(p.we_wordv[0]);
-        }
-        wordfree(&p);
+/**
+ * @brief Reads an optional size setting (e.g., "10M") from the profile.
+ *
+ * @param source The profile's settings.
+ * @param key The key to read (e.g., "Filters:max_file_size").
+ * @param language The profile name, for the warning message.
+ * @return The size in bytes, or 0 (no limit) if unset or invalid.
+ */
+static uint64_t parse_size_setting(const ProfileSource *source, const char *key,
+                                   const char *language)
+{
+    const char *value = source_get(source, key, "");
+    uint64_t size = 0;
+    if (value[0] != '\0' && !reader_parse_size(value, &size)) {
+        fprintf(stderr, "Warning: Ignoring invalid size '%s' for '%s' in profile '%s'.\n", value,
+                key, language);
+        return 0;
     }
-    return expanded;
+    return size;
 }
 
-LanguageProfile *load_language_profile(const char *language)
+/**
+ * @brief The lists compiled into a profile's lookup table, with the role
+ * they give their items (0 for the syntax map).
+ */
+static const struct {
+    const char *key;
+    uint8_t role;
+} profile_lists[] = {
+    {"Filters:allowed_extensions", PROFILE_ALLOWED_EXT},
+    {"Filters:allowed_dotfiles", PROFILE_ALLOWED_DOTFILE},
+    {"Filters:allowed_filenames", PROFILE_ALLOWED_NAME},
+    {"Filters:ignored_extensions", PROFILE_IGNORED_EXT},
+    {"Filters:ignored_filenames", PROFILE_IGNORED_NAME},
+    {"Markdown:syntax_map", 0},
+};
+
+#define PROFILE_LIST_COUNT (sizeof(profile_lists) / sizeof(profile_lists[0]))
+
+/**
+ * @brief Counts the items of a comma-separated list (empty ones included).
+ */
+static size_t count_items(const char *list)
 {
-    dictionary *ini = NULL;
-    char ini_path[PATH_BUF_SIZE];
+    size_t count = 1;
+    while ((list = strchr(list, ',')) != NULL) {
+        count++;
+        list++;
+    }
+    return count;
+}
+
+/**
+ * @brief Builds a profile from its settings.
+ *
+ * The lists are copied once, into a single block split in place into the
+ * table's keys and the syntax tags. The table is sized for every item, so
+ * it never grows.
+ *
+ * @return A new profile, or NULL if out of memory (an error has been printed).
+ */
+static LanguageProfile *compile_profile(const ProfileSource *source, const char *language)
+{
+    const char *values[PROFILE_LIST_COUNT];
+    size_t total = 0;
+    size_t items = 0;
+    for (size_t i = 0; i < PROFILE_LIST_COUNT; i++) {
+        values[i] = source_get(source, profile_lists[i].key, "");
+        total += strlen(values[i]) + 1;
+        items += count_items(values[i]);
+    }
+    size_t key_cap = PROFILE_MIN_CAP;
+    while (key_cap < items * 2) // Keep the load factor under 1/2
+        key_cap *= 2;
+    size_t tag_cap = count_items(values[PROFILE_LIST_COUNT - 1]); // The syntax map comes last
+
+    Arena *arena = arena_create();
+    LanguageProfile *profile = arena ? arena_alloc(arena, sizeof(LanguageProfile)) : NULL;
+    ProfileKey *keys = profile ? arena_alloc(arena, key_cap * sizeof(ProfileKey)) : NULL;
+    const char **tags = keys ? arena_alloc(arena, tag_cap * sizeof(char *)) : NULL;
+    char *strings = tags ? arena_alloc(arena, total) : NULL;
+    if (!strings) {
+        fprintf(stderr, "Error: Out of memory loading language profile '%s'.\n", language);
+        arena_destroy(arena);
+        return NULL;
+    }
+    memset(profile, 0, sizeof(LanguageProfile));
+    memset(keys, 0, key_cap * sizeof(ProfileKey));
+    profile->arena = arena;
+    profile->keys = keys;
+    profile->key_cap = key_cap;
+    profile->syntax_tags = tags;
+
+    strncpy(profile->language_name, source_get(source, "Core:language_name", "Project"),
+            MAX_STR_LEN - 1);
+    profile->language_name[MAX_STR_LEN - 1] = '\0'; // Ensure null termination
+
+    // Compile every filter list and the syntax map into the lookup table
+    for (size_t i = 0; i < PROFILE_LIST_COUNT; i++) {
+        size_t len = strlen(values[i]);
+        memcpy(strings, values[i], len + 1);
+        if (profile_lists[i].role)
+            add_list(profile, strings, profile_lists[i].role);
+        else
+            add_syntax_map(profile, strings);
+        strings += len + 1;
+    }
+    profile->max_file_size = parse_size_setting(source, "Filters:max_file_size", language);
+    profile->max_total_size = parse_size_setting(source, "Filters:max_total_size", language);
+    return profile;
+}
 
+/**
+ * @brief Builds the path of one of the search directories, expanding "~"
+ * from $HOME.
+ *
+ * @return The path length, or 0 if the directory does not apply ($HOME
+ * unset) or the path is too long.
+ */
+static size_t profile_dir_path(int dir, char *buf, size_t size)
+{
     // Standard search paths for config files
-    const char *config_paths[MAX_PATHS] = {"./config", "~/.config/source-map",
-                                           "/usr/local/share/source-map/config"};
+    static const char *const config_paths[MAX_PATHS] = {
+        "./config", "~/.config/source-map", "/usr/local/share/source-map/config"};
 
-    for (int i = 0; i < MAX_PATHS; i++) {
-        char *base_path = NULL;
-        if (config_paths[i][0] == '~') {
-            base_path = expand_path(config_paths[i]);
-        }
-        else {
-            base_path = strdup(config_paths[i]);
-        }
+    const char *base = config_paths[dir];
+    const char *home = "";
+    if (base[0] == '~') {
+        home = getenv("HOME");
+        if (!home || home[0] == '\0')
+            return 0;
+        base++;
+    }
+    int len = snprintf(buf, size, "%s%s", home, base);
+    return len > 0 && (size_t)len < size ? (size_t)len : 0;
+}
 
-        if (!base_path)
+/**
+ * @brief Builds the path of a profile file in one of the search
+ * directories.
+ *
+ * @return true on success, false if the directory does not apply or the
+ * path is too long.
+ */
+static bool profile_file_path(int dir, const char *language, char *buf, size_t size)
+{
+    size_t len = profile_dir_path(dir, buf, size);
+    if (len == 0)
+        return false;
+    int added = snprintf(buf + len, size - len, "/%s.ini", language);
+    return added > 0 && (size_t)added < size - len;
+}
+
+/**
+ * @brief Loads the first "<language>.ini" found in search directories
+ * `first` to `last - 1`.
+ *
+ * @return The loaded dictionary, or NULL if there is none.
+ */
+static dictionary *load_profile_file(int first, int last, const char *language)
+{
+    char ini_path[PATH_BUF_SIZE];
+    for (int i = first; i < last; i++) {
+        if (!profile_file_path(i, language, ini_path, sizeof(ini_path)))
             continue;
+        dictionary *ini = iniparser_load(ini_path);
+        if (ini)
+            return ini; // File found and loaded
+    }
+    return NULL;
+}
 
-        snprintf(ini_path, sizeof(ini_path), "%s/%s.ini", base_path, language);
-        free(base_path); // Free the expanded/duplicated path
+/**
+ * @brief Finds a profile compiled into the binary.
+ *
+ * @return The profile, or NULL if there is none by that name.
+ */
+static const BuiltinProfile *find_builtin_profile(const char *language)
+{
+    for (size_t i = 0; i < builtin_profile_count; i++)
+        if (strcmp(builtin_profiles[i].name, language) == 0)
+            return &builtin_profiles[i];
+    return NULL;
+}
 
-        if (access(ini_path, F_OK) == 0) {
-            ini = iniparser_load(ini_path);
-            if (ini)
-                break; // File found and loaded
-        }
-    }
+LanguageProfile *load_language_profile(const char *language)
+{
+    // Files in ./config and ~/.config/source-map override the built-in
+    // profiles, which take precedence over the system-wide directory
+    ProfileSource source = {.ini = load_profile_file(0, OVERRIDE_PATHS, language)};
+    if (!source.ini)
+        source.builtin = find_builtin_profile(language);
+    if (!source.ini && !source.builtin)
+        source.ini = load_profile_file(OVERRIDE_PATHS, MAX_PATHS, language);
 
-    if (!ini) {
+    if (!source.ini && !source.builtin) {
         fprintf(stderr, "Error: Could not load language profile '%s'.\n", language);
         return NULL;
     }
 
-    LanguageProfile *profile = calloc(1, sizeof(LanguageProfile));
-    if (!profile) {
-        iniparser_freedict(ini);
-        return NULL;
+    LanguageProfile *profile = compile_profile(&source, language);
+    iniparser_freedict(source.ini);
+    return profile;
+}
+
+/**
+ * @brief Appends a copy of a name to a growing list.
+ *
+ * @return true on success, false if out of memory.
+ */
+static bool name_list_add(char ***names, size_t *count, size_t *cap, const char *name,
+                          size_t len)
+{
+    if (*count == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 32;
+        char **grown = realloc(*names, new_cap * sizeof(char *));
+        if (!grown)
+            return false;
+        *names = grown;
+        *cap = new_cap;
     }
+    char *copy = malloc(len + 1);
+    if (!copy)
+        return false;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    (*names)[(*count)++] = copy;
+    return true;
+}
 
-    // Load all filter strings from the .ini file
-    char *allowed_ext_str = strdup(iniparser_getstring(ini, "Filters:allowed_extensions", ""));
-    char *allowed_dot_str = strdup(iniparser_getstring(ini, "Filters:allowed_dotfiles", ""));
-    char *allowed_file_str = strdup(iniparser_getstring(ini, "Filters:allowed_filenames", ""));
-    char *ignored_ext_str = strdup(iniparser_getstring(ini, "Filters:ignored_extensions", ""));
-    char *ignored_file_str = strdup(iniparser_getstring(ini, "Filters:ignored_filenames", ""));
-    char *syntax_map_str = strdup(iniparser_getstring(ini, "Markdown:syntax_map", ""));
+/**
+ * @brief Orders profile names byte-wise.
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-    strncpy(profile->language_name, iniparser_getstring(ini, "Core:language_name", "Project"),
-            MAX_STR_LEN - 1);
-    profile->language_name[MAX_STR_LEN - 1] = '\0'; // Ensure null termination
+char **list_language_profiles(size_t *count)
+{
+    char **names = NULL;
+    size_t cap = 0;
+    bool ok = true;
+    *count = 0;
+    for (size_t i = 0; ok && i < builtin_profile_count; i++)
+        ok = name_list_add(&names, count, &cap, builtin_profiles[i].name,
+                           strlen(builtin_profiles[i].name));
 
-    // Parse the comma-separated strings into the profile struct
-    profile->allowed_extensions_count =
-        parse_comma_separated_string(allowed_ext_str, profile->allowed_extensions, MAX_EXTENSIONS);
-    profile->allowed_dotfiles_count =
-        parse_comma_separated_string(allowed_dot_str, profile->allowed_dotfiles, MAX_FILENAMES);
-    profile->allowed_filenames_count =
-        parse_comma_separated_string(allowed_file_str, profile->allowed_filenames, MAX_FILENAMES);
-    profile->ignored_extensions_count =
-        parse_comma_separated_string(ignored_ext_str, profile->ignored_extensions, MAX_EXTENSIONS);
-    profile->ignored_filenames_count =
-        parse_comma_separated_string(ignored_file_str, profile->ignored_filenames, MAX_FILENAMES);
-    profile->syntax_map_count = parse_syntax_map(syntax_map_str, profile, MAX_EXTENSIONS);
-
-    // Free the temporary strings
-    free(allowed_ext_str);
-    free(allowed_dot_str);
-    free(allowed_file_str);
-    free(ignored_ext_str);
-    free(ignored_file_str);
-    free(syntax_map_str);
-
-    iniparser_freedict(ini);
-    return profile;
+    char dir_path[PATH_BUF_SIZE];
+    for (int i = 0; ok && i < MAX_PATHS; i++) {
+        DIR *dir = profile_dir_path(i, dir_path, sizeof(dir_path)) ? opendir(dir_path) : NULL;
+        if (!dir)
+            continue;
+        struct dirent *entry;
+        while (ok && (entry = readdir(dir)) != NULL) {
+            size_t len = strlen(entry->d_name);
+            if (len > 4 && strcmp(entry->d_name + len - 4, ".ini") == 0)
+                ok = name_list_add(&names, count, &cap, entry->d_name, len - 4);
+        }
+        closedir(dir);
+    }
+    if (!ok) {
+        free_profile_names(names, *count);
+        *count = 0;
+        return NULL;
+    }
+
+    // Sort, then drop the names found in several places
+    if (*count > 1)
+        qsort(names, *count, sizeof(char *), compare_names);
+    size_t unique = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (unique > 0 && strcmp(names[unique - 1], names[i]) == 0)
+            free(names[i]);
+        else
+            names[unique++] = names[i];
+    }
+    *count = unique;
+    return names;
+}
+
+void free_profile_names(char **names, size_t count)
+{
+    for (size_t i = 0; names && i < count; i++)
+        free(names[i]);
+    free(names);
 }
 
 void free_language_profile(LanguageProfile *profile)
 {
-    if (!profile)
-        return;
+    // The profile lives in its own arena, with its table and strings
+    if (profile)
+        arena_destroy(profile->arena);
+}
 
-    // Free all dynamically allocated strings inside the profile
-    for (int i = 0; i < profile->allowed_extensions_count; i++)
-        free(profile->allowed_extensions[i]);
-    for (int i = 0; i < profile->allowed_dotfiles_count; i++)
-        free(profile->allowed_dotfiles[i]);
-    for (int i = 0; i < profile->allowed_filenames_count; i++)
-        free(profile->allowed_filenames[i]);
-    for (int i = 0; i < profile->ignored_extensions_count; i++)
-        free(profile->ignored_extensions[i]);
-    for (int i = 0; i < profile->ignored_filenames_count; i++)
-        free(profile->ignored_filenames[i]);
-    for (int i = 0; i < profile->syntax_map_count; i++) {
-        free(profile->syntax_map[i].ext);
-        free(profile->syntax_map[i].tag);
-    }
+/**
+ * @brief Looks up a filename and its extension.
+ *
+ * @param profile The language profile.
+ * @param filename The simple filename.
+ * @param by_name Receives the entry for the whole name, or NULL.
+ * @param by_ext Receives the entry for the extension, or NULL.
+ * @return The extension, or "" if the name has none.
+ */
+static const char *lookup_name(const LanguageProfile *profile, const char *filename,
+                               const ProfileKey **by_name, const ProfileKey **by_ext)
+{
+    const char *ext = strrchr(filename, '.');
+    ext = (ext && ext != filename) ? ext + 1 : "";
+    *by_name = lookup_key(profile, filename);
+    *by_ext = lookup_key(profile, ext);
+    return ext;
+}
 
-    // Free the profile itself
-    free(profile);
+bool profile_allows_file(const LanguageProfile *profile, const char *filename)
+{
+    const ProfileKey *by_name, *by_ext;
+    lookup_name(profile, filename, &by_name, &by_ext);
+    uint8_t name_roles = by_name ? by_name->roles : 0;
+    uint8_t ext_roles = by_ext ? by_ext->roles : 0;
+
+    // Check ignore lists first
+    if ((name_roles & PROFILE_IGNORED_NAME) || (ext_roles & PROFILE_IGNORED_EXT))
+        return false;
+
+    // Check allow lists
+    if (filename[0] == '.' && (name_roles & PROFILE_ALLOWED_DOTFILE))
+        return true;
+    return (name_roles & PROFILE_ALLOWED_NAME) || (ext_roles & PROFILE_ALLOWED_EXT);
+}
+
+bool profile_lists_name(const LanguageProfile *profile, const char *filename)
+{
+    const ProfileKey *by_name = lookup_key(profile, filename);
+    uint8_t name_roles = PROFILE_ALLOWED_NAME | PROFILE_ALLOWED_DOTFILE | PROFILE_IGNORED_NAME;
+    return by_name && (by_name->roles & name_roles);
 }
 
 const char *get_syntax_tag(const LanguageProfile *profile, const char *filename)
@@ -191,20 +484,16 @@ const char *get_syntax_tag(const LanguageProfile *profile, const char *filename)
     if (!profile || !filename)
         return "txt";
 
-    // Get the extension (if any)
-    const char *ext = strrchr(filename, '.');
-    ext = (ext && ext != filename) ? ext + 1 : "";
+    const ProfileKey *by_name, *by_ext;
+    const char *ext = lookup_name(profile, filename, &by_name, &by_ext);
 
-    for (int i = 0; i < profile->syntax_map_count; i++) {
-        // Try to match by full filename first (e.g., "Makefile")
-        if (strcmp(profile->syntax_map[i].ext, filename) == 0) {
-            return profile->syntax_map[i].tag;
-        }
-        // Try to match by extension (e.g., "c")
-        if (ext[0] != '\0' && strcmp(profile->syntax_map[i].ext, ext) == 0) {
-            return profile->syntax_map[i].tag;
-        }
-    }
+    // The earliest mapping of the full filename (e.g., "Makefile") or of the
+    // extension (e.g., "c") wins
+    int syntax = by_name ? by_name->syntax : -1;
+    if (by_ext && by_ext->syntax >= 0 && (syntax < 0 || by_ext->syntax < syntax))
+        syntax = by_ext->syntax;
+    if (syntax >= 0)
+        return profile->syntax_tags[syntax];
 
     // If an extension exists but wasn't mapped, use the extension itself as the tag
     if (ext[0] != '\0') {
@@ -213,4 +502,4 @@ const char *get_syntax_tag(const LanguageProfile *profile, const char *filename)
 
     // Final fallback
     return "txt";
-}
\ No newline at end of file
+}
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE // For fdopendir(), strdup() and the DT_* constants
+#include "detect.h"
+#include "arena.h"
+#include "config.h"
+#include "gitignore.h"
+#include "hash.h"
+#include "walk.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HISTOGRAM_MIN_CAP 256
+
+/**
+ * @brief One bar of the histogram: an extension, or the whole name of a
+ * file without one or that a profile lists by name.
+ */
+typedef struct {
+    const char *key; // NULL marks a free slot
+    size_t len;
+    uint64_t hash;
+    bool whole_name;    // The key is a file name, not an extension
+    const char *sample; // The first file name counted, matched against the profiles
+    size_t count;
+} Bucket;
+
+/**
+ * @brief Open-addressing table of the sampled files, by bucket.
+ */
+typedef struct {
+    Bucket *buckets;
+    size_t cap; // Power of two (0 until the first insertion)
+    size_t count;
+    size_t files;                     // Files sampled
+    Arena *arena;                     // Names and sampled directory paths
+    LanguageProfile *const *profiles; // The candidates (their name lists split buckets)
+    size_t profile_count;
+} Histogram;
+
+/**
+ * @brief Finds the slot of a key: its bucket, or the free slot where it
+ * would go.
+ */
+static Bucket *histogram_slot(Bucket *buckets, size_t cap, const char *key, size_t len,
+                              uint64_t hash, bool whole_name)
+{
+    size_t mask = cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Bucket *slot = &buckets[i];
+        if (!slot->key || (slot->hash == hash && slot->whole_name == whole_name &&
+                           slot->len == len && memcmp(slot->key, key, len) == 0))
+            return slot;
+    }
+}
+
+/**
+ * @brief Checks if some candidate profile lists a file by name: its
+ * extension alone does not tell how the profiles treat it.
+ */
+static bool histogram_names(const Histogram *hist, const char *name)
+{
+    for (size_t p = 0; p < hist->profile_count; p++)
+        if (hist->profiles[p] && profile_lists_name(hist->profiles[p], name))
+            return true;
+    return false;
+}
+
+/**
+ * @brief Counts a sampled file (best effort: on allocation failure the file
+ * is left out).
+ */
+static void histogram_add(Histogram *hist, const char *name)
+{
+    if ((hist->count + 1) * 2 > hist->cap) {
+        size_t new_cap = hist->cap ? hist->cap * 2 : HISTOGRAM_MIN_CAP;
+        Bucket *buckets = calloc(new_cap, sizeof(Bucket));
+        if (!buckets)
+            return;
+        for (size_t i = 0; i < hist->cap; i++) {
+            const Bucket *old = &hist->buckets[i];
+            if (old->key)
+                *histogram_slot(buckets, new_cap, old->key, old->len, old->hash,
+                                old->whole_name) = *old;
+        }
+        free(hist->buckets);
+        hist->buckets = buckets;
+        hist->cap = new_cap;
+    }
+
+    const char *ext = strrchr(name, '.');
+    bool whole_name = !ext || ext == name || histogram_names(hist, name);
+    const char *key = whole_name ? name : ext + 1;
+    size_t len = strlen(key);
+    uint64_t hash = hash_bytes(key, len);
+    Bucket *slot = histogram_slot(hist->buckets, hist->cap, key, len, hash, whole_name);
+    if (!slot->key) {
+        size_t name_len = strlen(name);
+        char *sample = arena_strndup(hist->arena, name, name_len);
+        if (!sample)
+            return;
+        slot->sample = sample;
+        slot->key = sample + (key - name);
+        slot->len = len;
+        slot->hash = hash;
+        slot->whole_name = whole_name;
+        hist->count++;
+    }
+    slot->count++;
+    hist->files++;
+}
+
+/**
+ * @brief A directory waiting to be sampled.
+ */
+typedef struct {
+    const char *path;     // Full path, in the histogram's arena
+    const char *name;     // Points inside path (NULL for the root)
+    GitignoreDir *parent; // The parent's frames (a reference held until opened)
+} SampleDir;
+
+/**
+ * @brief Breadth-first queue of the directories to sample.
+ */
+typedef struct {
+    SampleDir dirs[DETECT_MAX_DIRS];
+    size_t count;
+    size_t next;
+} SampleQueue;
+
+/**
+ * @brief Queues a subdirectory (ignored once the queue is full).
+ */
+static void sample_queue_push(SampleQueue *queue, Histogram *hist, const SampleDir *dir,
+                              GitignoreDir *frame, const char *name)
+{
+    if (queue->count == DETECT_MAX_DIRS)
+        return;
+    size_t dir_len = strlen(dir->path);
+    size_t name_len = strlen(name);
+    char *path = arena_alloc(hist->arena, dir_len + name_len + 2);
+    if (!path)
+        return;
+    memcpy(path, dir->path, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    queue->dirs[queue->count++] =
+        (SampleDir){.path = path, .name = path + dir_len + 1, .parent = gitignore_dir_ref(frame)};
+}
+
+/**
+ * @brief Counts the first files of a directory and queues its
+ * subdirectories, skipping ignored entries.
+ */
+static void sample_dir(const Gitignore *gi, SampleQueue *queue, const SampleDir *dir,
+                       Histogram *hist)
+{
+    int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    GitignoreDir *frame = gitignore_dir_open(gi, dir->parent, fd, dir->name);
+    gitignore_dir_close(dir->parent);
+    DIR *stream = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!stream) {
+        if (fd >= 0)
+            close(fd);
+        gitignore_dir_close(frame);
+        return;
+    }
+
+    size_t taken = 0;
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        bool want_files = taken < DETECT_MAX_DIR_FILES && hist->files < DETECT_MAX_FILES;
+        bool want_dirs = queue->count < DETECT_MAX_DIRS;
+        if (!want_files && !want_dirs)
+            break;
+
+        WalkKind kind;
+        if (!walk_resolve_kind(fd, name, WALK_DTYPE(entry), &kind))
+            continue;
+        bool is_dir = kind == WALK_DIR;
+        if ((is_dir && strcmp(name, ".git") == 0) || gitignore_dir_matches(frame, name, is_dir))
+            continue;
+        if (is_dir && want_dirs) {
+            sample_queue_push(queue, hist, dir, frame, name);
+        }
+        else if (kind == WALK_FILE && want_files) {
+            histogram_add(hist, name);
+            taken++;
+        }
+    }
+    closedir(stream);
+    gitignore_dir_close(frame);
+}
+
+/**
+ * @brief Samples the project into a histogram.
+ */
+static void sample_project(const char *root_path, Histogram *hist)
+{
+    SampleQueue *queue = calloc(1, sizeof(SampleQueue));
+    if (!queue)
+        return;
+    Gitignore *gi = gitignore_load(root_path);
+    queue->dirs[queue->count++] = (SampleDir){.path = root_path};
+    while (queue->next < queue->count && hist->files < DETECT_MAX_FILES)
+        sample_dir(gi, queue, &queue->dirs[queue->next++], hist);
+
+    // Release the frames held by directories left unvisited
+    while (queue->next < queue->count)
+        gitignore_dir_close(queue->dirs[queue->next++].parent);
+    gitignore_free(gi);
+    free(queue);
+}
+
+/**
+ * @brief Scores the profiles against the histogram and picks them
+ * greedily.
+ *
+ * Every file of a bucket is treated alike by each profile: files a profile
+ * lists by name have buckets of their own, and the others are only told
+ * apart by their extension.
+ *
+ * @return The number of profiles picked.
+ */
+static size_t pick_profiles(const Histogram *hist, char **candidates, size_t candidate_count,
+                            size_t max_count, char **names)
+{
+    LanguageProfile *const *profiles = hist->profiles;
+    const Bucket **bars = malloc((hist->count ? hist->count : 1) * sizeof(Bucket *));
+    bool *allows = calloc(candidate_count * hist->count + 1, sizeof(bool));
+    double *weights = calloc(hist->count + 1, sizeof(double));
+    size_t picked = 0;
+    if (!bars || !allows || !weights)
+        goto done;
+
+    size_t bar_count = 0;
+    for (size_t i = 0; i < hist->cap; i++)
+        if (hist->buckets[i].key)
+            bars[bar_count++] = &hist->buckets[i];
+    for (size_t p = 0; p < candidate_count; p++)
+        for (size_t b = 0; profiles[p] && b < bar_count; b++)
+            allows[p * bar_count + b] = profile_allows_file(profiles[p], bars[b]->sample);
+
+    // A file included by several profiles tells them apart less
+    double total = 0;
+    for (size_t b = 0; b < bar_count; b++) {
+        size_t includers = 0;
+        for (size_t p = 0; p < candidate_count; p++)
+            includers += allows[p * bar_count + b];
+        weights[b] = includers ? (double)bars[b]->count / (double)includers : 0;
+        total += weights[b];
+    }
+
+    while (picked < max_count) {
+        size_t best = candidate_count;
+        double best_score = 0;
+        for (size_t p = 0; p < candidate_count; p++) {
+            double score = 0;
+            for (size_t b = 0; b < bar_count; b++)
+                score += allows[p * bar_count + b] ? weights[b] : 0;
+            if (score > best_score) {
+                best = p;
+                best_score = score;
+            }
+        }
+        if (best == candidate_count ||
+            (picked > 0 && best_score * 100 < total * DETECT_MIN_SHARE_PERCENT))
+            break;
+        names[picked] = strdup(candidates[best]);
+        if (!names[picked])
+            break;
+        picked++;
+
+        // The files it includes no longer count for the others
+        for (size_t b = 0; b < bar_count; b++)
+            if (allows[best * bar_count + b])
+                weights[b] = 0;
+    }
+
+done:
+    free(allows);
+    free(weights);
+    free(bars);
+    return picked;
+}
+
+size_t detect_profiles(const char *root_path, size_t max_count, char **names)
+{
+    size_t candidate_count;
+    char **candidates = list_language_profiles(&candidate_count);
+    LanguageProfile **profiles =
+        candidates ? calloc(candidate_count ? candidate_count : 1, sizeof(*profiles)) : NULL;
+    Histogram hist = {.arena = arena_create(), .profiles = profiles};
+    size_t picked = 0;
+    if (profiles && hist.arena) {
+        for (size_t p = 0; p < candidate_count; p++)
+            profiles[p] = load_language_profile(candidates[p]);
+        hist.profile_count = candidate_count;
+        sample_project(root_path, &hist);
+        picked = pick_profiles(&hist, candidates, candidate_count, max_count, names);
+    }
+
+    for (size_t p = 0; profiles && p < candidate_count; p++)
+        free_language_profile(profiles[p]);
+    free(profiles);
+    free_profile_names(candidates, candidate_count);
+    free(hist.buckets);
+    arena_destroy(hist.arena);
+    return picked;
+}
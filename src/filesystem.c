@@ -1,213 +1,1417 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // For struct statx
 #include "filesystem.h"
-#include "gitignore.h"
-#include <dirent.h>
+#include "arena.h"
+#include "hash.h"
+#include "index.h"
+#include "manifest.h"
+#include "reader.h"
+#include "uring.h"
+#include "walk.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
-#define PATH_MAX_LEN 4096
+#define PIPELINE_RING_SLOTS 256                // Files in flight between the readers and the writer
+#define PIPELINE_MEMORY_MAX (64 * 1024 * 1024) // Bytes of bodies held in the ring at once
 
 /**
- * @brief Native fallback if 'tree' command is not available.
+ * @brief One directory on the tree renderer's stack.
+ */
+typedef struct {
+    const FsNode **children; // Visible children, sorted by name
+    size_t count;
+    size_t next;
+    size_t prefix_len; // Length of the line prefix drawn for this level
+} TreeLevel;
+
+/**
+ * @brief Orders nodes by name, byte-wise, so the tree does not depend on
+ * readdir order or on the locale.
+ */
+static int compare_node_names(const void *a, const void *b)
+{
+    const FsNode *left = *(const FsNode *const *)a;
+    const FsNode *right = *(const FsNode *const *)b;
+    return strcmp(left->name, right->name);
+}
+
+/**
+ * @brief Collects the children shown in the tree (everything but ignored
+ * entries and the report itself), sorted by name.
  *
- * Recursively scans a directory and prints its structure to the Markdown file.
+ * @return true on success (level->count may be 0), false on allocation failure.
+ */
+static bool tree_level_load(TreeLevel *level, const FsNode *dir)
+{
+    level->children = NULL;
+    level->count = 0;
+    level->next = 0;
+
+    size_t count = 0;
+    for (const FsNode *child = dir->children; child; child = child->next)
+        count += !(child->flags & (FS_NODE_IGNORED | FS_NODE_OUTPUT));
+    if (count == 0)
+        return true;
+
+    level->children = malloc(count * sizeof(*level->children));
+    if (!level->children)
+        return false;
+    for (const FsNode *child = dir->children; child; child = child->next)
+        if (!(child->flags & (FS_NODE_IGNORED | FS_NODE_OUTPUT)))
+            level->children[level->count++] = child;
+    qsort(level->children, level->count, sizeof(*level->children), compare_node_names);
+    return true;
+}
+
+/**
+ * @brief Appends bytes to a growable line buffer.
+ */
+static bool line_append(char **line, size_t *len, size_t *cap, const char *text, size_t text_len)
+{
+    if (*len + text_len + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (new_cap < *len + text_len + 1)
+            new_cap *= 2;
+        char *grown = realloc(*line, new_cap);
+        if (!grown)
+            return false;
+        *line = grown;
+        *cap = new_cap;
+    }
+    memcpy(*line + *len, text, text_len);
+    *len += text_len;
+    (*line)[*len] = '\0';
+    return true;
+}
+
+void generate_directory_tree(MarkdownHandle *md, const FsTree *tree)
+{
+    const FsNode *root = fs_tree_root(tree);
+    md_add_raw_text(md, "```\n");
+    md_add_raw_text_len(md, root->name, root->name_len);
+    md_add_raw_text(md, "\n");
+
+    TreeLevel *levels = malloc(16 * sizeof(TreeLevel));
+    size_t levels_cap = 16;
+    size_t depth = 0;
+    if (levels && tree_level_load(&levels[0], root)) {
+        levels[0].prefix_len = 0;
+        depth = 1;
+    }
+
+    // The line buffer starts with the prefix of the current level, e.g.
+    // "│   │   ", followed by the connector and name of the entry
+    char *line = NULL;
+    size_t line_cap = 0;
+    size_t dirs = 0;
+    size_t files = 0;
+    while (depth > 0) {
+        TreeLevel *level = &levels[depth - 1];
+        if (level->next == level->count) {
+            free(level->children);
+            depth--;
+            continue;
+        }
+
+        const FsNode *node = level->children[level->next++];
+        bool last = level->next == level->count;
+        size_t len = level->prefix_len;
+        if (!line_append(&line, &len, &line_cap, last ? "└── " : "├── ",
+                         strlen(last ? "└── " : "├── ")) ||
+            !line_append(&line, &len, &line_cap, node->name, node->name_len) ||
+            !line_append(&line, &len, &line_cap, "\n", 1))
+            break;
+        md_add_raw_text_len(md, line, len);
+
+        if (node->kind != WALK_DIR) {
+            files++;
+            continue;
+        }
+        dirs++;
+
+        // Draw the continuation of this level in front of the children
+        len = level->prefix_len;
+        const char *rail = last ? "    " : "│   ";
+        if (!line_append(&line, &len, &line_cap, rail, strlen(rail)))
+            break;
+        if (depth == levels_cap) {
+            TreeLevel *grown = realloc(levels, levels_cap * 2 * sizeof(TreeLevel));
+            if (!grown)
+                break;
+            levels = grown;
+            levels_cap *= 2;
+        }
+        if (tree_level_load(&levels[depth], node) && levels[depth].count > 0) {
+            levels[depth].prefix_len = len;
+            depth++;
+        }
+    }
+    while (depth > 0)
+        free(levels[--depth].children);
+    free(levels);
+    free(line);
+
+    char summary[96];
+    int summary_len = snprintf(summary, sizeof(summary), "\n%zu director%s, %zu file%s\n", dirs,
+                               dirs == 1 ? "y" : "ies", files, files == 1 ? "" : "s");
+    md_add_raw_text_len(md, summary, (size_t)summary_len);
+    md_add_raw_text(md, "```\n");
+}
+
+/**
+ * @brief Running total of file bodies written, checked against the
+ * profile's max_file_size and max_total_size.
+ */
+typedef struct {
+    uint64_t used;
+    bool exhausted; // Set once a body did not fit in max_total_size
+} SizeBudget;
+
+/**
+ * @brief Decides whether a file body of the given size may be included and
+ * accounts for it if so.
+ *
+ * Once a body does not fit in max_total_size, no further bodies are added,
+ * which keeps the outcome independent of the size of later files.
+ *
+ * @param budget The running total.
+ * @param profile The language profile holding the limits.
+ * @param size The file size in bytes.
+ * @return NULL if the body may be written, otherwise the note to write in
+ * its place.
+ */
+static const char *size_budget_check(SizeBudget *budget, const LanguageProfile *profile,
+                                     uint64_t size)
+{
+    if (profile->max_file_size && size > profile->max_file_size)
+        return "_Skipped: larger than max_file_size._\n\n";
+    if (budget->exhausted ||
+        (profile->max_total_size && size > profile->max_total_size - budget->used)) {
+        budget->exhausted = true;
+        return "_Skipped: max_total_size reached._\n\n";
+    }
+    budget->used += size;
+    return NULL;
+}
+
+static ContentStats content_stats; // Updated atomically: shards emit in parallel
+
+/**
+ * @brief Writes a file's code block from a loaded body, fenced so that no
+ * line of it can close the block. A binary body is replaced by a note.
  *
  * @param md The Markdown file handle.
- * @param base_path The current directory being scanned.
- * @param indent_level The current depth for indentation.
+ * @param tag The syntax tag.
+ * @param fd The file, positioned at its start (used for BODY_STREAM).
+ * @param body The body loaded by reader_load().
+ * @param stream_hash Receives the hash of a streamed body as it is copied
+ * (NULL if not needed).
  */
-static void native_tree_fallback(MarkdownHandle *md, const char *base_path, int indent_level)
+static void emit_file_body(MarkdownHandle *md, const char *tag, int fd, const FileBody *body,
+                           uint64_t *stream_hash)
 {
-    DIR *dir = opendir(base_path);
-    if (!dir)
+    if (body->mode == BODY_NONE)
         return;
+    if (body->scan.binary) {
+        md_add_raw_text(md, "_Skipped: binary file._\n\n");
+        __atomic_add_fetch(&content_stats.binary, 1, __ATOMIC_RELAXED);
+        return;
+    }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+    size_t fence = content_scan_fence(&body->scan);
+    if (body->mode == BODY_STREAM)
+        md_add_code_block_fd(md, tag, fd, fence, stream_hash);
+    else
+        md_add_code_block_len(md, tag, body->data, body->length, fence);
+    __atomic_add_fetch(&content_stats.files, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&content_stats.lines, body->scan.lines, __ATOMIC_RELAXED);
+    if (!body->scan.utf8_valid)
+        __atomic_add_fetch(&content_stats.not_utf8, 1, __ATOMIC_RELAXED);
+}
 
-        char path[PATH_MAX_LEN];
-        snprintf(path, sizeof(path), "%s/%s", base_path, entry->d_name);
+void get_content_stats(ContentStats *stats)
+{
+    stats->files = __atomic_load_n(&content_stats.files, __ATOMIC_RELAXED);
+    stats->lines = __atomic_load_n(&content_stats.lines, __ATOMIC_RELAXED);
+    stats->binary = __atomic_load_n(&content_stats.binary, __ATOMIC_RELAXED);
+    stats->not_utf8 = __atomic_load_n(&content_stats.not_utf8, __ATOMIC_RELAXED);
+}
 
-        char indent_str[PATH_MAX_LEN];
-        size_t indent_len = (size_t)indent_level * 4; // 4 spaces per indent level
+/**
+ * @brief A body already written in full, keyed by content hash and size.
+ */
+typedef struct {
+    uint64_t hash;    // hash_bytes() of the body (0 marks a free bucket)
+    uint64_t size;
+    const char *path; // The file it was written for
+} DedupEntry;
 
-        // Ensure indent string doesn't overflow buffer
-        if (indent_len >= sizeof(indent_str)) {
-            indent_len = sizeof(indent_str) - 1;
-        }
-        memset(indent_str, ' ', indent_len);
-        indent_str[indent_len] = '\0';
+/**
+ * @brief Open-addressing table of the bodies written so far.
+ */
+typedef struct {
+    DedupEntry *buckets;
+    size_t cap; // Power of two (0 until the first insertion)
+    size_t count;
+    Arena *paths;
+    uint64_t sizes[16]; // Bloom filter (1024 bits) of the sizes of the entries
+} DedupTable;
 
-        char line[PATH_MAX_LEN];
+/**
+ * @brief The bit of DedupTable.sizes standing for a size.
+ */
+static unsigned dedup_size_bit(uint64_t size)
+{
+    return (unsigned)((size * 0x9E3779B97F4A7C15u) >> 54);
+}
 
-        // Safe concatenation to build the line (e.g., "    |-- main.c\n")
-        strncpy(line, indent_str, sizeof(line) - 1);
-        line[sizeof(line) - 1] = '\0'; // Ensure null-termination
+/**
+ * @brief Tells whether a body of the given size may have been written
+ * already, before it is read (false positives only cost a read).
+ */
+static bool dedup_may_hold(const DedupTable *table, uint64_t size)
+{
+    unsigned bit = dedup_size_bit(size);
+    return table && (table->sizes[bit / 64] >> (bit % 64) & 1);
+}
 
-        strncat(line, "|-- ", sizeof(line) - strlen(line) - 1);
-        strncat(line, entry->d_name, sizeof(line) - strlen(line) - 1);
-        strncat(line, "\n", sizeof(line) - strlen(line) - 1);
+/**
+ * @brief Finds the file a body was first written for.
+ *
+ * @return Its path, or NULL if the body has not been written yet (or was
+ * not hashed).
+ */
+static const char *dedup_find(const DedupTable *table, uint64_t hash, uint64_t size)
+{
+    if (!table || table->cap == 0 || hash == 0)
+        return NULL;
+    size_t mask = table->cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const DedupEntry *entry = &table->buckets[i];
+        if (entry->hash == 0)
+            return NULL;
+        if (entry->hash == hash && entry->size == size)
+            return entry->path;
+    }
+}
 
-        md_add_raw_text(md, line);
+/**
+ * @brief Places an entry in the first free bucket of its probe sequence.
+ */
+static void dedup_place(DedupEntry *buckets, size_t cap, const DedupEntry *entry)
+{
+    size_t i = entry->hash & (cap - 1);
+    while (buckets[i].hash != 0)
+        i = (i + 1) & (cap - 1);
+    buckets[i] = *entry;
+}
 
-        struct stat statbuf;
-        if (stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode))
-            native_tree_fallback(md, path, indent_level + 1);
+/**
+ * @brief Records a body written in full (best effort: on allocation failure
+ * later copies are simply written in full too).
+ */
+static void dedup_insert(DedupTable *table, uint64_t hash, uint64_t size, const char *path)
+{
+    if (hash == 0)
+        return;
+    if ((table->count + 1) * 2 > table->cap) {
+        size_t new_cap = table->cap ? table->cap * 2 : 256;
+        DedupEntry *buckets = calloc(new_cap, sizeof(DedupEntry));
+        if (!buckets)
+            return;
+        for (size_t i = 0; i < table->cap; i++)
+            if (table->buckets[i].hash != 0)
+                dedup_place(buckets, new_cap, &table->buckets[i]);
+        free(table->buckets);
+        table->buckets = buckets;
+        table->cap = new_cap;
     }
-    closedir(dir);
+    if (!table->paths && !(table->paths = arena_create()))
+        return;
+
+    DedupEntry entry = {.hash = hash, .size = size};
+    entry.path = arena_strndup(table->paths, path, strlen(path));
+    if (!entry.path)
+        return;
+    dedup_place(table->buckets, table->cap, &entry);
+    table->count++;
+    unsigned bit = dedup_size_bit(size);
+    table->sizes[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+/**
+ * @brief Frees a table's entries.
+ */
+static void dedup_destroy(DedupTable *table)
+{
+    free(table->buckets);
+    arena_destroy(table->paths);
+}
+
+/**
+ * @brief Confirms that a body matched by hash and size in the dedup table
+ * is byte for byte the file the table names, by reading that file again:
+ * a hash collision, or a file changed since, must not turn a body into a
+ * note.
+ *
+ * @param original The path of the file the body was written for.
+ * @param data The body.
+ * @param length Its length.
+ * @return true if the file holds exactly the body.
+ */
+static bool dedup_confirm(const char *original, const char *data, size_t length)
+{
+    int fd = open(original, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    FileBody body;
+    bool same = reader_load(&body, fd, length) && body.mode != BODY_STREAM &&
+                body.length == length && memcmp(body.data, data, length) == 0;
+    reader_release(&body);
+    close(fd);
+    return same;
+}
+
+/**
+ * @brief State of the "File Contents" section while it is written.
+ */
+typedef struct {
+    MarkdownHandle *md;
+    const LanguageProfile *profile;
+    SizeBudget budget;
+    FragmentCache *cache; // NULL unless the run is incremental
+    DedupTable *dedup;    // NULL when duplicate bodies are written in full
+    ReportIndex *index;   // NULL unless the report is indexed
+} Emitter;
+
+/**
+ * @brief Tells whether bodies must be hashed (for deduplication, the
+ * manifest or the index).
+ */
+static bool emitter_hashes(const Emitter *em)
+{
+    return em->dedup || em->cache || em->index;
+}
+
+/**
+ * @brief Finds the code block of the last report for a file that has not
+ * changed since (same inode, size and modification time, same syntax tag).
+ *
+ * @return The manifest entry, or NULL if the file must be read.
+ */
+static const ManifestEntry *fragment_lookup(const Emitter *em, const FsNode *node,
+                                            const char *path, const char *tag)
+{
+    if (!em->cache || em->cache->report_fd < 0)
+        return NULL;
+    const ManifestEntry *entry = manifest_find(em->cache->previous, path);
+    if (!entry || entry->ino != node->ino || entry->size != node->size ||
+        entry->mtime_ns != node->mtime_ns || strcmp(entry->tag, tag) != 0)
+        return NULL;
+    return entry;
+}
+
+/**
+ * @brief Records where a file's code block, written since `start`, lies in
+ * the new report.
+ */
+static void fragment_record(Emitter *em, ManifestEntry *entry, uint64_t start)
+{
+    entry->offset = start;
+    entry->length = md_tell(em->md) - start;
+    manifest_add(em->cache->current, entry);
+}
+
+/**
+ * @brief Writes the note that stands in for the code block of a file
+ * identical to one written earlier. Duplicates do not count toward
+ * max_total_size.
+ *
+ * @param em The emitter.
+ * @param entry The file's path, tag, stat fields and hash.
+ * @param original The path of the file the body was written for.
+ */
+static void emit_duplicate(Emitter *em, ManifestEntry *entry, const char *original)
+{
+    md_add_raw_text(em->md, "_Identical to `");
+    md_add_raw_text(em->md, original);
+    md_add_raw_text(em->md, "`._\n\n");
+    IndexEntry indexed = {
+        .path = entry->path, .tag = entry->tag, .duplicate_of = original, .hash = entry->hash};
+    report_index_add(em->index, &indexed);
+    if (em->cache) {
+        // The note names the first copy, so it is not reused as a fragment
+        entry->offset = 0;
+        entry->length = 0;
+        manifest_add(em->cache->current, entry);
+    }
+}
+
+/**
+ * @brief Writes an unchanged file's code block by copying it from the last
+ * report (or a note if its body was already written), subject to the size
+ * limits.
+ *
+ * @return true if the file was handled, false if it must be read: it was a
+ * duplicate last time, or it may be one now (its bytes are then compared
+ * by emit_fresh()).
+ */
+static bool emit_cached(Emitter *em, const ManifestEntry *cached)
+{
+    if (cached->length == 0 || dedup_find(em->dedup, cached->hash, cached->size))
+        return false;
+
+    const char *skipped = size_budget_check(&em->budget, em->profile, cached->size);
+    if (skipped) {
+        md_add_raw_text(em->md, skipped);
+        return true;
+    }
+    ManifestEntry entry = *cached;
+    uint64_t start = md_tell(em->md);
+    if (md_add_raw_range(em->md, em->cache->report_fd, cached->offset, cached->length)) {
+        fragment_record(em, &entry, start);
+        if (em->dedup)
+            dedup_insert(em->dedup, entry.hash, entry.size, entry.path);
+    }
+    return true;
 }
 
-void generate_directory_tree(MarkdownHandle *md, const char *root_path, const char *output_file)
+/**
+ * @brief Applies the size limits to a file before its body is read, unless
+ * the body may be a copy of one already written: duplicates do not count
+ * toward max_total_size, so only its hash can tell.
+ *
+ * @return The note to write in place of the body, or NULL if the body must
+ * be read (emit_fresh() then applies the limits).
+ */
+static const char *emit_skip_unread(Emitter *em, uint64_t size)
 {
-    char command[PATH_MAX_LEN];
-    // Use 'tree' if available, as it respects .gitignore and looks better
-    snprintf(command, sizeof(command), "tree --gitignore -a -I \"%s|.git\" \"%s\"", output_file,
-             root_path);
+    const LanguageProfile *profile = em->profile;
+    bool fits = !(profile->max_file_size && size > profile->max_file_size);
+    if (fits && dedup_may_hold(em->dedup, size))
+        return NULL;
+    SizeBudget trial = em->budget;
+    if (!size_budget_check(&trial, profile, size))
+        return NULL; // Charged by emit_fresh()
+    return size_budget_check(&em->budget, profile, size);
+}
 
-    FILE *pipe = popen(command, "r");
-    if (!pipe) {
-        // Fallback if 'tree' command fails or is not installed
-        fprintf(stderr, "Warning: 'tree' command not found. Using native fallback.\n");
-        md_add_raw_text(md, "```\n");
-        md_add_raw_text(md, root_path);
-        md_add_raw_text(md, "\n");
-        native_tree_fallback(md, root_path, 0);
-        md_add_raw_text(md, "```\n");
+/**
+ * @brief Writes a freshly read code block (or a note if the same body was
+ * already written), subject to the size limits, recording it in the
+ * manifest of an incremental run.
+ *
+ * @param em The emitter.
+ * @param entry The file's path, tag and stat fields, and its hash if the
+ * reader computed it already (0 otherwise).
+ * @param fd The file, positioned at its start (used for BODY_STREAM).
+ * @param body The body loaded by reader_load().
+ */
+static void emit_fresh(Emitter *em, ManifestEntry *entry, int fd, const FileBody *body)
+{
+    // Binary bodies are not written, so later copies cannot refer to them
+    if (body->scan.binary)
+        entry->hash = 0;
+    else if (emitter_hashes(em) && body->mode != BODY_STREAM && entry->hash == 0)
+        entry->hash = hash_bytes(body->data, body->length);
+    const char *original = dedup_find(em->dedup, entry->hash, entry->size);
+    if (original && dedup_confirm(original, body->data, body->length)) {
+        emit_duplicate(em, entry, original);
+        return;
+    }
+    const char *skipped = size_budget_check(&em->budget, em->profile, entry->size);
+    if (skipped) {
+        md_add_raw_text(em->md, skipped);
         return;
     }
 
-    char buffer[PATH_MAX_LEN];
-    md_add_raw_text(md, "```\n");
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL)
-        md_add_raw_text(md, buffer);
-    md_add_raw_text(md, "```\n");
-    pclose(pipe);
+    // The index lists the hash of every body, streamed ones included
+    uint64_t *stream_hash = em->index && entry->hash == 0 ? &entry->hash : NULL;
+    uint64_t start = em->cache ? md_tell(em->md) : 0;
+    emit_file_body(em->md, entry->tag, fd, body, stream_hash);
+    if (em->index && !body->scan.binary) {
+        IndexEntry indexed = {
+            .path = entry->path,
+            .tag = entry->tag,
+            .lines = body->scan.partial ? INDEX_LINES_UNKNOWN : body->scan.lines,
+            .hash = entry->hash,
+        };
+        md_last_block(em->md, &indexed.offset, &indexed.length);
+        report_index_add(em->index, &indexed);
+    }
+    if (em->dedup && body->mode != BODY_STREAM)
+        dedup_insert(em->dedup, entry->hash, entry->size, entry->path);
+    if (em->cache)
+        fragment_record(em, entry, start);
 }
 
 /**
- * @brief Checks if a file should be included based on the language profile.
+ * @brief Opens and reads a file, then writes its code block, subject to the
+ * size limits.
  *
- * @param path The relative path to the file.
- * @param profile The loaded language profile with filter rules.
- * @return true if the file is allowed, false otherwise.
+ * @param em The emitter.
+ * @param node The file.
+ * @param path The file's full path.
+ * @param tag The file's syntax tag.
  */
-static bool is_file_allowed(const char *path, const LanguageProfile *profile)
+static void emit_read(Emitter *em, const FsNode *node, const char *path, const char *tag)
 {
-    const char *filename = strrchr(path, '/');
-    filename = filename ? filename + 1 : path;
+    int fd = fs_node_open(node, path, O_RDONLY);
+    if (fd < 0)
+        return;
 
-    const char *ext = strrchr(filename, '.');
-    ext = (ext && ext != filename) ? ext + 1 : "";
+    struct stat st;
+    ManifestEntry entry = {.path = path, .tag = tag};
+    if (fstat(fd, &st) == 0)
+        manifest_stamp(&entry, &st);
+    const char *skipped = emit_skip_unread(em, entry.size);
+    FileBody body;
+    if (skipped) {
+        md_add_raw_text(em->md, skipped);
+    }
+    else if (reader_load(&body, fd, entry.size)) {
+        emit_fresh(em, &entry, fd, &body);
+        reader_release(&body);
+    }
+    close(fd);
+}
 
-    // Check ignore lists first
-    for (int i = 0; i < profile->ignored_filenames_count; i++)
-        if (strcmp(filename, profile->ignored_filenames[i]) == 0)
-            return false;
+/**
+ * @brief A file read ahead of the writer by a reader thread.
+ */
+typedef struct {
+    const FsNode *node;
+    char *path;                  // Full path
+    size_t path_len;             // Its length
+    const ManifestEntry *cached; // Unchanged since the last report: not read
+    FileBody body;               // Prefetched body (BODY_STREAM: reopened by the writer)
+    ManifestEntry stamp;         // Tag and stat fields of the opened file
+    uint64_t charge;             // Bytes of the body counted against PIPELINE_MEMORY_MAX
+    bool opened;                 // false if the file could not be opened
+    bool done;                   // Set under Prefetch.lock once the reader is finished
+} PrefetchSlot;
 
-    for (int i = 0; i < profile->ignored_extensions_count; i++)
-        if (strcmp(ext, profile->ignored_extensions[i]) == 0)
-            return false;
+/**
+ * @brief Shared state of a prefetching emission: a bounded ring of slots,
+ * filled in file order by reader threads and drained in the same order by
+ * the writer, which routes each body to the reports including the file.
+ */
+typedef struct {
+    Emitter *outputs; // outputs[i] writes report i
+    int output_count;
+    const FsNode **files;
+    size_t count;
+    PrefetchSlot *ring; // File i lives in ring[i % ring_size]
+    size_t ring_size;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_done; // Broadcast whenever a slot completes
+    pthread_cond_t slot_free; // Broadcast whenever the writer releases a slot
+    size_t next_read;         // Next file claimed by a reader
+    size_t next_write;        // Next file the writer emits
+    uint64_t memory_used;     // Sum of the charges of the slots in the ring
+    uint16_t exhausted;       // Bit i: set by the writer once report i is full
+} Prefetch;
 
-    // Check allow lists
-    if (filename[0] == '.') {
-        for (int i = 0; i < profile->allowed_dotfiles_count; i++)
-            if (strcmp(filename, profile->allowed_dotfiles[i]) == 0)
-                return true;
+/**
+ * @brief Fills in a slot's path and cached fragment.
+ *
+ * @return true if the file must be read, false if it is served from the
+ * last report (or has no path and is emitted as a bare header).
+ */
+static bool slot_prepare(const Prefetch *prefetch, PrefetchSlot *slot, const FsNode *node)
+{
+    size_t cap = 0;
+    slot->node = node;
+    slot->path_len = fs_node_path(node, &slot->path, &cap);
+    if (slot->path_len == (size_t)-1) {
+        slot->path_len = 0;
+        return false;
     }
+    slot->stamp.path = slot->path;
 
-    for (int i = 0; i < profile->allowed_filenames_count; i++)
-        if (strcmp(filename, profile->allowed_filenames[i]) == 0)
-            return true;
+    // Only single-report runs keep fragments
+    const Emitter *em = &prefetch->outputs[0];
+    if (em->cache) {
+        slot->stamp.tag = get_syntax_tag(em->profile, node->name);
+        slot->cached = fragment_lookup(em, node, slot->path, slot->stamp.tag);
+    }
+    return !slot->cached;
+}
 
-    for (int i = 0; i < profile->allowed_extensions_count; i++)
-        if (strcmp(ext, profile->allowed_extensions[i]) == 0)
+/**
+ * @brief Tells whether a body of the given size is needed: some report
+ * including the file takes it under max_file_size and is not full yet.
+ *
+ * @param prefetch The emission.
+ * @param node The file.
+ * @param size The file size in bytes.
+ * @param exhausted The reports known to be full.
+ */
+static bool body_wanted(const Prefetch *prefetch, const FsNode *node, uint64_t size,
+                        uint16_t exhausted)
+{
+    for (int i = 0; i < prefetch->output_count; i++) {
+        const LanguageProfile *profile = prefetch->outputs[i].profile;
+        if ((node->reports & ~exhausted & (1u << i)) &&
+            !(profile->max_file_size && size > profile->max_file_size))
             return true;
-
-    // Default to deny
+    }
     return false;
 }
 
 /**
- * @brief Recursively traverses the directory and processes allowed files.
+ * @brief Opens one file and reads its body, first waiting until the body
+ * fits in the ring's memory cap.
  *
- * @param md The Markdown file handle.
- * @param base_path The current directory being scanned.
- * @param profile The language profile with filter rules.
- * @param gi The loaded .gitignore rules.
- * @param output_file The name of the final .md file (to be ignored).
+ * The file the writer is waiting for is always read, whatever its size, so
+ * the pipeline cannot stall.
  */
-static void traverse_and_process(MarkdownHandle *md, const char *base_path,
-                                 const LanguageProfile *profile, Gitignore *gi,
-                                 const char *output_file)
+static void prefetch_read(Prefetch *prefetch, PrefetchSlot *slot, size_t index)
 {
-    DIR *dir = opendir(base_path);
-    if (!dir)
+    int fd = fs_node_open(slot->node, slot->path, O_RDONLY);
+    if (fd < 0)
         return;
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+    struct stat st;
+    ManifestEntry *stamp = &slot->stamp;
+    slot->opened = true;
+    if (fstat(fd, &st) == 0)
+        manifest_stamp(stamp, &st);
+    uint64_t charge = reader_select_mode(stamp->size) == BODY_STREAM ? 0 : stamp->size;
+
+    pthread_mutex_lock(&prefetch->lock);
+    bool load = body_wanted(prefetch, slot->node, stamp->size, prefetch->exhausted);
+    while (load && index != prefetch->next_write &&
+           prefetch->memory_used + charge > PIPELINE_MEMORY_MAX) {
+        pthread_cond_wait(&prefetch->slot_free, &prefetch->lock);
+        load = body_wanted(prefetch, slot->node, stamp->size, prefetch->exhausted);
+    }
+    if (load) {
+        prefetch->memory_used += charge;
+        slot->charge = charge;
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+
+    if (load && reader_load(&slot->body, fd, stamp->size) &&
+        emitter_hashes(&prefetch->outputs[0]) && slot->body.mode != BODY_STREAM &&
+        !slot->body.scan.binary)
+        stamp->hash = hash_bytes(slot->body.data, slot->body.length); // Off the writer thread
+    close(fd);
+}
+
+/**
+ * @brief Reader thread: claims files in order and fills their slots,
+ * waiting while the ring is full.
+ */
+static void *prefetch_reader(void *arg)
+{
+    Prefetch *prefetch = arg;
+    pthread_mutex_lock(&prefetch->lock);
+    for (;;) {
+        while (prefetch->next_read < prefetch->count &&
+               prefetch->next_read >= prefetch->next_write + prefetch->ring_size)
+            pthread_cond_wait(&prefetch->slot_free, &prefetch->lock);
+        if (prefetch->next_read >= prefetch->count)
+            break;
+        size_t index = prefetch->next_read++;
+        pthread_mutex_unlock(&prefetch->lock);
+
+        PrefetchSlot *slot = &prefetch->ring[index % prefetch->ring_size];
+        if (slot_prepare(prefetch, slot, prefetch->files[index]))
+            prefetch_read(prefetch, slot, index);
+
+        pthread_mutex_lock(&prefetch->lock);
+        slot->done = true;
+        pthread_cond_broadcast(&prefetch->slot_done);
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+    return NULL;
+}
+
+/**
+ * @brief Writes a prefetched file's header and code block to one report,
+ * subject to its size limits.
+ *
+ * @param prefetch The emission.
+ * @param slot The file.
+ * @param report The index of the report.
+ */
+static void emit_prefetched(Prefetch *prefetch, PrefetchSlot *slot, int report)
+{
+    Emitter *em = &prefetch->outputs[report];
+    md_add_header_len(em->md, 3, slot->path, slot->path_len);
+    slot->stamp.tag = get_syntax_tag(em->profile, slot->node->name);
+    if (slot->cached) {
+        if (!emit_cached(em, slot->cached))
+            emit_read(em, slot->node, slot->path, slot->stamp.tag);
+        return;
+    }
+
+    if (!slot->opened)
+        return;
+    const char *skipped = emit_skip_unread(em, slot->stamp.size);
+    if (skipped) {
+        md_add_raw_text(em->md, skipped);
+    }
+    else if (slot->body.mode == BODY_STREAM) {
+        int fd = fs_node_open(slot->node, slot->path, O_RDONLY);
+        if (fd >= 0) {
+            emit_fresh(em, &slot->stamp, fd, &slot->body);
+            close(fd);
+        }
+    }
+    else if (slot->body.mode != BODY_NONE) {
+        emit_fresh(em, &slot->stamp, -1, &slot->body);
+    }
+    else {
+        // Not read ahead since the report looked full, but it may be a copy
+        emit_read(em, slot->node, slot->path, slot->stamp.tag);
+    }
+    if (em->budget.exhausted && !(prefetch->exhausted & (1u << report))) {
+        pthread_mutex_lock(&prefetch->lock);
+        prefetch->exhausted |= (uint16_t)(1u << report);
+        pthread_mutex_unlock(&prefetch->lock);
+    }
+}
+
+/**
+ * @brief Writes a prefetched file to every report including it, then
+ * releases its body.
+ */
+static void route_prefetched(Prefetch *prefetch, PrefetchSlot *slot)
+{
+    for (int i = 0; i < prefetch->output_count; i++)
+        if (slot->node->reports & (1u << i))
+            emit_prefetched(prefetch, slot, i);
+    reader_release(&slot->body);
+}
+
+/**
+ * @brief Reads and writes the files one at a time on the calling thread.
+ */
+static void emit_files_serial(Emitter *outputs, int output_count, const FsNode **files,
+                              size_t count)
+{
+    Prefetch prefetch = {.outputs = outputs, .output_count = output_count};
+    pthread_mutex_init(&prefetch.lock, NULL);
+    for (size_t i = 0; i < count; i++) {
+        PrefetchSlot slot = {0};
+        prefetch.next_write = i; // The file being written is never held back
+        if (slot_prepare(&prefetch, &slot, files[i]))
+            prefetch_read(&prefetch, &slot, i);
+        if (slot.path)
+            route_prefetched(&prefetch, &slot);
+        free(slot.path);
+    }
+    pthread_mutex_destroy(&prefetch.lock);
+}
+
+/**
+ * @brief Writes the files in order on the calling thread while reader
+ * threads fill a ring of the following ones.
+ *
+ * The ring holds at most PIPELINE_RING_SLOTS files and PIPELINE_MEMORY_MAX
+ * bytes of bodies (plus, at worst, the one file the writer is waiting
+ * for); readers block while it is full, so reading and writing overlap
+ * without memory growing with the tree.
+ *
+ * @return true on success, false if no reader could be started (nothing
+ * has been written in that case).
+ */
+static bool emit_files_pipelined(Emitter *outputs, int output_count, const FsNode **files,
+                                 size_t count, int readers)
+{
+    size_t ring_size = count < PIPELINE_RING_SLOTS ? count : PIPELINE_RING_SLOTS;
+    PrefetchSlot *ring = calloc(ring_size, sizeof(PrefetchSlot));
+    pthread_t *threads = malloc((size_t)readers * sizeof(pthread_t));
+    if (!ring || !threads) {
+        free(ring);
+        free(threads);
+        return false;
+    }
+
+    Prefetch prefetch = {.outputs = outputs,
+                         .output_count = output_count,
+                         .files = files,
+                         .count = count,
+                         .ring = ring,
+                         .ring_size = ring_size};
+    pthread_mutex_init(&prefetch.lock, NULL);
+    pthread_cond_init(&prefetch.slot_done, NULL);
+    pthread_cond_init(&prefetch.slot_free, NULL);
+    int started = 0;
+    while (started < readers &&
+           pthread_create(&threads[started], NULL, prefetch_reader, &prefetch) == 0)
+        started++;
+
+    for (size_t i = 0; started > 0 && i < count; i++) {
+        PrefetchSlot *slot = &ring[i % ring_size];
+        pthread_mutex_lock(&prefetch.lock);
+        while (!slot->done)
+            pthread_cond_wait(&prefetch.slot_done, &prefetch.lock);
+        pthread_mutex_unlock(&prefetch.lock);
+
+        if (slot->path)
+            route_prefetched(&prefetch, slot);
+        free(slot->path);
+        uint64_t charge = slot->charge;
+        memset(slot, 0, sizeof(*slot)); // Readers only reuse it once next_write moves on
+
+        pthread_mutex_lock(&prefetch.lock);
+        prefetch.next_write++;
+        prefetch.memory_used -= charge;
+        pthread_cond_broadcast(&prefetch.slot_free);
+        pthread_mutex_unlock(&prefetch.lock);
+    }
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&prefetch.lock);
+    pthread_cond_destroy(&prefetch.slot_done);
+    pthread_cond_destroy(&prefetch.slot_free);
+    free(threads);
+    free(ring);
+    return started > 0;
+}
+
+/**
+ * @brief Operations of an io_uring batch, tagged in the low bits of
+ * user_data (the slot index is in the rest).
+ */
+enum {
+    URING_OP_OPEN,
+    URING_OP_STATX,
+    URING_OP_READ,
+    URING_OP_BITS = 2,
+};
+
+#define URING_IN_FLIGHT INT32_MIN // UringFile.got while its read is queued
+
+/**
+ * @brief A file of an io_uring batch.
+ */
+typedef struct {
+    int fd;
+    bool statx_ok;
+    struct statx stx;
+    char *buffer;    // Read target for small files (BODY_BUFFER), from the pool
+    size_t capacity; // The buffer's size
+    size_t want;     // Bytes requested: the scanned size plus one, to detect growth
+    int32_t got;     // Bytes read, a negated errno, or URING_IN_FLIGHT
+} UringFile;
+
+/**
+ * @brief Hands a completion to its file.
+ */
+static void uring_record(UringFile *batch, uint64_t user_data, int32_t res)
+{
+    UringFile *file = &batch[user_data >> URING_OP_BITS];
+    switch (user_data & ((1u << URING_OP_BITS) - 1)) {
+        case URING_OP_OPEN:
+            file->fd = res;
+            break;
+        case URING_OP_STATX:
+            file->statx_ok = res == 0;
+            break;
+        default:
+            file->got = res;
+            break;
+    }
+}
+
+/**
+ * @brief Waits for `pending` completions and hands each one to its file.
+ *
+ * @return true on success, false on a ring error.
+ */
+static bool uring_reap(Uring *ring, unsigned pending, UringFile *batch)
+{
+    if (pending == 0)
+        return true;
+    if (!uring_submit_and_wait(ring, pending))
+        return false;
+
+    uint64_t user_data;
+    int32_t res;
+    while (pending > 0) {
+        if (!uring_next_cqe(ring, &user_data, &res)) {
+            if (!uring_submit_and_wait(ring, 1))
+                return false;
             continue;
+        }
+        uring_record(batch, user_data, res);
+        pending--;
+    }
+    return true;
+}
+
+/**
+ * @brief After a ring error, waits for every request the kernel took and
+ * hands its completion to its file, so that no open completes unseen (its
+ * descriptor would leak). Reads the kernel never took are marked failed.
+ */
+static void uring_drain(Uring *ring, UringFile *batch, size_t count)
+{
+    uint64_t user_data;
+    int32_t res;
+    while (uring_in_flight(ring) > 0) {
+        if (uring_next_cqe(ring, &user_data, &res))
+            uring_record(batch, user_data, res);
+        else if (!uring_submit_and_wait(ring, 1))
+            return; // Requests may still be in flight: keep their buffers
+    }
+    for (size_t i = 0; i < count; i++)
+        if (batch[i].got == URING_IN_FLIGHT)
+            batch[i].got = -ECANCELED;
+}
+
+/**
+ * @brief Reads a batch of files with io_uring: one round of openat, then
+ * one round of statx plus a read of every small file. Requests that fail
+ * for any reason are retried on the synchronous path, which reports the
+ * real error.
+ *
+ * @return true on success, false on a ring error (the batch is then read
+ * synchronously).
+ */
+static bool uring_read_batch(Uring *ring, Prefetch *prefetch, PrefetchSlot *slots,
+                             UringFile *batch, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        batch[i].fd = -1;
+        batch[i].got = -1;
+    }
 
-        char path[PATH_MAX_LEN];
-        snprintf(path, sizeof(path), "%s/%s", base_path, entry->d_name);
+    unsigned pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!slots[i].path || slots[i].cached)
+            continue;
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        if (!sqe)
+            return false;
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)slots[i].path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC | O_NOCTTY;
+        sqe->user_data = (uint64_t)i << URING_OP_BITS | URING_OP_OPEN;
+        pending++;
+    }
+    if (!uring_reap(ring, pending, batch))
+        return false;
 
-        struct stat statbuf;
-        if (stat(path, &statbuf) != 0)
+    uint16_t exhausted = prefetch->exhausted; // Only the calling thread sets it
+    pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        UringFile *file = &batch[i];
+        if (file->fd < 0 && slots[i].path && !slots[i].cached)
+            file->fd = fs_node_open(slots[i].node, slots[i].path, O_RDONLY);
+        if (file->fd < 0)
             continue;
 
-        bool is_dir = S_ISDIR(statbuf.st_mode);
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        if (!sqe)
+            return false;
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = file->fd;
+        sqe->addr = (uint64_t)(uintptr_t)"";
+        sqe->statx_flags = AT_EMPTY_PATH;
+        sqe->len = STATX_INO | STATX_SIZE | STATX_MTIME;
+        sqe->off = (uint64_t)(uintptr_t)&file->stx;
+        sqe->user_data = (uint64_t)i << URING_OP_BITS | URING_OP_STATX;
+        pending++;
 
-        // Check .gitignore rules
-        if (gitignore_matches_path(gi, path, is_dir))
+        uint64_t size = slots[i].node->size;
+        if (size > READER_BUFFER_MAX || !body_wanted(prefetch, slots[i].node, size, exhausted))
             continue;
+        file->want = (size_t)size + 1;
+        file->buffer = reader_buffer_acquire(file->want, &file->capacity);
+        sqe = file->buffer ? uring_get_sqe(ring) : NULL;
+        if (!sqe)
+            continue; // Read synchronously instead
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file->fd;
+        sqe->addr = (uint64_t)(uintptr_t)file->buffer;
+        sqe->len = (uint32_t)file->want;
+        sqe->off = 0;
+        sqe->user_data = (uint64_t)i << URING_OP_BITS | URING_OP_READ;
+        file->got = URING_IN_FLIGHT;
+        pending++;
+    }
+    if (!uring_reap(ring, pending, batch))
+        return false;
+
+    for (size_t i = 0; i < count; i++) {
+        UringFile *file = &batch[i];
+        PrefetchSlot *slot = &slots[i];
+        if (file->fd < 0)
+            continue;
+
+        ManifestEntry *stamp = &slot->stamp;
+        struct stat st;
+        slot->opened = true;
+        if (file->statx_ok) {
+            stamp->ino = file->stx.stx_ino;
+            stamp->size = file->stx.stx_size;
+            stamp->mtime_ns =
+                (int64_t)file->stx.stx_mtime.tv_sec * 1000000000 + file->stx.stx_mtime.tv_nsec;
+        }
+        else if (fstat(file->fd, &st) == 0) {
+            manifest_stamp(stamp, &st);
+        }
 
-        if (is_dir) {
-            // Recurse into subdirectory
-            traverse_and_process(md, path, profile, gi, output_file);
+        // A complete read of an unchanged size is the body; anything else
+        // (the file grew or shrank, or the read failed) is read again
+        if (file->buffer && file->got >= 0 && (uint64_t)file->got == stamp->size &&
+            stamp->size < file->want) {
+            slot->body.mode = BODY_BUFFER;
+            slot->body.data = file->buffer;
+            slot->body.length = (size_t)file->got;
+            slot->body.capacity = file->capacity;
+            content_scan(&slot->body.scan, file->buffer, (size_t)file->got);
         }
         else {
-            const char *filename = strrchr(path, '/');
-            filename = filename ? filename + 1 : path;
-
-            // Don't include the output file itself
-            if (strcmp(filename, output_file) == 0)
-                continue;
-
-            // Check if the file is allowed by the profile
-            if (is_file_allowed(path, profile)) {
-                md_add_header(md, 3, path); // Add file path as a header
-                FILE *file = fopen(path, "rb");
-                if (file) {
-                    fseek(file, 0, SEEK_END);
-                    long length = ftell(file);
-                    fseek(file, 0, SEEK_SET);
-                    char *content = malloc(length + 1);
-                    if (content) {
-                        fread(content, 1, length, file);
-                        content[length] = '\0';
-
-                        const char *tag = get_syntax_tag(profile, filename);
-                        md_add_code_block(md, tag, content);
-                        free(content);
+            reader_buffer_release(file->buffer, file->capacity);
+            if (body_wanted(prefetch, slot->node, stamp->size, exhausted))
+                reader_load(&slot->body, file->fd, stamp->size);
+        }
+        close(file->fd);
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the files in order, reading them in io_uring batches of
+ * half the queue depth (each file takes up to two requests per round).
+ *
+ * @return true on success, false if io_uring is unavailable (nothing has
+ * been written in that case).
+ */
+static bool emit_files_uring(Emitter *outputs, int output_count, const FsNode **files,
+                             size_t count, unsigned depth)
+{
+    Uring *ring = uring_create(depth);
+    if (!ring)
+        return false;
+
+    size_t batch_size = depth / 2;
+    PrefetchSlot *slots = malloc(batch_size * sizeof(PrefetchSlot));
+    UringFile *batch = malloc(batch_size * sizeof(UringFile));
+    if (!slots || !batch) {
+        free(slots);
+        free(batch);
+        uring_destroy(ring);
+        return false;
+    }
+
+    Prefetch prefetch = {.outputs = outputs, .output_count = output_count};
+    pthread_mutex_init(&prefetch.lock, NULL);
+    for (size_t start = 0; start < count; start += batch_size) {
+        size_t n = count - start < batch_size ? count - start : batch_size;
+        memset(slots, 0, n * sizeof(PrefetchSlot));
+        memset(batch, 0, n * sizeof(UringFile));
+        for (size_t i = 0; i < n; i++)
+            slot_prepare(&prefetch, &slots[i], files[start + i]);
+
+        if (!uring_read_batch(ring, &prefetch, slots, batch, n)) {
+            // The ring is unusable: once the requests it took are done,
+            // close the files the batch opened and release its buffers,
+            // except any a queued read may still fill. Everything left is
+            // read synchronously.
+            uring_drain(ring, batch, n);
+            for (size_t i = 0; i < n; i++) {
+                if (batch[i].fd >= 0)
+                    close(batch[i].fd);
+                if (batch[i].got != URING_IN_FLIGHT)
+                    reader_buffer_release(batch[i].buffer, batch[i].capacity);
+                free(slots[i].path);
+            }
+            emit_files_serial(outputs, output_count, files + start, count - start);
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (slots[i].path)
+                route_prefetched(&prefetch, &slots[i]);
+            free(slots[i].path);
+        }
+    }
+
+    pthread_mutex_destroy(&prefetch.lock);
+    free(slots);
+    free(batch);
+    uring_destroy(ring);
+    return true;
+}
+
+/**
+ * @brief Lists the allowed files in walk order (pre-order, readdir order per
+ * directory).
+ *
+ * @return A newly allocated array (NULL if there are no files), or NULL
+ * with `*count` set to 0 on allocation failure.
+ */
+static const FsNode **collect_files(const FsTree *tree, size_t *count)
+{
+    const FsNode **files = NULL;
+    size_t cap = 0;
+    *count = 0;
+    for (const FsNode *node = fs_tree_root(tree); node; node = fs_node_next(node, true)) {
+        if (!(node->flags & FS_NODE_ALLOWED))
+            continue;
+        if (*count == cap) {
+            size_t new_cap = cap ? cap * 2 : 64;
+            const FsNode **grown = realloc(files, new_cap * sizeof(*files));
+            if (!grown)
+                break;
+            files = grown;
+            cap = new_cap;
+        }
+        files[(*count)++] = node;
+    }
+    return files;
+}
+
+/**
+ * @brief Writes the files with the fastest available method, each to the
+ * reports including it (outputs[i] writes report i).
+ */
+static void emit_files(Emitter *outputs, int output_count, const FsNode **files, size_t count,
+                       const ReadOptions *opts)
+{
+    DedupTable dedup[FS_TREE_MAX_REPORTS] = {0};
+    for (int i = 0; opts->dedup && i < output_count; i++)
+        if (!outputs[i].dedup)
+            outputs[i].dedup = &dedup[i];
+    bool done = opts->uring_depth > 0 &&
+                emit_files_uring(outputs, output_count, files, count, opts->uring_depth);
+    if (!done && count > 1)
+        done = emit_files_pipelined(outputs, output_count, files, count, opts->jobs);
+    if (!done)
+        emit_files_serial(outputs, output_count, files, count);
+    for (int i = 0; i < output_count; i++) {
+        if (outputs[i].dedup == &dedup[i])
+            outputs[i].dedup = NULL;
+        dedup_destroy(&dedup[i]);
+    }
+}
+
+void process_project_files(MarkdownHandle *md, ReportIndex *index, const FsTree *tree,
+                           const LanguageProfile *profile, FragmentCache *cache,
+                           const ReadOptions *opts)
+{
+    size_t count;
+    const FsNode **files = collect_files(tree, &count);
+    Emitter em = {.md = md, .profile = profile, .cache = cache, .index = index};
+    emit_files(&em, 1, files, count, opts);
+    free(files);
+}
+
+void process_project_reports(MarkdownHandle *const *mds, ReportIndex *const *indexes,
+                             const ReportSpec *reports, int count, const FsTree *tree,
+                             const ReadOptions *opts)
+{
+    size_t file_count;
+    const FsNode **files = collect_files(tree, &file_count);
+    Emitter outputs[FS_TREE_MAX_REPORTS];
+    for (int i = 0; i < count; i++)
+        outputs[i] = (Emitter){.md = mds[i], .profile = reports[i].profile, .index = indexes[i]};
+    emit_files(outputs, count, files, file_count, opts);
+    free(files);
+}
+
+static int compare_sizes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Tells whether a size occurs more than once in a sorted array.
+ */
+static bool size_repeated(const uint64_t *sizes, size_t count, uint64_t size)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sizes[mid] < size)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo + 1 < count && sizes[lo] == size && sizes[lo + 1] == size;
+}
+
+/**
+ * @brief Reads a file and hashes its body as emit_fresh() does, then looks
+ * for an earlier copy of it.
+ *
+ * @param node The file.
+ * @param path Its full path.
+ * @param written The bodies written so far.
+ * @param original Receives the path of the confirmed earlier copy, or NULL.
+ * @return The hash, or 0 if the file is streamed, binary or cannot be read.
+ */
+static uint64_t digest_file(const FsNode *node, const char *path, const DedupTable *written,
+                            const char **original)
+{
+    *original = NULL;
+    if (reader_select_mode(node->size) == BODY_STREAM)
+        return 0;
+    int fd = fs_node_open(node, path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    FileBody body;
+    uint64_t hash = 0;
+    if (reader_load(&body, fd, node->size)) {
+        if ((body.mode == BODY_BUFFER || body.mode == BODY_HEAP) && !body.scan.binary)
+            hash = hash_bytes(body.data, body.length);
+        const char *found = dedup_find(written, hash, node->size);
+        if (found && dedup_confirm(found, body.data, body.length))
+            *original = found;
+        reader_release(&body);
+    }
+    close(fd);
+    return hash;
+}
+
+size_t split_project_files(const FsTree *tree, const LanguageProfile *profile, uint64_t target,
+                           bool dedup, FileSpan **spans_out)
+{
+    size_t count;
+    const FsNode **files = collect_files(tree, &count);
+    FileSpan *spans = malloc(sizeof(FileSpan));
+    uint64_t *sizes = dedup && count ? malloc(count * sizeof(uint64_t)) : NULL;
+    FileDigest *digests = NULL;
+    if (!spans || (dedup && count && !sizes)) {
+        free(spans);
+        free(sizes);
+        free(files);
+        return 0;
+    }
+    size_t span_count = 1;
+    size_t span_cap = 1;
+    spans[0] = (FileSpan){.files = files};
+
+    // Only files sharing their size with another can be copies
+    for (size_t i = 0; sizes && i < count; i++)
+        sizes[i] = files[i]->size;
+    if (sizes)
+        qsort(sizes, count, sizeof(uint64_t), compare_sizes);
+
+    // Replays the size limits and deduplication on the scanned files, so each
+    // span starts from the state a single report would have at that point
+    SizeBudget budget = {0};
+    DedupTable written = {0};
+    size_t digest_count = 0;
+    size_t digest_cap = 0;
+    uint64_t filled = 0;
+    char *path = NULL;
+    size_t path_cap = 0;
+    bool failed = false;
+    for (size_t i = 0; i < count; i++) {
+        const FsNode *node = files[i];
+        size_t path_len = fs_node_path(node, &path, &path_cap);
+        SizeBudget before = budget;
+        size_t before_digests = digest_count;
+        uint64_t estimate = (path_len == (size_t)-1 ? 0 : path_len) + 16; // Header and fences
+        bool fits = !(profile->max_file_size && node->size > profile->max_file_size);
+        uint64_t hash = 0;
+        const char *original = NULL;
+        if (path_len != (size_t)-1 && fits && sizes && size_repeated(sizes, count, node->size))
+            hash = digest_file(node, path, &written, &original);
+        if (original) {
+            estimate += strlen(original) + 20; // The "_Identical to_" note
+        }
+        else if (!size_budget_check(&budget, profile, node->size)) {
+            estimate += node->size;
+            if (hash != 0) {
+                if (digest_count == digest_cap) {
+                    size_t new_cap = digest_cap ? digest_cap * 2 : 64;
+                    FileDigest *grown = realloc(digests, new_cap * sizeof(FileDigest));
+                    if (!grown) {
+                        failed = true;
+                        break;
                     }
-                    fclose(file);
+                    digests = grown;
+                    digest_cap = new_cap;
                 }
+                digests[digest_count++] = (FileDigest){node, hash, node->size};
+                dedup_insert(&written, hash, node->size, path);
             }
         }
+
+        FileSpan *span = &spans[span_count - 1];
+        if (span->count > 0 && filled + estimate > target) {
+            if (span_count == span_cap) {
+                FileSpan *grown = realloc(spans, span_cap * 2 * sizeof(FileSpan));
+                if (!grown) {
+                    failed = true;
+                    break;
+                }
+                spans = grown;
+                span_cap *= 2;
+            }
+            span = &spans[span_count++];
+            *span = (FileSpan){.files = &files[i],
+                               .budget_used = before.used,
+                               .budget_exhausted = before.exhausted,
+                               .written_count = before_digests};
+            filled = 0;
+        }
+        span->count++;
+        filled += estimate;
+    }
+    free(path);
+    free(sizes);
+    dedup_destroy(&written);
+    for (size_t i = 0; i < span_count; i++)
+        spans[i].written = digests; // Every span reads a prefix of the same array
+    if (failed) {
+        free_file_spans(spans, span_count);
+        return 0;
+    }
+    *spans_out = spans;
+    return span_count;
+}
+
+void free_file_spans(FileSpan *spans, size_t count)
+{
+    if (!spans)
+        return;
+    if (count > 0) {
+        // Every span points into the first one's arrays
+        free(spans[0].files);
+        free((void *)spans[0].written);
     }
-    closedir(dir);
+    free(spans);
 }
 
-void process_project_files(MarkdownHandle *md, const char *root_path,
-                           const LanguageProfile *profile, const char *output_file)
+void process_file_span(MarkdownHandle *md, ReportIndex *index, const FileSpan *span,
+                       const LanguageProfile *profile, const ReadOptions *opts)
 {
-    Gitignore *gi = gitignore_load(root_path);
-    traverse_and_process(md, root_path, profile, gi, output_file);
-    gitignore_free(gi);
-}
\ No newline at end of file
+    DedupTable dedup = {0};
+    Emitter em = {.md = md, .profile = profile, .index = index};
+    em.budget.used = span->budget_used;
+    em.budget.exhausted = span->budget_exhausted;
+    if (opts->dedup) {
+        em.dedup = &dedup;
+        char *path = NULL;
+        size_t path_cap = 0;
+        for (size_t i = 0; i < span->written_count; i++) {
+            const FileDigest *digest = &span->written[i];
+            if (fs_node_path(digest->node, &path, &path_cap) != (size_t)-1)
+                dedup_insert(&dedup, digest->hash, digest->size, path);
+        }
+        free(path);
+    }
+    emit_files(&em, 1, span->files, span->count, opts);
+    dedup_destroy(&dedup);
+}
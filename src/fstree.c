@@ -0,0 +1,892 @@
+#define _GNU_SOURCE // For fdopendir(), openat() and the DT_* constants
+#include "fstree.h"
+#include "arena.h"
+#include "gitignore.h"
+#include "gitrepo.h"
+#include "manifest.h"
+#include "walk.h"
+#include "workpool.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FSTREE_MAX_HELD_DIRS 128
+
+/**
+ * @brief Internal representation of a scanned project.
+ */
+struct FsTree {
+    FsNode *root;
+    Arena **arenas; // [0]: the building thread; [1 + i]: scanning worker i
+    int arena_count;
+    const FsNode **added; // Directories added by the last fs_tree_rescan()
+    size_t added_count;
+    size_t added_cap;
+};
+
+/**
+ * @brief Rules shared by both builders to classify an entry.
+ */
+typedef struct {
+    const ReportSpec *reports;
+    int report_count;
+    const Gitignore *gi;
+} TreeFilter;
+
+/**
+ * @brief Records the stat fields of an allowed file.
+ */
+static void node_set_stat(FsNode *node, const struct stat *st)
+{
+    node->size = (uint64_t)st->st_size;
+    node->ino = (uint64_t)st->st_ino;
+    node->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Computes the FS_NODE_* flags of an entry.
+ *
+ * @param filter The classification rules.
+ * @param ignore The gitignore rules of the entry's directory (may be NULL).
+ * @param name The entry name.
+ * @param kind The entry kind.
+ * @param reports Receives the bits of the reports including the file.
+ * @return The flags.
+ */
+static uint8_t classify_entry(const TreeFilter *filter, const GitignoreDir *ignore,
+                              const char *name, WalkKind kind, uint16_t *reports)
+{
+    bool is_dir = kind == WALK_DIR;
+    *reports = 0;
+    if ((is_dir && strcmp(name, ".git") == 0) || gitignore_dir_matches(ignore, name, is_dir))
+        return FS_NODE_IGNORED;
+    if (kind != WALK_FILE)
+        return 0; // Never read FIFOs or devices
+    for (int i = 0; i < filter->report_count; i++) {
+        const char *output_file = filter->reports[i].output_file;
+        if (strcmp(output_file, REPORT_STDOUT) != 0 && manifest_is_report_file(name, output_file))
+            return FS_NODE_OUTPUT;
+    }
+    for (int i = 0; i < filter->report_count; i++)
+        if (profile_allows_file(filter->reports[i].profile, name))
+            *reports |= (uint16_t)(1u << i);
+    return *reports ? FS_NODE_ALLOWED : 0;
+}
+
+/**
+ * @brief Appends a node to the children of `parent`, whose last child is
+ * tracked in `*tail`.
+ */
+static void node_link(FsNode *parent, FsNode **tail, FsNode *node)
+{
+    node->next = NULL;
+    if (*tail)
+        (*tail)->next = node;
+    else if (parent)
+        parent->children = node;
+    *tail = node;
+}
+
+/**
+ * @brief Allocates a node (and a copy of its name) and appends it to the
+ * children of `parent`, whose last child is tracked in `*tail`.
+ */
+static FsNode *node_append(Arena *arena, FsNode *parent, FsNode **tail, const char *name,
+                           size_t name_len, WalkKind kind, uint8_t flags, uint16_t reports)
+{
+    FsNode *node = arena_alloc(arena, sizeof(FsNode));
+    char *copy = node ? arena_strndup(arena, name, name_len) : NULL;
+    if (!copy)
+        return NULL;
+
+    memset(node, 0, sizeof(*node));
+    node->name = copy;
+    node->name_len = (uint32_t)name_len;
+    node->parent = parent;
+    node->kind = (uint8_t)kind;
+    node->flags = flags;
+    node->reports = reports;
+    node_link(parent, tail, node);
+    return node;
+}
+
+/**
+ * @brief Marks a node and every node below it FS_NODE_REMOVED.
+ */
+static void node_remove(FsNode *node)
+{
+    FsNode *cursor = node;
+    while (cursor) {
+        cursor->flags |= FS_NODE_REMOVED;
+        if (cursor->children) {
+            cursor = cursor->children;
+            continue;
+        }
+        while (cursor != node && !cursor->next)
+            cursor = cursor->parent;
+        cursor = cursor != node ? cursor->next : NULL;
+    }
+}
+
+/**
+ * @brief A directory being filled by the sequential builder.
+ */
+typedef struct {
+    FsNode *dir;
+    FsNode *tail;         // Last child appended so far
+    GitignoreDir *ignore; // Pushed with the directory's first entry
+    bool ignore_ready;
+} BuildLevel;
+
+/**
+ * @brief The previous children of a directory listed again, which its new
+ * listing takes over by name.
+ */
+typedef struct {
+    FsNode **nodes; // NULL once taken
+    size_t count;
+    size_t cursor; // Where the next lookup starts: readdir order rarely changes
+} OldChildren;
+
+/**
+ * @brief Takes the previous node of an entry still there with the same kind
+ * and classification.
+ *
+ * @return The node, or NULL if the entry is new (or changed).
+ */
+static FsNode *old_children_take(OldChildren *old, const char *name, size_t name_len,
+                                 WalkKind kind, uint8_t flags)
+{
+    for (size_t n = 0; n < old->count; n++) {
+        size_t i = (old->cursor + n) % old->count;
+        FsNode *node = old->nodes[i];
+        if (!node || node->name_len != name_len || memcmp(node->name, name, name_len) != 0)
+            continue;
+        if (node->kind != kind || node->flags != flags)
+            return NULL; // Left to be removed
+        old->nodes[i] = NULL;
+        old->cursor = i + 1;
+        return node;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Records a directory added by a rescan.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool tree_note_added(FsTree *tree, const FsNode *dir)
+{
+    if (tree->added_count == tree->added_cap) {
+        size_t new_cap = tree->added_cap ? tree->added_cap * 2 : 16;
+        const FsNode **added = realloc(tree->added, new_cap * sizeof(*added));
+        if (!added)
+            return false;
+        tree->added = added;
+        tree->added_cap = new_cap;
+    }
+    tree->added[tree->added_count++] = dir;
+    return true;
+}
+
+/**
+ * @brief Builds the subtree of a directory on the calling thread with a
+ * single DirWalk.
+ *
+ * @param tree The tree.
+ * @param filter The classification rules.
+ * @param path The directory's full path.
+ * @param top The directory, with its gitignore frames if already known
+ * (released here).
+ * @param old Its previous children, taken over where still there, or NULL
+ * for a first scan. New subdirectories are then recorded as added.
+ * @return true on success, false if the directory cannot be read.
+ */
+static bool build_sequential(FsTree *tree, const TreeFilter *filter, const char *path,
+                             BuildLevel top, OldChildren *old)
+{
+    DirWalk *walk = dirwalk_open(path);
+    BuildLevel *levels = walk ? calloc(16, sizeof(BuildLevel)) : NULL;
+    size_t levels_cap = 16;
+    if (!levels) {
+        gitignore_dir_close(top.ignore);
+        if (walk)
+            dirwalk_close(walk);
+        return false;
+    }
+    Arena *arena = tree->arenas[0];
+    levels[0] = top;
+    if (old)
+        top.dir->children = NULL;
+    bool ok = true;
+
+    WalkEntry entry;
+    while (dirwalk_next(walk, &entry)) {
+        size_t depth = (size_t)entry.depth;
+        BuildLevel *level = &levels[depth];
+        if (!level->ignore_ready) {
+            // The directory's frame, on top of its parent's
+            GitignoreDir *parent = depth > 0 ? levels[depth - 1].ignore : NULL;
+            const char *dir_name = depth > 0 ? level->dir->name : NULL;
+            level->ignore =
+                gitignore_dir_open(filter->gi, parent, dirwalk_dir_fd(walk), dir_name);
+            level->ignore_ready = true;
+        }
+        size_t name_len = entry.path_len - (size_t)(entry.name - entry.path);
+        uint16_t reports;
+        uint8_t flags = classify_entry(filter, level->ignore, entry.name, entry.kind, &reports);
+        FsNode *reused =
+            depth == 0 && old ? old_children_take(old, entry.name, name_len, entry.kind, flags)
+                              : NULL;
+        FsNode *node = reused;
+        if (reused)
+            node_link(level->dir, &level->tail, reused);
+        else
+            node = node_append(arena, level->dir, &level->tail, entry.name, name_len,
+                               entry.kind, flags, reports);
+        if (!node)
+            break;
+
+        if (flags & FS_NODE_ALLOWED) {
+            struct stat st;
+            if (dirwalk_stat(walk, &st))
+                node_set_stat(node, &st);
+        }
+
+        // A subdirectory still there keeps its subtree
+        if (entry.kind != WALK_DIR || (flags & FS_NODE_IGNORED) || reused)
+            continue;
+        if (depth == 0 && old && !(ok = tree_note_added(tree, node)))
+            break;
+        if (depth + 2 > levels_cap) {
+            BuildLevel *grown = realloc(levels, levels_cap * 2 * sizeof(BuildLevel));
+            if (!grown)
+                break;
+            memset(grown + levels_cap, 0, levels_cap * sizeof(BuildLevel));
+            levels = grown;
+            levels_cap *= 2;
+        }
+        if (dirwalk_descend(walk)) {
+            BuildLevel *child = &levels[depth + 1];
+            gitignore_dir_close(child->ignore); // Left by a previous sibling's subtree
+            *child = (BuildLevel){.dir = node};
+        }
+    }
+
+    for (size_t i = 0; i < levels_cap; i++)
+        gitignore_dir_close(levels[i].ignore);
+    free(levels);
+    dirwalk_close(walk);
+    return ok;
+}
+
+/**
+ * @brief A directory task of the parallel builder.
+ *
+ * Tasks live in per-worker scratch arenas until the build ends, so the
+ * parent chain can always be followed for cycle detection.
+ */
+typedef struct ScanTask {
+    FsNode *node;
+    struct ScanTask *parent;
+    struct ScanTask *next; // Next sibling task queued by the same parent
+    const char *path;      // Full path, to open the directory and name its children
+    size_t path_len;
+    GitignoreDir *ignore;  // The parent's frames (a reference held until opened)
+    dev_t dev;
+    ino_t ino;
+    DIR *stream;     // Kept open until every child has opened itself
+    size_t unopened; // References to stream still held (under the lock)
+} ScanTask;
+
+/**
+ * @brief Shared state of a parallel build.
+ */
+typedef struct {
+    FsTree *tree;
+    const TreeFilter *filter;
+    Arena **scratch; // Indexed like FsTree.arenas
+    pthread_mutex_t lock;
+    size_t held_streams; // Directories kept open for their children
+    bool root_failed;
+} ParallelBuild;
+
+/**
+ * @brief Drops one reference to a held directory stream, closing it when
+ * the owning task and every child are done with it.
+ */
+static void scan_task_release(ParallelBuild *build, ScanTask *task)
+{
+    pthread_mutex_lock(&build->lock);
+    bool last = --task->unopened == 0;
+    if (last)
+        build->held_streams--;
+    pthread_mutex_unlock(&build->lock);
+    if (last) {
+        closedir(task->stream);
+        task->stream = NULL;
+    }
+}
+
+/**
+ * @brief Opens a directory task relative to its parent's descriptor (by
+ * path only for the root or if the parent could not be kept open),
+ * refusing directories already being scanned further up the same branch.
+ *
+ * @return An open directory stream, or NULL.
+ */
+static DIR *scan_task_open(ParallelBuild *build, ScanTask *task)
+{
+    ScanTask *parent = task->parent;
+    int fd;
+    if (parent && parent->stream) {
+        fd = openat(dirfd(parent->stream), task->node->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        scan_task_release(build, parent);
+    }
+    else {
+        fd = fs_node_open(task->node, task->path, O_RDONLY | O_DIRECTORY);
+    }
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    for (const ScanTask *up = parent; up; up = up->parent) {
+        if (up->dev == st.st_dev && up->ino == st.st_ino) {
+            close(fd);
+            return NULL;
+        }
+    }
+    task->dev = st.st_dev;
+    task->ino = st.st_ino;
+
+    DIR *d = fdopendir(fd);
+    if (!d)
+        close(fd);
+    return d;
+}
+
+/**
+ * @brief Worker callback: lists one directory into the tree and queues its
+ * subdirectories.
+ */
+static void scan_task_run(WorkPool *pool, int worker, void *task_ptr, void *ctx)
+{
+    ParallelBuild *build = ctx;
+    ScanTask *task = task_ptr;
+    Arena *arena = build->tree->arenas[worker + 1];
+    Arena *scratch = build->scratch[worker + 1];
+
+    DIR *d = scan_task_open(build, task);
+    if (!d) {
+        gitignore_dir_close(task->ignore);
+        if (!task->parent)
+            build->root_failed = true; // Read after workpool_wait()
+        return;
+    }
+
+    int fd = dirfd(d);
+    GitignoreDir *ignore = gitignore_dir_open(build->filter->gi, task->ignore, fd,
+                                              task->parent ? task->node->name : NULL);
+    gitignore_dir_close(task->ignore);
+    char *path = NULL;
+    size_t path_cap = 0;
+    FsNode *tail = NULL;
+    ScanTask *children = NULL;
+    ScanTask **children_tail = &children;
+    size_t child_count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        WalkKind kind;
+        if (!walk_resolve_kind(fd, name, WALK_DTYPE(entry), &kind))
+            continue;
+
+        size_t name_len = strlen(name);
+        size_t path_len = task->path_len + 1 + name_len;
+        if (path_len + 1 > path_cap) {
+            char *grown = realloc(path, path_len + 1);
+            if (!grown)
+                break;
+            path = grown;
+            path_cap = path_len + 1;
+        }
+        memcpy(path, task->path, task->path_len);
+        path[task->path_len] = '/';
+        memcpy(path + task->path_len + 1, name, name_len + 1);
+
+        uint16_t reports;
+        uint8_t flags = classify_entry(build->filter, ignore, name, kind, &reports);
+        FsNode *node =
+            node_append(arena, task->node, &tail, name, name_len, kind, flags, reports);
+        if (!node)
+            break;
+
+        if (flags & FS_NODE_ALLOWED) {
+            struct stat st;
+            if (fstatat(fd, name, &st, 0) == 0)
+                node_set_stat(node, &st);
+        }
+
+        if (kind != WALK_DIR || (flags & FS_NODE_IGNORED))
+            continue;
+        ScanTask *child = arena_alloc(scratch, sizeof(ScanTask));
+        char *child_path = child ? arena_strndup(scratch, path, path_len) : NULL;
+        if (!child_path)
+            continue;
+        memset(child, 0, sizeof(*child));
+        child->node = node;
+        child->parent = task;
+        child->path = child_path;
+        child->path_len = path_len;
+        child->ignore = gitignore_dir_ref(ignore);
+        *children_tail = child;
+        children_tail = &child->next;
+        child_count++;
+    }
+    free(path);
+    gitignore_dir_close(ignore);
+
+    // Keep the stream open so children can open themselves relative to it;
+    // this task holds one extra reference until they are queued.
+    if (child_count > 0) {
+        pthread_mutex_lock(&build->lock);
+        if (build->held_streams < FSTREE_MAX_HELD_DIRS) {
+            build->held_streams++;
+            task->unopened = child_count + 1;
+            task->stream = d;
+        }
+        pthread_mutex_unlock(&build->lock);
+    }
+
+    for (ScanTask *child = children; child; child = child->next)
+        workpool_push(pool, worker, child);
+
+    if (task->stream)
+        scan_task_release(build, task);
+    else
+        closedir(d);
+}
+
+/**
+ * @brief Builds the tree with a pool of scanning threads.
+ *
+ * @return true on success, false if the pool could not be started (the tree
+ * is untouched in that case) or the root cannot be read.
+ */
+static bool build_parallel(FsTree *tree, const TreeFilter *filter, int jobs)
+{
+    ParallelBuild build = {.tree = tree, .filter = filter};
+    build.scratch = calloc((size_t)tree->arena_count, sizeof(Arena *));
+    bool ok = build.scratch != NULL;
+    for (int i = 0; ok && i < tree->arena_count; i++)
+        ok = (build.scratch[i] = arena_create()) != NULL;
+
+    ScanTask *root = ok ? arena_alloc(build.scratch[0], sizeof(ScanTask)) : NULL;
+    WorkPool *pool = NULL;
+    if (root) {
+        memset(root, 0, sizeof(*root));
+        root->node = tree->root;
+        root->path = tree->root->name;
+        root->path_len = tree->root->name_len;
+        pthread_mutex_init(&build.lock, NULL);
+        pool = workpool_create(jobs, scan_task_run, &build);
+        if (pool) {
+            workpool_push(pool, -1, root);
+            workpool_wait(pool);
+            workpool_destroy(pool);
+        }
+        pthread_mutex_destroy(&build.lock);
+    }
+
+    for (int i = 0; build.scratch && i < tree->arena_count; i++)
+        arena_destroy(build.scratch[i]);
+    free(build.scratch);
+    return pool && !build.root_failed;
+}
+
+/**
+ * @brief Allocates a tree with its arenas and a root node named after the
+ * root path.
+ *
+ * @return The tree, or NULL on allocation failure.
+ */
+static FsTree *tree_create(const char *root_path, int arena_count)
+{
+    FsTree *tree = calloc(1, sizeof(FsTree));
+    if (!tree)
+        return NULL;
+    tree->arena_count = arena_count;
+    tree->arenas = calloc((size_t)tree->arena_count, sizeof(Arena *));
+    bool ok = tree->arenas != NULL;
+    for (int i = 0; ok && i < tree->arena_count; i++)
+        ok = (tree->arenas[i] = arena_create()) != NULL;
+
+    FsNode *tail = NULL;
+    if (ok)
+        tree->root = node_append(tree->arenas[0], NULL, &tail, root_path, strlen(root_path),
+                                 WALK_DIR, 0, 0);
+    if (!tree->root) {
+        fs_tree_free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+FsTree *fs_tree_build(const char *root_path, const ReportSpec *reports, int report_count,
+                      int jobs)
+{
+    FsTree *tree = tree_create(root_path, jobs > 1 ? jobs + 1 : 1);
+    if (!tree)
+        return NULL;
+
+    Gitignore *gi = gitignore_load(root_path);
+    TreeFilter filter = {.reports = reports, .report_count = report_count, .gi = gi};
+    // A failed parallel build leaves the root empty: retry on this thread
+    bool built = jobs > 1 && build_parallel(tree, &filter, jobs);
+    if (!built)
+        built = build_sequential(tree, &filter, root_path, (BuildLevel){.dir = tree->root}, NULL);
+    gitignore_free(gi);
+
+    if (!built) {
+        fs_tree_free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+/**
+ * @brief Computes the gitignore frames of a directory of the tree, reading
+ * the .gitignore files from the root down.
+ *
+ * @param frames Receives the frames (NULL if no rule can match).
+ * @return true on success, false if a directory on the way cannot be
+ * opened.
+ */
+static bool dir_frames(const FsNode *dir, const Gitignore *gi, GitignoreDir **frames)
+{
+    size_t depth = 0;
+    for (const FsNode *up = dir; up->parent; up = up->parent)
+        depth++;
+    const FsNode **chain = malloc((depth ? depth : 1) * sizeof(*chain));
+    if (!chain)
+        return false;
+    const FsNode *root = dir;
+    for (size_t i = depth; root->parent; root = root->parent)
+        chain[--i] = root;
+
+    int dir_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    int fd = open(root->name, dir_flags);
+    GitignoreDir *ignore = fd >= 0 ? gitignore_dir_open(gi, NULL, fd, NULL) : NULL;
+    for (size_t i = 0; i < depth && fd >= 0; i++) {
+        int next = openat(fd, chain[i]->name, dir_flags);
+        close(fd);
+        fd = next;
+        GitignoreDir *child = fd >= 0 ? gitignore_dir_open(gi, ignore, fd, chain[i]->name) : NULL;
+        gitignore_dir_close(ignore);
+        ignore = child;
+    }
+    free(chain);
+    if (fd < 0)
+        return false;
+    close(fd);
+    *frames = ignore;
+    return true;
+}
+
+/**
+ * @brief Lists a directory of the tree again, taking over the nodes of the
+ * entries still there and marking the others FS_NODE_REMOVED.
+ *
+ * @return true on success, false if the directory cannot be read (it is
+ * left as it was) or on allocation failure.
+ */
+static bool rescan_dir(FsTree *tree, const TreeFilter *filter, FsNode *dir)
+{
+    size_t count = 0;
+    for (const FsNode *child = dir->children; child; child = child->next)
+        count++;
+    OldChildren old = {.nodes = malloc((count ? count : 1) * sizeof(FsNode *)), .count = count};
+    char *path = NULL;
+    size_t path_cap = 0;
+    bool ok = old.nodes && fs_node_path(dir, &path, &path_cap) != (size_t)-1;
+    size_t i = 0;
+    for (FsNode *child = ok ? dir->children : NULL; child; child = child->next)
+        old.nodes[i++] = child;
+
+    BuildLevel top = {.dir = dir, .ignore_ready = true};
+    ok = ok && dir_frames(dir, filter->gi, &top.ignore) &&
+         build_sequential(tree, filter, path, top, &old);
+    for (i = 0; ok && i < count; i++)
+        if (old.nodes[i])
+            node_remove(old.nodes[i]);
+    free(path);
+    free(old.nodes);
+    return ok;
+}
+
+bool fs_tree_rescan(FsTree *tree, const FsTreeChange *changes, size_t count,
+                    const ReportSpec *reports, int report_count)
+{
+    // Drop replaced subtrees first, so listing their parents cannot reuse them
+    tree->added_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        FsNode *dir = (FsNode *)changes[i].dir; // One of the tree's own nodes
+        if (!changes[i].subtree)
+            continue;
+        if (dir->parent)
+            node_remove(dir);
+        else
+            for (FsNode *child = dir->children; child; child = child->next)
+                node_remove(child);
+    }
+
+    Gitignore *gi = gitignore_load(tree->root->name);
+    TreeFilter filter = {.reports = reports, .report_count = report_count, .gi = gi};
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; i++) {
+        FsNode *dir = (FsNode *)changes[i].dir;
+        if (changes[i].subtree && dir->parent)
+            dir = dir->parent;
+        if (dir->flags & FS_NODE_REMOVED)
+            continue; // Scanned afresh along with an ancestor
+        // A subdirectory that cannot be read is gone: its parent drops it
+        ok = rescan_dir(tree, &filter, dir) || dir->parent != NULL;
+    }
+    gitignore_free(gi);
+    return ok;
+}
+
+const FsNode *const *fs_tree_added(const FsTree *tree, size_t *count)
+{
+    *count = tree->added_count;
+    return tree->added;
+}
+
+/**
+ * @brief A directory being filled by the index builder.
+ */
+typedef struct {
+    FsNode *dir;
+    FsNode *tail;       // Last child appended so far
+    const char *prefix; // "<relative path>/" of the directory (first prefix_len bytes)
+    size_t prefix_len;
+} IndexLevel;
+
+/**
+ * @brief Builds the tree from the tracked paths of a git index.
+ *
+ * Index paths are sorted byte-wise, so the paths below a directory are
+ * contiguous and a stack of the directories of the current path suffices.
+ * Allowed files are stat'ed; those missing from the work tree are left out.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool build_from_index(FsTree *tree, const TreeFilter *filter, const GitIndex *index)
+{
+    size_t count;
+    const GitIndexEntry *entries = git_index_entries(index, &count);
+    Arena *arena = tree->arenas[0];
+    size_t root_len = tree->root->name_len;
+
+    size_t levels_cap = 16;
+    IndexLevel *levels = malloc(levels_cap * sizeof(IndexLevel));
+    if (!levels)
+        return false;
+    levels[0] = (IndexLevel){.dir = tree->root, .prefix = ""};
+    size_t depth = 0;
+    char *path = NULL;
+    size_t path_cap = 0;
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < count; i++) {
+        const GitIndexEntry *entry = &entries[i];
+
+        // Leave the directories this path is not in, then enter (creating
+        // them) those it is in
+        while (depth > 0 &&
+               (entry->path_len <= levels[depth].prefix_len ||
+                memcmp(entry->path, levels[depth].prefix, levels[depth].prefix_len) != 0))
+            depth--;
+        const char *name = entry->path + levels[depth].prefix_len;
+        const char *slash;
+        while (ok && (slash = strchr(name, '/')) != NULL) {
+            IndexLevel *level = &levels[depth];
+            FsNode *dir = node_append(arena, level->dir, &level->tail, name,
+                                      (size_t)(slash - name), WALK_DIR, 0, 0);
+            if (depth + 2 > levels_cap) {
+                IndexLevel *grown = realloc(levels, levels_cap * 2 * sizeof(IndexLevel));
+                if (grown) {
+                    levels = grown;
+                    levels_cap *= 2;
+                }
+                else {
+                    dir = NULL;
+                }
+            }
+            ok = dir != NULL;
+            if (ok) {
+                size_t prefix_len = (size_t)(slash - entry->path) + 1;
+                levels[++depth] = (IndexLevel){dir, NULL, entry->path, prefix_len};
+                name = slash + 1;
+            }
+        }
+
+        size_t path_len = root_len + 1 + entry->path_len;
+        if (ok && path_len + 1 > path_cap) {
+            char *grown = realloc(path, path_len + 1);
+            ok = grown != NULL;
+            if (ok) {
+                path = grown;
+                path_cap = path_len + 1;
+            }
+        }
+        if (!ok)
+            break;
+        memcpy(path, tree->root->name, root_len);
+        path[root_len] = '/';
+        memcpy(path + root_len + 1, entry->path, entry->path_len + 1);
+
+        // Submodules (and symlinks to directories) are shown, not entered
+        WalkKind kind = entry->type == GIT_MODE_GITLINK ? WALK_DIR : WALK_FILE;
+        if (entry->type == GIT_MODE_SYMLINK && !walk_resolve_kind(AT_FDCWD, path, DT_LNK, &kind))
+            continue; // Dangling
+        uint16_t reports;
+        uint8_t flags = classify_entry(filter, NULL, name, kind, &reports);
+        struct stat st;
+        if ((flags & FS_NODE_ALLOWED) && (stat(path, &st) != 0 || !S_ISREG(st.st_mode)))
+            continue; // Deleted (or replaced) in the work tree
+
+        IndexLevel *level = &levels[depth];
+        FsNode *node = node_append(arena, level->dir, &level->tail, name,
+                                   entry->path_len - (size_t)(name - entry->path), kind, flags,
+                                   reports);
+        ok = node != NULL;
+        if (ok && (flags & FS_NODE_ALLOWED))
+            node_set_stat(node, &st);
+    }
+    free(path);
+    free(levels);
+    return ok;
+}
+
+FsTree *fs_tree_build_from_git_index(const char *root_path, const ReportSpec *reports,
+                                     int report_count, GitIndexStatus *status)
+{
+    GitIndex *index = git_index_load(root_path, status);
+    if (!index)
+        return NULL;
+    FsTree *tree = tree_create(root_path, 1);
+    TreeFilter filter = {.reports = reports, .report_count = report_count};
+    if (tree && !build_from_index(tree, &filter, index)) {
+        fs_tree_free(tree);
+        tree = NULL;
+    }
+    git_index_free(index);
+    return tree;
+}
+
+void fs_tree_free(FsTree *tree)
+{
+    if (!tree)
+        return;
+    for (int i = 0; tree->arenas && i < tree->arena_count; i++)
+        arena_destroy(tree->arenas[i]);
+    free(tree->arenas);
+    free(tree->added);
+    free(tree);
+}
+
+const FsNode *fs_tree_root(const FsTree *tree)
+{
+    return tree->root;
+}
+
+const FsNode *fs_node_next(const FsNode *node, bool descend)
+{
+    if (descend && node->children)
+        return node->children;
+    for (; node; node = node->parent)
+        if (node->next)
+            return node->next;
+    return NULL;
+}
+
+int fs_node_depth(const FsNode *node)
+{
+    int depth = -1;
+    for (const FsNode *up = node->parent; up; up = up->parent)
+        depth++;
+    return depth;
+}
+
+size_t fs_node_path(const FsNode *node, char **buf, size_t *cap)
+{
+    size_t len = node->name_len;
+    for (const FsNode *up = node->parent; up; up = up->parent)
+        len += up->name_len + 1;
+
+    if (len + 1 > *cap) {
+        char *grown = realloc(*buf, len + 1);
+        if (!grown)
+            return (size_t)-1;
+        *buf = grown;
+        *cap = len + 1;
+    }
+
+    // Fill from the end, one component per ancestor
+    char *out = *buf;
+    size_t pos = len;
+    out[pos] = '\0';
+    for (const FsNode *up = node; up; up = up->parent) {
+        pos -= up->name_len;
+        memcpy(out + pos, up->name, up->name_len);
+        if (up->parent)
+            out[--pos] = '/';
+    }
+    return len;
+}
+
+int fs_node_open(const FsNode *node, const char *path, int flags)
+{
+    int fd = open(path, flags | O_CLOEXEC | O_NOCTTY);
+    if (fd >= 0 || errno != ENAMETOOLONG)
+        return fd;
+
+    // Too long for one call: descend from the root one component at a time
+    size_t depth = 0;
+    for (const FsNode *up = node; up->parent; up = up->parent)
+        depth++;
+    if (depth == 0)
+        return -1;
+    const FsNode **chain = malloc(depth * sizeof(*chain));
+    if (!chain)
+        return -1;
+    const FsNode *root = node;
+    for (size_t i = depth; root->parent; root = root->parent)
+        chain[--i] = root;
+
+    int dir_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    fd = open(root->name, dir_flags);
+    for (size_t i = 0; i < depth && fd >= 0; i++) {
+        int next_flags = i + 1 == depth ? flags | O_CLOEXEC | O_NOCTTY : dir_flags;
+        int next = openat(fd, chain[i]->name, next_flags);
+        close(fd);
+        fd = next;
+    }
+    free(chain);
+    return fd;
+}
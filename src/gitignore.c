@@ -1,60 +1,583 @@
-#define _GNU_SOURCE // For strdup()
+#define _GNU_SOURCE // For getline() and openat()
 #include "gitignore.h"
+#include "arena.h"
+#include "gitrepo.h"
+#include "hash.h"
 
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define MAX_PATTERNS 512
-#define MAX_PATTERN_LEN 256
+#define TRIE_NONE UINT32_MAX // No trie node (the root is node 0)
+#define PATH_MAX_COMPONENTS 63 // State sets are 64-bit masks, bit n meaning "matched"
+#define STATE_BIT(i) ((uint64_t)1 << (i))
 
 /**
- * @brief Internal representation of gitignore rules.
+ * @brief Last-match-wins bookkeeping for the rules sharing one key: the
+ * highest rule index, over all of them and over those that also apply to
+ * files (not directory-only).
  */
-struct Gitignore {
-    char *patterns[MAX_PATTERNS];
-    bool is_negation[MAX_PATTERNS]; // true if the pattern is an exclusion (starts with !)
+typedef struct {
+    int last_any;  // -1 if none
+    int last_file; // -1 if none
+} RuleRank;
+
+/**
+ * @brief A literal key (exact name or suffix) in a LiteralSet.
+ */
+typedef struct {
+    const char *key; // NULL marks a free slot
+    size_t key_len;
+    uint64_t hash;
+    RuleRank rank;
+} LiteralSlot;
+
+/**
+ * @brief Open-addressing hash set of literal keys.
+ */
+typedef struct {
+    LiteralSlot *slots;
+    size_t cap; // Power of two (0 while empty)
+    size_t count;
+} LiteralSet;
+
+/**
+ * @brief A node of the prefix trie; children are chained through `sibling`.
+ */
+typedef struct {
+    uint32_t child;   // First child (TRIE_NONE if none)
+    uint32_t sibling; // Next child of the same parent (TRIE_NONE if none)
+    unsigned char c;
+    RuleRank rank; // Rules whose prefix ends here
+} TrieNode;
+
+/**
+ * @brief A glob with its literal ends, checked before calling fnmatch().
+ */
+typedef struct {
+    const char *text;
+    uint32_t len;
+    uint32_t head_len; // Literal characters before the first wildcard
+    uint32_t tail_len; // Literal characters after the last wildcard
+} Glob;
+
+/**
+ * @brief A slash-less pattern only a glob engine can evaluate.
+ */
+typedef struct {
+    Glob glob; // Trailing '/' removed
+    int index;
+    bool dir_only;
+} NameGlob;
+
+typedef enum {
+    COMP_LITERAL,
+    COMP_GLOB,
+    COMP_ANY_DIRS, // "**"
+} PathCompKind;
+
+/**
+ * @brief One '/'-separated component of an anchored pattern.
+ */
+typedef struct {
+    Glob glob; // Only the text is used by literals and "**"
+    PathCompKind kind;
+} PathComp;
+
+/**
+ * @brief A pattern anchored to the directory of its file, matched one path
+ * component at a time.
+ *
+ * Matching runs as a small NFA whose states are component positions. The
+ * states reached after a directory's path are kept with the directory, so
+ * each entry only advances them over its own name.
+ */
+typedef struct {
+    PathComp *comps;
+    int comp_count;
+    int index;
+    bool dir_only;
+} PathRule;
+
+/**
+ * @brief The compiled rules of one ignore file.
+ */
+typedef struct {
+    bool *negation; // Per rule index: true if the pattern started with '!'
     int count;
+    int cap;
+    // Slash-less patterns, matched against the entry name
+    LiteralSet names;    // Patterns without wildcards
+    LiteralSet suffixes; // "*<literal>"
+    size_t suffix_min;   // Shortest and longest suffix, to skip hopeless lookups
+    size_t suffix_max;
+    TrieNode *trie; // "<literal>*"
+    uint32_t trie_count;
+    uint32_t trie_cap;
+    NameGlob *globs; // Everything else, by ascending index
+    size_t glob_count;
+    size_t glob_cap;
+    // Patterns containing a '/', by ascending index
+    PathRule *paths;
+    size_t path_count;
+    size_t path_cap;
+    Arena *arena; // Holds the rules and everything above, released at once
+} IgnoreRules;
+
+/**
+ * @brief Internal representation of the repository-wide rules.
+ */
+struct Gitignore {
+    IgnoreRules *excludes[2]; // info/exclude, then core.excludesFile (by precedence)
+    size_t exclude_count;
 };
 
 /**
- * @brief Loads patterns from a single .gitignore file.
+ * @brief The NFA states an anchored rule has reached in a directory.
+ */
+typedef struct {
+    const PathRule *rule;
+    uint64_t states;
+    int lead; // First character any next component must start with, or -1
+} PathState;
+
+/**
+ * @brief One ignore file, as seen from a directory at or below its own.
+ */
+typedef struct {
+    const IgnoreRules *rules;
+    PathState *paths; // Anchored rules still alive here, highest index first
+    size_t path_count;
+} Frame;
+
+/**
+ * @brief Internal representation of the frames of one directory.
+ */
+struct GitignoreDir {
+    GitignoreDir *parent; // Owns the inherited rules (NULL if none are)
+    IgnoreRules *own;     // From this directory's .gitignore (NULL if none)
+    Frame *frames;        // Innermost first: the first frame with a match decides
+    size_t frame_count;
+    PathState *states; // Backing store of every frame's `paths`
+    unsigned refs;
+};
+
+static void rank_add(RuleRank *rank, int index, bool dir_only)
+{
+    rank->last_any = index; // Rules are added in ascending order
+    if (!dir_only)
+        rank->last_file = index;
+}
+
+static int rank_pick(const RuleRank *rank, bool is_dir)
+{
+    return is_dir ? rank->last_any : rank->last_file;
+}
+
+/**
+ * @brief Copies a glob into `arena` and finds its literal ends.
  *
- * @param gi The Gitignore struct to populate.
- * @param filepath Path to the .gitignore file.
+ * @return true on success, false on allocation failure.
  */
-static void load_patterns_from_file(Gitignore *gi, const char *filepath)
+static bool glob_init(Glob *glob, Arena *arena, const char *text, size_t len)
 {
-    FILE *file = fopen(filepath, "r");
-    if (!file)
-        return;
+    glob->text = arena_strndup(arena, text, len);
+    if (!glob->text)
+        return false;
+    glob->len = (uint32_t)len;
+    glob->head_len = (uint32_t)strcspn(glob->text, "*?[\\");
+    glob->tail_len = 0;
+    while (glob->tail_len < len - glob->head_len &&
+           !strchr("*?[]\\", text[len - 1 - glob->tail_len]))
+        glob->tail_len++;
+    return true;
+}
 
-    char line[MAX_PATTERN_LEN];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0; // Remove newline
+/**
+ * @brief Matches a name against a glob, rejecting on the literal ends first.
+ */
+static bool glob_match(const Glob *glob, const char *name, size_t name_len)
+{
+    if (name_len < glob->head_len + glob->tail_len ||
+        memcmp(name, glob->text, glob->head_len) != 0 ||
+        memcmp(name + name_len - glob->tail_len, glob->text + glob->len - glob->tail_len,
+               glob->tail_len) != 0)
+        return false;
+    return fnmatch(glob->text, name, 0) == 0;
+}
 
-        // Skip comments and empty lines
-        if (line[0] == '#' || line[0] == '\0')
-            continue;
+static LiteralSlot *literal_find(const LiteralSet *set, const char *key, size_t key_len)
+{
+    if (set->cap == 0)
+        return NULL;
+    uint64_t hash = hash_bytes(key, key_len);
+    size_t mask = set->cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        LiteralSlot *slot = &set->slots[i];
+        if (!slot->key)
+            return NULL;
+        if (slot->hash == hash && slot->key_len == key_len && memcmp(slot->key, key, key_len) == 0)
+            return slot;
+    }
+}
 
-        if (gi->count >= MAX_PATTERNS)
-            break; // Stop if we've read too many patterns
+/**
+ * @brief Finds or adds the slot of a key (copied into `arena`).
+ *
+ * @return The slot, or NULL on allocation failure.
+ */
+static LiteralSlot *literal_insert(LiteralSet *set, Arena *arena, const char *key,
+                                   size_t key_len)
+{
+    LiteralSlot *slot = literal_find(set, key, key_len);
+    if (slot)
+        return slot;
 
-        char *pattern = line;
-        if (pattern[0] == '!') {
-            gi->is_negation[gi->count] = true;
-            pattern++; // Skip the '!'
+    if ((set->count + 1) * 2 > set->cap) {
+        size_t new_cap = set->cap ? set->cap * 2 : 64;
+        LiteralSlot *slots = arena_alloc(arena, new_cap * sizeof(LiteralSlot));
+        if (!slots)
+            return NULL;
+        memset(slots, 0, new_cap * sizeof(LiteralSlot));
+        for (size_t i = 0; i < set->cap; i++) {
+            if (!set->slots[i].key)
+                continue;
+            size_t j = set->slots[i].hash & (new_cap - 1);
+            while (slots[j].key)
+                j = (j + 1) & (new_cap - 1);
+            slots[j] = set->slots[i];
         }
-        else {
-            gi->is_negation[gi->count] = false;
+        set->slots = slots;
+        set->cap = new_cap;
+    }
+
+    uint64_t hash = hash_bytes(key, key_len);
+    size_t i = hash & (set->cap - 1);
+    while (set->slots[i].key)
+        i = (i + 1) & (set->cap - 1);
+    slot = &set->slots[i];
+    slot->key = arena_strndup(arena, key, key_len);
+    if (!slot->key)
+        return NULL;
+    slot->key_len = key_len;
+    slot->hash = hash;
+    slot->rank = (RuleRank){-1, -1};
+    set->count++;
+    return slot;
+}
+
+/**
+ * @brief Returns the child of a trie node for a character.
+ *
+ * @return The child's index, or TRIE_NONE if there is none.
+ */
+static uint32_t trie_step(const IgnoreRules *rules, uint32_t node, unsigned char c)
+{
+    uint32_t child = rules->trie[node].child;
+    while (child != TRIE_NONE && rules->trie[child].c != c)
+        child = rules->trie[child].sibling;
+    return child;
+}
+
+/**
+ * @brief Appends a trie node (the root when the trie is empty).
+ *
+ * @return The node's index, or TRIE_NONE on allocation failure.
+ */
+static uint32_t trie_new_node(IgnoreRules *rules, unsigned char c)
+{
+    if (rules->trie_count == rules->trie_cap) {
+        uint32_t new_cap = rules->trie_cap ? rules->trie_cap * 2 : 64;
+        TrieNode *grown = arena_grow(rules->arena, rules->trie, rules->trie_cap * sizeof(TrieNode),
+                                     new_cap * sizeof(TrieNode));
+        if (!grown)
+            return TRIE_NONE;
+        rules->trie = grown;
+        rules->trie_cap = new_cap;
+    }
+    TrieNode *node = &rules->trie[rules->trie_count];
+    node->child = TRIE_NONE;
+    node->sibling = TRIE_NONE;
+    node->c = c;
+    node->rank = (RuleRank){-1, -1};
+    return rules->trie_count++;
+}
+
+/**
+ * @brief Adds a prefix to the trie.
+ *
+ * @return The node where it ends, or NULL on allocation failure.
+ */
+static TrieNode *trie_insert(IgnoreRules *rules, const char *prefix, size_t len)
+{
+    if (rules->trie_count == 0 && trie_new_node(rules, 0) == TRIE_NONE)
+        return NULL;
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)prefix[i];
+        uint32_t child = trie_step(rules, node, c);
+        if (child == TRIE_NONE) {
+            child = trie_new_node(rules, c);
+            if (child == TRIE_NONE)
+                return NULL;
+            rules->trie[child].sibling = rules->trie[node].child;
+            rules->trie[node].child = child;
         }
+        node = child;
+    }
+    return &rules->trie[node];
+}
 
-        gi->patterns[gi->count] = strdup(pattern);
-        gi->count++;
+/**
+ * @brief Adds a slash-less rule that needs the glob engine.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool name_glob_insert(IgnoreRules *rules, const char *pattern, size_t len, int index,
+                             bool dir_only)
+{
+    if (rules->glob_count == rules->glob_cap) {
+        size_t new_cap = rules->glob_cap ? rules->glob_cap * 2 : 16;
+        NameGlob *grown = arena_grow(rules->arena, rules->globs, rules->glob_cap * sizeof(NameGlob),
+                                     new_cap * sizeof(NameGlob));
+        if (!grown)
+            return false;
+        rules->globs = grown;
+        rules->glob_cap = new_cap;
     }
+    NameGlob *glob = &rules->globs[rules->glob_count];
+    if (!glob_init(&glob->glob, rules->arena, pattern, len))
+        return false;
+    glob->index = index;
+    glob->dir_only = dir_only;
+    rules->glob_count++;
+    return true;
+}
+
+/**
+ * @brief Adds an anchored rule, split into its components.
+ *
+ * @return true on success (or if the pattern has too many components to be
+ * tracked, in which case it is dropped), false on allocation failure.
+ */
+static bool path_rule_insert(IgnoreRules *rules, const char *pattern, size_t len, int index,
+                             bool dir_only)
+{
+    int comp_count = 1;
+    for (size_t i = 0; i < len; i++)
+        comp_count += pattern[i] == '/';
+    if (comp_count > PATH_MAX_COMPONENTS)
+        return true;
+
+    if (rules->path_count == rules->path_cap) {
+        size_t new_cap = rules->path_cap ? rules->path_cap * 2 : 16;
+        PathRule *grown = arena_grow(rules->arena, rules->paths, rules->path_cap * sizeof(PathRule),
+                                     new_cap * sizeof(PathRule));
+        if (!grown)
+            return false;
+        rules->paths = grown;
+        rules->path_cap = new_cap;
+    }
+    PathRule *rule = &rules->paths[rules->path_count];
+    rule->comps = arena_alloc(rules->arena, (size_t)comp_count * sizeof(PathComp));
+    if (!rule->comps)
+        return false;
+    rule->comp_count = comp_count;
+    rule->index = index;
+    rule->dir_only = dir_only;
+
+    const char *start = pattern;
+    const char *end = pattern + len;
+    for (int i = 0; i < comp_count; i++) {
+        const char *slash = memchr(start, '/', (size_t)(end - start));
+        size_t comp_len = (size_t)((slash ? slash : end) - start);
+        PathComp *comp = &rule->comps[i];
+        if (!glob_init(&comp->glob, rules->arena, start, comp_len))
+            return false;
+        if (comp_len == 2 && start[0] == '*' && start[1] == '*')
+            comp->kind = COMP_ANY_DIRS;
+        else if (comp->glob.head_len < comp_len)
+            comp->kind = COMP_GLOB;
+        else
+            comp->kind = COMP_LITERAL;
+        start += comp_len + 1;
+    }
+    rules->path_count++;
+    return true;
+}
+
+/**
+ * @brief Compiles one pattern into the matcher that fits its shape.
+ *
+ * @param rules The rules being built.
+ * @param pattern The pattern, without its '!' or trailing '/'.
+ * @param len The pattern's length.
+ * @param index The rule's position in the file.
+ * @param dir_only Whether the pattern had a trailing '/'.
+ * @return true on success, false on allocation failure.
+ */
+static bool compile_pattern(IgnoreRules *rules, const char *pattern, size_t len, int index,
+                            bool dir_only)
+{
+    // A leading "**/" matches in all directories, like no slash at all
+    while (len > 3 && memcmp(pattern, "**/", 3) == 0 && !memchr(pattern + 3, '/', len - 3)) {
+        pattern += 3;
+        len -= 3;
+    }
+    if (memchr(pattern, '/', len)) {
+        if (pattern[0] == '/') {
+            pattern++;
+            len--;
+        }
+        return path_rule_insert(rules, pattern, len, index, dir_only);
+    }
+
+    const char *meta = "*?[\\";
+    size_t literal = 0;
+    while (literal < len && !strchr(meta, pattern[literal]))
+        literal++;
+    if (literal == len) {
+        LiteralSlot *slot = literal_insert(&rules->names, rules->arena, pattern, len);
+        if (slot)
+            rank_add(&slot->rank, index, dir_only);
+        return slot != NULL;
+    }
+    size_t tail = 1;
+    while (tail < len && !strchr(meta, pattern[tail]))
+        tail++;
+    if (pattern[0] == '*' && tail == len) {
+        LiteralSlot *slot = literal_insert(&rules->suffixes, rules->arena, pattern + 1, len - 1);
+        if (!slot)
+            return false;
+        rank_add(&slot->rank, index, dir_only);
+        if (rules->suffixes.count == 1 || len - 1 < rules->suffix_min)
+            rules->suffix_min = len - 1;
+        if (len - 1 > rules->suffix_max)
+            rules->suffix_max = len - 1;
+        return true;
+    }
+    if (literal == len - 1 && pattern[literal] == '*') {
+        TrieNode *node = trie_insert(rules, pattern, literal);
+        if (node)
+            rank_add(&node->rank, index, dir_only);
+        return node != NULL;
+    }
+    return name_glob_insert(rules, pattern, len, index, dir_only);
+}
+
+/**
+ * @brief Parses one line of an ignore file.
+ *
+ * @return true on success (including blank lines and comments), false on
+ * allocation failure.
+ */
+static bool parse_line(IgnoreRules *rules, char *line, size_t len)
+{
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        len--;
+    if (len == 0 || line[0] == '#')
+        return true;
+    // Trailing spaces are dropped unless escaped with a backslash
+    while (len > 0 && line[len - 1] == ' ' && !(len > 1 && line[len - 2] == '\\'))
+        len--;
+
+    bool negation = line[0] == '!';
+    const char *pattern = line;
+    if (negation || (line[0] == '\\' && (line[1] == '!' || line[1] == '#'))) {
+        pattern++; // Skip the '!', or the backslash of an escaped leading '!' or '#'
+        len--;
+    }
+    bool dir_only = len > 0 && pattern[len - 1] == '/';
+    if (dir_only)
+        len--; // Matched without the trailing slash
+    if (len == 0)
+        return true;
+
+    if (rules->count == rules->cap) {
+        int new_cap = rules->cap ? rules->cap * 2 : 64;
+        bool *grown = arena_grow(rules->arena, rules->negation, (size_t)rules->cap * sizeof(bool),
+                                 (size_t)new_cap * sizeof(bool));
+        if (!grown)
+            return false;
+        rules->negation = grown;
+        rules->cap = new_cap;
+    }
+    if (!compile_pattern(rules, pattern, len, rules->count, dir_only))
+        return false;
+    rules->negation[rules->count++] = negation;
+    return true;
+}
+
+static void rules_free(IgnoreRules *rules)
+{
+    if (rules)
+        arena_destroy(rules->arena);
+}
+
+/**
+ * @brief Compiles every pattern of an ignore file. The file is closed.
+ *
+ * @return The rules, or NULL if the file has none (or on allocation
+ * failure, in which case the file is skipped as a whole).
+ */
+static IgnoreRules *rules_read(FILE *file)
+{
+    Arena *arena = arena_create();
+    IgnoreRules *rules = arena ? arena_alloc(arena, sizeof(IgnoreRules)) : NULL;
+    if (!rules) {
+        arena_destroy(arena);
+        fclose(file);
+        return NULL;
+    }
+    memset(rules, 0, sizeof(IgnoreRules));
+    rules->arena = arena;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    bool ok = true;
+    while (ok && (len = getline(&line, &line_cap, file)) >= 0)
+        ok = parse_line(rules, line, (size_t)len);
+    free(line);
     fclose(file);
+
+    if (!ok || rules->count == 0) {
+        rules_free(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+/**
+ * @brief Reads the ignore file at `path`, if there is one.
+ */
+static IgnoreRules *rules_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    return file ? rules_read(file) : NULL;
+}
+
+/**
+ * @brief Reads the .gitignore of a directory, if there is one.
+ */
+static IgnoreRules *rules_load_at(int dir_fd)
+{
+    if (dir_fd < 0)
+        return NULL;
+    int fd = openat(dir_fd, GITIGNORE_FILE, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0)
+        return NULL;
+    FILE *file = fdopen(fd, "r");
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+    return rules_read(file);
 }
 
 Gitignore *gitignore_load(const char *base_path)
@@ -63,12 +586,20 @@ Gitignore *gitignore_load(const char *base_path)
     if (!gi)
         return NULL;
 
-    char gitignore_path[1024];
-    snprintf(gitignore_path, sizeof(gitignore_path), "%s/.gitignore", base_path);
+    char *git_dir = git_dir_find(base_path);
+    if (!git_dir)
+        return gi; // Not a repository: .gitignore files only
 
-    load_patterns_from_file(gi, gitignore_path);
-    // Note: A full implementation would search parent directories.
-    // This implementation only loads .gitignore from the root.
+    char *path = git_path_join(git_dir, "info/exclude");
+    if (path && (gi->excludes[gi->exclude_count] = rules_load(path)))
+        gi->exclude_count++;
+    free(path);
+
+    path = git_excludes_file(git_dir);
+    if (path && (gi->excludes[gi->exclude_count] = rules_load(path)))
+        gi->exclude_count++;
+    free(path);
+    free(git_dir);
     return gi;
 }
 
@@ -76,41 +607,274 @@ void gitignore_free(Gitignore *gi)
 {
     if (!gi)
         return;
-    for (int i = 0; i < gi->count; i++)
-        free(gi->patterns[i]);
+    for (size_t i = 0; i < gi->exclude_count; i++)
+        rules_free(gi->excludes[i]);
     free(gi);
 }
 
-bool gitignore_matches_path(const Gitignore *gi, const char *path, bool is_dir)
+/**
+ * @brief Follows "**" positions that may match no directory at all (all
+ * but a trailing one, which must match something).
+ */
+static uint64_t path_rule_closure(const PathRule *rule, uint64_t states)
 {
-    if (!gi)
-        return false;
+    for (int i = 0; i + 1 < rule->comp_count; i++)
+        if ((states & STATE_BIT(i)) && rule->comps[i].kind == COMP_ANY_DIRS)
+            states |= STATE_BIT(i + 1);
+    return states;
+}
 
-    bool is_ignored = false;
-    const char *relative_path = path;
-
-    // Normalize path (remove leading ./)
-    if (strncmp(path, "./", 2) == 0)
-        relative_path += 2;
-
-    // Check all patterns in order
-    for (int i = 0; i < gi->count; i++) {
-        char pattern[MAX_PATTERN_LEN];
-        strncpy(pattern, gi->patterns[i], sizeof(pattern) - 1);
-        pattern[sizeof(pattern) - 1] = '\0';
-
-        // Handle directory-only patterns (e.g., "build/")
-        size_t len = strlen(pattern);
-        if (len > 0 && pattern[len - 1] == '/') {
-            if (!is_dir)
-                continue;            // This rule only applies to directories
-            pattern[len - 1] = '\0'; // Remove trailing slash for matching
-        }
+/**
+ * @brief Advances a rule's states over one path component.
+ *
+ * @return The new states; bit comp_count is set if the rule matched the
+ * whole path.
+ */
+static uint64_t path_rule_step(const PathRule *rule, uint64_t states, const char *name,
+                               size_t name_len)
+{
+    int last = rule->comp_count - 1;
+    uint64_t next = 0;
+    for (int i = 0; i <= last; i++) {
+        if (!(states & STATE_BIT(i)))
+            continue;
+        const PathComp *comp = &rule->comps[i];
+        if (comp->kind == COMP_ANY_DIRS)
+            next |= STATE_BIT(i) | (i == last ? STATE_BIT(i + 1) : 0);
+        else if (comp->kind == COMP_LITERAL
+                     ? comp->glob.len == name_len && memcmp(comp->glob.text, name, name_len) == 0
+                     : glob_match(&comp->glob, name, name_len))
+            next |= STATE_BIT(i + 1);
+    }
+    return path_rule_closure(rule, next);
+}
+
+/**
+ * @brief Finds the first character every component reachable from
+ * `states` requires, to skip most names without evaluating the rule.
+ *
+ * @return The character, or -1 if there is no such character.
+ */
+static int path_state_lead(const PathRule *rule, uint64_t states)
+{
+    int lead = -1;
+    for (int i = 0; i < rule->comp_count; i++) {
+        if (!(states & STATE_BIT(i)))
+            continue;
+        const PathComp *comp = &rule->comps[i];
+        if (comp->kind == COMP_ANY_DIRS || comp->glob.head_len == 0)
+            return -1;
+        int c = (unsigned char)comp->glob.text[0];
+        if (lead >= 0 && c != lead)
+            return -1;
+        lead = c;
+    }
+    return lead;
+}
+
+static PathState path_state(const PathRule *rule, uint64_t states)
+{
+    return (PathState){rule, states, path_state_lead(rule, states)};
+}
+
+/**
+ * @brief Whether a frame can still match anything below this point.
+ */
+static bool rules_match_names(const IgnoreRules *rules)
+{
+    return rules->names.count || rules->suffixes.count || rules->trie_count || rules->glob_count;
+}
+
+/**
+ * @brief Starts a frame at the directory of its file: every anchored rule
+ * is alive, at its first component.
+ */
+static void frame_start(Frame *frame, const IgnoreRules *rules, PathState **states)
+{
+    frame->rules = rules;
+    frame->paths = *states;
+    frame->path_count = 0;
+    for (size_t i = rules->path_count; i-- > 0;) {
+        const PathRule *rule = &rules->paths[i];
+        frame->paths[frame->path_count++] = path_state(rule, path_rule_closure(rule, STATE_BIT(0)));
+    }
+    *states += frame->path_count;
+}
 
-        // Use fnmatch to check for wildcard matches
-        if (fnmatch(pattern, relative_path, FNM_PATHNAME) == 0)
-            is_ignored = !gi->is_negation[i]; // Last match wins
+/**
+ * @brief Derives a subdirectory's frame from its parent's by advancing the
+ * anchored rules over the subdirectory's name.
+ *
+ * @return false if nothing in the frame can match below the subdirectory.
+ */
+static bool frame_descend(Frame *frame, const Frame *from, const char *name, size_t name_len,
+                          PathState **states)
+{
+    frame->rules = from->rules;
+    frame->paths = *states;
+    frame->path_count = 0;
+    for (size_t i = 0; i < from->path_count; i++) {
+        const PathRule *rule = from->paths[i].rule;
+        uint64_t next = path_rule_step(rule, from->paths[i].states, name, name_len);
+        if (next & (STATE_BIT(rule->comp_count) - 1)) // Matching the directory itself is done
+            frame->paths[frame->path_count++] = path_state(rule, next);
     }
+    *states += frame->path_count;
+    return frame->path_count > 0 || rules_match_names(frame->rules);
+}
+
+GitignoreDir *gitignore_dir_open(const Gitignore *gi, GitignoreDir *parent, int dir_fd,
+                                 const char *name)
+{
+    IgnoreRules *own = rules_load_at(dir_fd);
+
+    // Inherited frames: the parent's, or the repository-wide ones at the root
+    size_t frame_cap = own ? 1 : 0;
+    size_t state_cap = own ? own->path_count : 0;
+    if (name && parent) {
+        frame_cap += parent->frame_count;
+        for (size_t i = 0; i < parent->frame_count; i++)
+            state_cap += parent->frames[i].path_count;
+    }
+    else if (!name && gi) {
+        frame_cap += gi->exclude_count;
+        for (size_t i = 0; i < gi->exclude_count; i++)
+            state_cap += gi->excludes[i]->path_count;
+    }
+    if (frame_cap == 0)
+        return NULL;
+
+    GitignoreDir *dir = calloc(1, sizeof(GitignoreDir));
+    Frame *frames = dir ? malloc(frame_cap * sizeof(Frame)) : NULL;
+    PathState *states = frames ? malloc(state_cap * sizeof(PathState) + 1) : NULL;
+    if (!states) {
+        free(frames);
+        free(dir);
+        rules_free(own);
+        return NULL;
+    }
+    dir->own = own;
+    dir->frames = frames;
+    dir->states = states;
+    dir->refs = 1;
+
+    PathState *cursor = states;
+    if (own)
+        frame_start(&frames[dir->frame_count++], own, &cursor);
+    size_t inherited = 0;
+    if (name && parent) {
+        size_t name_len = strlen(name);
+        for (size_t i = 0; i < parent->frame_count; i++)
+            if (frame_descend(&frames[dir->frame_count], &parent->frames[i], name, name_len,
+                              &cursor)) {
+                dir->frame_count++;
+                inherited++;
+            }
+        if (inherited > 0)
+            dir->parent = gitignore_dir_ref(parent);
+    }
+    else if (!name && gi) {
+        for (size_t i = 0; i < gi->exclude_count; i++)
+            frame_start(&frames[dir->frame_count++], gi->excludes[i], &cursor);
+    }
+
+    if (dir->frame_count == 0) {
+        gitignore_dir_close(dir);
+        return NULL;
+    }
+    return dir;
+}
 
-    return is_ignored;
-}
\ No newline at end of file
+GitignoreDir *gitignore_dir_ref(GitignoreDir *dir)
+{
+    if (dir)
+        __atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+    return dir;
+}
+
+void gitignore_dir_close(GitignoreDir *dir)
+{
+    while (dir && __atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        GitignoreDir *parent = dir->parent;
+        rules_free(dir->own);
+        free(dir->frames);
+        free(dir->states);
+        free(dir);
+        dir = parent; // Release the reference this directory held
+    }
+}
+
+/**
+ * @brief Finds the last rule of a frame that matches an entry.
+ *
+ * @return The rule's index, or -1 if none matches.
+ */
+static int frame_match(const Frame *frame, const char *name, size_t name_len, bool is_dir)
+{
+    const IgnoreRules *rules = frame->rules;
+
+    // Highest index among the matching rules: the last match wins
+    int best = -1;
+    const LiteralSlot *slot = literal_find(&rules->names, name, name_len);
+    if (slot)
+        best = rank_pick(&slot->rank, is_dir);
+
+    // "*<suffix>"
+    for (size_t i = 0; rules->suffixes.count > 0 && i <= name_len; i++) {
+        if (name_len - i > rules->suffix_max)
+            continue;
+        if (name_len - i < rules->suffix_min)
+            break;
+        slot = literal_find(&rules->suffixes, name + i, name_len - i);
+        if (slot && rank_pick(&slot->rank, is_dir) > best)
+            best = rank_pick(&slot->rank, is_dir);
+    }
+
+    // "<prefix>*"
+    uint32_t node = rules->trie_count ? 0 : TRIE_NONE;
+    for (size_t i = 0; node != TRIE_NONE; i++) {
+        int rank = rank_pick(&rules->trie[node].rank, is_dir);
+        if (rank > best)
+            best = rank;
+        if (i == name_len)
+            break;
+        node = trie_step(rules, node, (unsigned char)name[i]);
+    }
+
+    // Globs and anchored rules, by descending index, until one can no
+    // longer beat `best`
+    for (size_t i = rules->glob_count; i-- > 0 && rules->globs[i].index > best;) {
+        const NameGlob *glob = &rules->globs[i];
+        if ((!glob->dir_only || is_dir) && glob_match(&glob->glob, name, name_len)) {
+            best = glob->index;
+            break;
+        }
+    }
+    for (size_t i = 0; i < frame->path_count && frame->paths[i].rule->index > best; i++) {
+        const PathState *state = &frame->paths[i];
+        const PathRule *rule = state->rule;
+        if (rule->dir_only && !is_dir)
+            continue;
+        if (state->lead >= 0 && (unsigned char)name[0] != state->lead)
+            continue;
+        uint64_t next = path_rule_step(rule, state->states, name, name_len);
+        if (next & STATE_BIT(rule->comp_count)) {
+            best = rule->index;
+            break;
+        }
+    }
+    return best;
+}
+
+bool gitignore_dir_matches(const GitignoreDir *dir, const char *name, bool is_dir)
+{
+    if (!dir)
+        return false;
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < dir->frame_count; i++) {
+        int best = frame_match(&dir->frames[i], name, name_len, is_dir);
+        if (best >= 0)
+            return !dir->frames[i].rules->negation[best];
+    }
+    return false;
+}
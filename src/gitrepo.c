@@ -0,0 +1,430 @@
+#define _GNU_SOURCE // For getline(), strndup() and realpath()
+#include "gitrepo.h"
+#include "arena.h"
+#include "walk.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_HEADER_SIZE 12
+#define INDEX_STAT_SIZE 40 // ctime, mtime, dev, ino, mode, uid, gid, size
+#define INDEX_FLAG_EXTENDED 0x4000
+#define INDEX_EXT_SKIP_WORKTREE 0x4000
+#define SHA1_SIZE 20
+#define SHA256_SIZE 32
+
+/**
+ * @brief Internal representation of a parsed index.
+ */
+struct GitIndex {
+    GitIndexEntry *entries;
+    size_t count;
+    size_t cap;
+    Arena *paths;
+};
+
+char *git_path_join(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (!path)
+        return NULL;
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+char *git_dir_find(const char *work_tree)
+{
+    char *dot_git = git_path_join(work_tree, ".git");
+    struct stat st;
+    if (!dot_git || stat(dot_git, &st) != 0) {
+        free(dot_git);
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode))
+        return dot_git;
+
+    FILE *file = S_ISREG(st.st_mode) ? fopen(dot_git, "r") : NULL;
+    free(dot_git);
+    if (!file)
+        return NULL;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len = getline(&line, &line_cap, file);
+    fclose(file);
+    char *git_dir = NULL;
+    if (len > 8 && strncmp(line, "gitdir: ", 8) == 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        git_dir = line[8] == '/' ? strdup(line + 8) : git_path_join(work_tree, line + 8);
+    }
+    free(line);
+    return git_dir;
+}
+
+char *git_config_get(const char *config_path, const char *section, const char *key)
+{
+    FILE *file = config_path ? fopen(config_path, "r") : NULL;
+    if (!file)
+        return NULL;
+
+    size_t section_len = strlen(section);
+    size_t key_len = strlen(key);
+    char *line = NULL;
+    size_t line_cap = 0;
+    bool in_section = false;
+    char *value = NULL;
+    while (getline(&line, &line_cap, file) >= 0) {
+        char *p = line + strspn(line, " \t");
+        if (*p == '[') {
+            p += 1 + strspn(p + 1, " \t");
+            in_section = strncasecmp(p, section, section_len) == 0 && p[section_len] != '\0' &&
+                         strchr("] \t", p[section_len]);
+            continue;
+        }
+        if (!in_section || strncasecmp(p, key, key_len) != 0)
+            continue;
+        p += key_len;
+        p += strspn(p, " \t");
+        if (*p != '=')
+            continue;
+        p += 1 + strspn(p + 1, " \t");
+        size_t len = strcspn(p, "\r\n");
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            len--;
+        if (len >= 2 && p[0] == '"' && p[len - 1] == '"') {
+            p++;
+            len -= 2;
+        }
+        free(value);
+        value = strndup(p, len);
+    }
+    free(line);
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief Expands a leading "~/" with $HOME.
+ *
+ * @return A newly allocated path (NULL on allocation failure). `path` is freed.
+ */
+static char *expand_home(char *path)
+{
+    const char *home = getenv("HOME");
+    if (!path || strncmp(path, "~/", 2) != 0 || !home)
+        return path;
+    char *expanded = git_path_join(home, path + 2);
+    free(path);
+    return expanded;
+}
+
+/**
+ * @brief Returns the path of $XDG_CONFIG_HOME/git/<name>, falling back to
+ * $HOME/.config/git/<name>.
+ *
+ * @return A newly allocated path, or NULL if neither variable is set.
+ */
+static char *xdg_git_path(const char *name)
+{
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    char *dir;
+    if (xdg && xdg[0])
+        dir = git_path_join(xdg, "git");
+    else if (home)
+        dir = git_path_join(home, ".config/git");
+    else
+        return NULL;
+    char *path = dir ? git_path_join(dir, name) : NULL;
+    free(dir);
+    return path;
+}
+
+char *git_excludes_file(const char *git_dir)
+{
+    char *config = git_path_join(git_dir, "config");
+    char *value = git_config_get(config, "core", "excludesFile");
+    free(config);
+
+    const char *home = getenv("HOME");
+    if (!value && home) {
+        config = git_path_join(home, ".gitconfig");
+        value = git_config_get(config, "core", "excludesFile");
+        free(config);
+    }
+    if (!value) {
+        config = xdg_git_path("config");
+        value = git_config_get(config, "core", "excludesFile");
+        free(config);
+    }
+    if (!value)
+        return xdg_git_path("ignore");
+    return expand_home(value);
+}
+
+static uint32_t read_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint16_t read_be16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+/**
+ * @brief Finds the top of the work tree containing a directory.
+ *
+ * @param real The directory's canonical path.
+ * @param top_len Receives the length of the work tree's path in `real`.
+ * @return The git directory (newly allocated), or NULL if there is none.
+ */
+static char *find_work_tree(char *real, size_t *top_len)
+{
+    size_t len = strlen(real);
+    for (;;) {
+        char saved = real[len];
+        real[len] = '\0';
+        char *git_dir = git_dir_find(real);
+        real[len] = saved;
+        if (git_dir) {
+            *top_len = len;
+            return git_dir;
+        }
+        if (len <= 1)
+            return NULL; // "/" was the last candidate
+        while (len > 1 && real[len - 1] != '/')
+            len--;
+        if (len > 1)
+            len--; // Drop the separator, unless it is the root itself
+    }
+}
+
+/**
+ * @brief Appends an entry, copying its path into the index's arena.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool index_append(GitIndex *index, const char *path, size_t path_len, uint32_t type)
+{
+    if (index->count == index->cap) {
+        size_t new_cap = index->cap ? index->cap * 2 : 1024;
+        GitIndexEntry *grown = realloc(index->entries, new_cap * sizeof(GitIndexEntry));
+        if (!grown)
+            return false;
+        index->entries = grown;
+        index->cap = new_cap;
+    }
+    char *copy = arena_strndup(index->paths, path, path_len);
+    if (!copy)
+        return false;
+    index->entries[index->count++] = (GitIndexEntry){copy, path_len, type};
+    return true;
+}
+
+/**
+ * @brief Parses the entries of an index file.
+ *
+ * @param index The index to fill.
+ * @param data The file contents.
+ * @param size The file size.
+ * @param hash_size The size of an object id (20 for SHA-1, 32 for SHA-256).
+ * @param prefix Only paths below this directory are kept ("" for all).
+ * @return GIT_INDEX_OK on success, otherwise why the file cannot be used.
+ */
+static GitIndexStatus index_parse(GitIndex *index, const unsigned char *data, size_t size,
+                        size_t hash_size, const char *prefix)
+{
+    if (size < INDEX_HEADER_SIZE + hash_size || memcmp(data, "DIRC", 4) != 0)
+        return GIT_INDEX_UNREADABLE;
+    uint32_t version = read_be32(data + 4);
+    uint32_t count = read_be32(data + 8);
+    if (version < 2 || version > 4)
+        return GIT_INDEX_UNREADABLE;
+
+    size_t prefix_len = strlen(prefix);
+    const unsigned char *p = data + INDEX_HEADER_SIZE;
+    const unsigned char *end = data + size - hash_size; // Trailing checksum
+    char *path = NULL; // Version 4 paths are stored relative to the previous one
+    size_t path_len = 0;
+    size_t path_cap = 0;
+    bool ok = true;
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        size_t fixed = INDEX_STAT_SIZE + hash_size + 2;
+        if ((size_t)(end - p) < fixed + 2) {
+            ok = false;
+            break;
+        }
+        uint32_t mode = read_be32(p + 24);
+        uint16_t flags = read_be16(p + INDEX_STAT_SIZE + hash_size);
+        uint16_t extended = 0;
+        if (flags & INDEX_FLAG_EXTENDED) {
+            if (version < 3) {
+                ok = false;
+                break;
+            }
+            extended = read_be16(p + fixed);
+            fixed += 2;
+        }
+        const unsigned char *name = p + fixed;
+        const char *entry_path;
+        size_t entry_len;
+
+        if (version == 4) {
+            // Varint: bytes to strip from the previous path, then the suffix
+            size_t strip = 0;
+            unsigned char c;
+            do {
+                if (name >= end) {
+                    ok = false;
+                    break;
+                }
+                c = *name++;
+                strip = (strip << 7) | (c & 0x7F);
+                if (c & 0x80)
+                    strip++; // Offset encoding: each continuation adds one
+            } while (ok && (c & 0x80));
+            const unsigned char *nul = ok ? memchr(name, '\0', (size_t)(end - name)) : NULL;
+            if (!nul || strip > path_len) {
+                ok = false;
+                break;
+            }
+            size_t suffix_len = (size_t)(nul - name);
+            path_len -= strip;
+            if (path_len + suffix_len + 1 > path_cap) {
+                size_t new_cap = (path_len + suffix_len + 1) * 2;
+                char *grown = realloc(path, new_cap);
+                if (!grown) {
+                    ok = false;
+                    break;
+                }
+                path = grown;
+                path_cap = new_cap;
+            }
+            memcpy(path + path_len, name, suffix_len + 1);
+            path_len += suffix_len;
+            entry_path = path;
+            entry_len = path_len;
+            p = nul + 1;
+        }
+        else {
+            // The NUL is authoritative: the length in the flags stops at 4095
+            const unsigned char *nul = memchr(name, '\0', (size_t)(end - name));
+            if (!nul) {
+                ok = false;
+                break;
+            }
+            entry_path = (const char *)name;
+            entry_len = (size_t)(nul - name);
+            size_t padded = (fixed + entry_len + 8) & ~(size_t)7; // 1 to 8 NULs
+            if ((size_t)(end - p) < padded) {
+                ok = false;
+                break;
+            }
+            p += padded;
+        }
+        uint32_t type = mode & GIT_MODE_TYPE;
+        if (extended & INDEX_EXT_SKIP_WORKTREE)
+            continue; // Not checked out (sparse checkout)
+        if (type != GIT_MODE_FILE && type != GIT_MODE_SYMLINK && type != GIT_MODE_GITLINK)
+            continue; // Sparse directory entries
+        if (prefix_len > 0 && (entry_len <= prefix_len || entry_path[prefix_len] != '/' ||
+                               memcmp(entry_path, prefix, prefix_len) != 0))
+            continue;
+
+        size_t skip = prefix_len ? prefix_len + 1 : 0;
+        entry_path += skip;
+        entry_len -= skip;
+
+        // Conflicted paths have one entry per stage, next to each other
+        if (index->count > 0) {
+            const GitIndexEntry *last = &index->entries[index->count - 1];
+            if (last->path_len == entry_len && memcmp(last->path, entry_path, entry_len) == 0)
+                continue;
+        }
+        ok = index_append(index, entry_path, entry_len, type);
+    }
+    free(path);
+    if (!ok)
+        return GIT_INDEX_UNREADABLE;
+
+    // Extensions: a split index keeps most entries in another file
+    while ((size_t)(end - p) >= 8) {
+        uint32_t ext_size = read_be32(p + 4);
+        if (memcmp(p, "link", 4) == 0)
+            return GIT_INDEX_SPLIT;
+        if ((size_t)(end - p) - 8 < ext_size)
+            break;
+        p += 8 + ext_size;
+    }
+    return GIT_INDEX_OK;
+}
+
+GitIndex *git_index_load(const char *dir, GitIndexStatus *status)
+{
+    *status = GIT_INDEX_UNREADABLE;
+    char *real = realpath(dir, NULL);
+    size_t top_len = 0;
+    char *git_dir = real ? find_work_tree(real, &top_len) : NULL;
+    if (!git_dir) {
+        free(real);
+        return NULL;
+    }
+    // The directory's path inside the work tree ("" at the top)
+    const char *prefix = real + top_len;
+    if (*prefix == '/')
+        prefix++;
+
+    char *config = git_path_join(git_dir, "config");
+    char *format = git_config_get(config, "extensions", "objectFormat");
+    size_t hash_size = format && strcasecmp(format, "sha256") == 0 ? SHA256_SIZE : SHA1_SIZE;
+    free(format);
+    free(config);
+
+    char *index_path = git_path_join(git_dir, "index");
+    int fd = index_path ? open(index_path, O_RDONLY | O_CLOEXEC) : -1;
+    size_t size = 0;
+    unsigned char *data = fd >= 0 ? (unsigned char *)walk_read_fd(fd, &size) : NULL;
+    if (fd >= 0)
+        close(fd);
+    free(index_path);
+    free(git_dir);
+
+    GitIndex *index = data ? calloc(1, sizeof(GitIndex)) : NULL;
+    if (index)
+        index->paths = arena_create();
+    if (index && index->paths)
+        *status = index_parse(index, data, size, hash_size, prefix);
+    if (index && *status != GIT_INDEX_OK) {
+        git_index_free(index);
+        index = NULL;
+    }
+    free(data);
+    free(real);
+    return index;
+}
+
+const GitIndexEntry *git_index_entries(const GitIndex *index, size_t *count)
+{
+    *count = index->count;
+    return index->entries;
+}
+
+void git_index_free(GitIndex *index)
+{
+    if (!index)
+        return;
+    free(index->entries);
+    arena_destroy(index->paths);
+    free(index);
+}
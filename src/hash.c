@@ -0,0 +1,165 @@
+#include "hash.h"
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads (memcpy compiles to a single move)
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Mixes one 8-byte lane into an accumulator.
+ */
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+/**
+ * @brief Folds a lane accumulator into the final hash.
+ */
+static uint64_t xxh64_merge(uint64_t hash, uint64_t acc)
+{
+    hash ^= xxh64_round(0, acc);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @brief Mixes the last bytes (under 32) into the hash and avalanches it.
+ */
+static uint64_t xxh64_finish(uint64_t hash, const unsigned char *p, const unsigned char *end)
+{
+    for (; p + 8 <= end; p += 8) {
+        hash ^= xxh64_round(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        hash ^= (uint64_t)read32(p) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash ? hash : 1;
+}
+
+/**
+ * @brief Combines the four lane accumulators.
+ */
+static uint64_t xxh64_lanes(const uint64_t v[4])
+{
+    uint64_t hash = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+    for (int i = 0; i < 4; i++)
+        hash = xxh64_merge(hash, v[i]);
+    return hash;
+}
+
+uint64_t hash_bytes(const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        // Four independent lanes over 32-byte stripes
+        uint64_t v1 = PRIME64_1 + PRIME64_2;
+        uint64_t v2 = PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = xxh64_lanes((const uint64_t[4]){v1, v2, v3, v4});
+    }
+    else {
+        hash = PRIME64_5;
+    }
+    return xxh64_finish(hash + (uint64_t)length, p, end);
+}
+
+/**
+ * @brief Folds one 32-byte stripe into the lanes.
+ */
+static void hash_stripe(HashState *state, const unsigned char *p)
+{
+    for (int i = 0; i < 4; i++)
+        state->lanes[i] = xxh64_round(state->lanes[i], read64(p + 8 * i));
+}
+
+void hash_init(HashState *state)
+{
+    state->lanes[0] = PRIME64_1 + PRIME64_2;
+    state->lanes[1] = PRIME64_2;
+    state->lanes[2] = 0;
+    state->lanes[3] = -PRIME64_1;
+    state->length = 0;
+    state->pending_len = 0;
+}
+
+void hash_update(HashState *state, const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + length;
+    state->length += (uint64_t)length;
+
+    if (state->pending_len > 0) {
+        size_t take = sizeof(state->pending) - state->pending_len;
+        if (take > length)
+            take = length;
+        memcpy(state->pending + state->pending_len, p, take);
+        state->pending_len += take;
+        p += take;
+        if (state->pending_len < sizeof(state->pending))
+            return;
+        hash_stripe(state, state->pending);
+        state->pending_len = 0;
+    }
+    for (; end - p >= 32; p += 32)
+        hash_stripe(state, p);
+    memcpy(state->pending, p, (size_t)(end - p));
+    state->pending_len = (size_t)(end - p);
+}
+
+uint64_t hash_final(const HashState *state)
+{
+    uint64_t hash = state->length >= 32 ? xxh64_lanes(state->lanes) : PRIME64_5;
+    return xxh64_finish(hash + state->length, state->pending,
+                        state->pending + state->pending_len);
+}
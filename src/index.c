@@ -0,0 +1,200 @@
+#define _GNU_SOURCE // For strdup()
+#include "index.h"
+#include "manifest.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Internal representation of an index being written.
+ */
+struct ReportIndex {
+    FILE *file;
+    char *path;      // The index file
+    char *temp_path; // Where it is written until closed
+    uint64_t count;  // Files listed
+};
+
+ReportIndex *report_index_open(const char *path)
+{
+    ReportIndex *index = calloc(1, sizeof(ReportIndex));
+    size_t path_len = strlen(path);
+    char *temp = index ? malloc(path_len + sizeof(REPORT_TEMP_SUFFIX)) : NULL;
+    if (!temp) {
+        free(index);
+        return NULL;
+    }
+    memcpy(temp, path, path_len);
+    memcpy(temp + path_len, REPORT_TEMP_SUFFIX, sizeof(REPORT_TEMP_SUFFIX));
+
+    index->path = strdup(path);
+    index->temp_path = temp;
+    index->file = index->path ? fopen(temp, "w") : NULL;
+    if (!index->file) {
+        free(index->path);
+        free(temp);
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * @brief Measures the UTF-8 sequence starting with a byte of 0x80 or above.
+ *
+ * @return Its length (2 to 4), or 0 if it is invalid or truncated.
+ */
+static size_t utf8_sequence_length(const unsigned char *p)
+{
+    size_t need;
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xBF;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+        need = 1;
+    }
+    else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        need = 2;
+        if (p[0] == 0xE0)
+            lo = 0xA0; // Overlong
+        else if (p[0] == 0xED)
+            hi = 0x9F; // Surrogates
+    }
+    else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        need = 3;
+        if (p[0] == 0xF0)
+            lo = 0x90; // Overlong
+        else if (p[0] == 0xF4)
+            hi = 0x8F; // Above U+10FFFF
+    }
+    else {
+        return 0;
+    }
+    for (size_t i = 1; i <= need; i++, lo = 0x80, hi = 0xBF)
+        if (p[i] < lo || p[i] > hi)
+            return 0; // Also stops at the terminating NUL
+    return need + 1;
+}
+
+/**
+ * @brief Writes a JSON string, escaping quotes, backslashes and control
+ * characters. Bytes that are not part of valid UTF-8 (file names need not
+ * be) are replaced by U+FFFD.
+ *
+ * @return true if the string was valid UTF-8, false if it was altered.
+ */
+static bool write_json_string(FILE *file, const char *str)
+{
+    bool valid = true;
+    putc('"', file);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putc('\\', file);
+            putc(*p, file);
+        }
+        else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        }
+        else if (*p < 0x80) {
+            putc(*p, file);
+        }
+        else {
+            size_t len = utf8_sequence_length(p);
+            if (len == 0) {
+                fputs("\\ufffd", file);
+                valid = false;
+                continue;
+            }
+            fwrite(p, 1, len, file);
+            p += len - 1;
+        }
+    }
+    putc('"', file);
+    return valid;
+}
+
+/**
+ * @brief Writes the bytes of a string in base64 (RFC 4648, padded), as a
+ * JSON string.
+ */
+static void write_json_base64(FILE *file, const char *str)
+{
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *p = (const unsigned char *)str;
+    size_t len = strlen(str);
+    putc('"', file);
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t group = (uint32_t)p[i] << 16;
+        if (i + 1 < len)
+            group |= (uint32_t)p[i + 1] << 8;
+        if (i + 2 < len)
+            group |= p[i + 2];
+        putc(digits[group >> 18], file);
+        putc(digits[(group >> 12) & 63], file);
+        putc(i + 1 < len ? digits[(group >> 6) & 63] : '=', file);
+        putc(i + 2 < len ? digits[group & 63] : '=', file);
+    }
+    putc('"', file);
+}
+
+/**
+ * @brief Writes a path member, `"key":"..."`. A path that is not valid
+ * UTF-8 also gets a `"<key>_base64"` member holding its exact bytes.
+ */
+static void write_json_path(FILE *file, const char *key, const char *path)
+{
+    fprintf(file, "\"%s\":", key);
+    if (write_json_string(file, path))
+        return;
+    fprintf(file, ",\"%s_base64\":", key);
+    write_json_base64(file, path);
+}
+
+void report_index_add(ReportIndex *index, const IndexEntry *entry)
+{
+    if (!index)
+        return;
+    FILE *file = index->file;
+    putc('{', file);
+    write_json_path(file, "path", entry->path);
+    fputs(",\"tag\":", file);
+    write_json_string(file, entry->tag);
+    if (entry->duplicate_of) {
+        putc(',', file);
+        write_json_path(file, "duplicate_of", entry->duplicate_of);
+    }
+    else {
+        fprintf(file, ",\"offset\":%" PRIu64 ",\"length\":%" PRIu64, entry->offset,
+                entry->length);
+        if (entry->lines != INDEX_LINES_UNKNOWN)
+            fprintf(file, ",\"lines\":%" PRIu64, entry->lines);
+    }
+    if (entry->hash)
+        fprintf(file, ",\"hash\":\"%016" PRIx64 "\"", entry->hash);
+    fputs("}\n", file);
+    index->count++;
+}
+
+bool report_index_close(ReportIndex *index, const char *report, uint64_t report_size,
+                        bool complete)
+{
+    if (!index)
+        return true;
+    const char *base = strrchr(report, '/');
+    fprintf(index->file, "{\"format\":\"" INDEX_FORMAT "\",\"version\":%d,", INDEX_VERSION);
+    write_json_path(index->file, "report", base ? base + 1 : report);
+    fprintf(index->file, ",\"size\":%" PRIu64 ",\"files\":%" PRIu64 "}\n", report_size,
+            index->count);
+
+    bool ok = !ferror(index->file);
+    ok = fclose(index->file) == 0 && ok && complete && rename(index->temp_path, index->path) == 0;
+    if (!ok)
+        remove(index->temp_path);
+    free(index->temp_path);
+    free(index->path);
+    free(index);
+    return ok || !complete;
+}
@@ -1,20 +1,28 @@
-#define _GNU_SOURCE // For strdup()
+#define _GNU_SOURCE // For getline()
 #include "iniparser.h"
+#include "arena.h"
 #include <ctype.h> // Added for isspace()
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_ENTRIES 512
-#define MAX_LINE_LEN 1024
+/**
+ * @brief One "Section:key" = value pair, in file order.
+ */
+typedef struct IniEntry {
+    const char *key; // Stored as "Section:key"
+    const char *val;
+    struct IniEntry *next;
+} IniEntry;
 
 /**
  * @brief Internal dictionary structure to hold .ini file entries.
  */
 struct dictionary {
-    char *key[MAX_ENTRIES]; // Stores keys as "Section:key"
-    char *val[MAX_ENTRIES]; // Stores values
-    int count;              // Number of entries
+    Arena *arena; // Holds the dictionary, its entries and their strings
+    IniEntry *first;
+    IniEntry *last;
 };
 
 /**
@@ -71,6 +79,35 @@ static void skip_utf8_bom(FILE *file)
     }
 }
 
+/**
+ * @brief Appends a "Section:key" = value pair to the dictionary.
+ *
+ * @return true on success, false if out of memory.
+ */
+static bool add_entry(dictionary *d, const char *section, const char *key, const char *val)
+{
+    size_t section_len = strlen(section);
+    size_t key_len = strlen(key);
+    IniEntry *entry = arena_alloc(d->arena, sizeof(IniEntry));
+    char *full_key = entry ? arena_alloc(d->arena, section_len + key_len + 2) : NULL;
+    char *copy = full_key ? arena_strndup(d->arena, val, strlen(val)) : NULL;
+    if (!copy)
+        return false;
+
+    memcpy(full_key, section, section_len);
+    full_key[section_len] = ':';
+    memcpy(full_key + section_len + 1, key, key_len + 1);
+    entry->key = full_key;
+    entry->val = copy;
+    entry->next = NULL;
+    if (d->last)
+        d->last->next = entry;
+    else
+        d->first = entry;
+    d->last = entry;
+    return true;
+}
+
 dictionary *iniparser_load(const char *filename)
 {
     FILE *file = fopen(filename, "r");
@@ -80,16 +117,23 @@ dictionary *iniparser_load(const char *filename)
     // Handle potential UTF-8 BOM, which can break parsing
     skip_utf8_bom(file);
 
-    dictionary *d = calloc(1, sizeof(dictionary));
+    Arena *arena = arena_create();
+    dictionary *d = arena ? arena_alloc(arena, sizeof(dictionary)) : NULL;
     if (!d) {
+        arena_destroy(arena);
         fclose(file);
         return NULL;
     }
+    d->arena = arena;
+    d->first = NULL;
+    d->last = NULL;
 
-    char line_buffer[MAX_LINE_LEN];
-    char section[MAX_LINE_LEN] = "";
+    char *line_buffer = NULL;
+    size_t line_cap = 0;
+    const char *section = "";
+    bool ok = true;
 
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
+    while (ok && getline(&line_buffer, &line_cap, file) >= 0) {
         line_buffer[strcspn(line_buffer, "\r\n")] = 0; // Remove newline
         char *line = line_buffer;
 
@@ -99,10 +143,12 @@ dictionary *iniparser_load(const char *filename)
             continue;
 
         // Section line: [SectionName]
-        if (line[0] == '[' && line[strlen(line) - 1] == ']') {
-            strncpy(section, line + 1, strlen(line) - 2);
-            section[strlen(line) - 2] = '\0';
-            trim_whitespace(section); // Trim whitespace from section name
+        size_t len = strlen(line);
+        if (line[0] == '[' && line[len - 1] == ']') {
+            line[len - 1] = '\0';
+            char *name = trim_whitespace(line + 1); // Trim whitespace from section name
+            section = arena_strndup(arena, name, strlen(name));
+            ok = section != NULL;
             continue;
         }
 
@@ -110,49 +156,32 @@ dictionary *iniparser_load(const char *filename)
         char *eq = strchr(line, '=');
         if (eq) {
             *eq = '\0';
-            char *key = trim_whitespace(line);
-            char *val = trim_whitespace(eq + 1);
-
-            if (d->count < MAX_ENTRIES) {
-                char full_key[MAX_LINE_LEN];
-
-                // Safely construct the full key: "Section:Key"
-                strncpy(full_key, section, sizeof(full_key) - 1);
-                full_key[sizeof(full_key) - 1] = '\0';
-
-                strncat(full_key, ":", sizeof(full_key) - strlen(full_key) - 1);
-                strncat(full_key, key, sizeof(full_key) - strlen(full_key) - 1);
-
-                d->key[d->count] = strdup(full_key);
-                d->val[d->count] = strdup(val);
-                d->count++;
-            }
+            ok = add_entry(d, section, trim_whitespace(line), trim_whitespace(eq + 1));
         }
     }
+    free(line_buffer);
     fclose(file);
+    if (!ok) {
+        iniparser_freedict(d);
+        return NULL;
+    }
     return d;
 }
 
 void iniparser_freedict(dictionary *d)
 {
-    if (!d)
-        return;
-    // Free all duplicated key and value strings
-    for (int i = 0; i < d->count; i++) {
-        free(d->key[i]);
-        free(d->val[i]);
-    }
-    // Free the dictionary itself
-    free(d);
+    // The dictionary lives in its own arena
+    if (d)
+        arena_destroy(d->arena);
 }
 
 const char *iniparser_getstring(dictionary *d, const char *key, const char *def)
 {
     if (!d || !key)
         return def;
-    for (int i = 0; i < d->count; i++) {
-        if (strcmp(d->key[i], key) == 0) {
-            return d->val[i];
+    for (const IniEntry *entry = d->first; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            return entry->val;
         }
     }
     return def;
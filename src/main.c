@@ -1,8 +1,37 @@
+#define _GNU_SOURCE // For getopt_long()
 #include "config.h"
+#include "detect.h"
 #include "filesystem.h"
+#include "fstree.h"
+#include "index.h"
+#include "manifest.h"
 #include "markdown.h"
+#include "reader.h"
+#include "uring.h"
+#include "watch.h"
+#include "workpool.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_JOBS 256
+
+enum {
+    OPT_NO_DEDUP = 256, // Long-only options, past every short option character
+    OPT_FROM_GIT_INDEX,
+    OPT_STATS,
+    OPT_WRITE_BUFFER,
+    OPT_SYNC,
+    OPT_COMPRESS,
+    OPT_INDEX,
+};
 
 /**
  * @brief Prints the command-line usage instructions.
@@ -10,53 +39,978 @@
  */
 void print_usage(const char *prog_name)
 {
-    fprintf(stderr, "Usage: %s <language_profile> [target_directory] [output_file]\n", prog_name);
+    fprintf(stderr,
+            "Usage: %s [options] <language_profile>[,...] [target_directory] [output_file]\n"
+            "\n"
+            "Several profiles (e.g. c,python) share one scan and read of the project and\n"
+            "write one report each, named after the profile (output.c.md, ...).\n"
+            "\"auto\" picks the profiles from a quick sample of the project's files.\n"
+            "An output_file of \"-\" streams the report to stdout.\n"
+            "\n"
+            "Options:\n"
+            "  -j, --jobs N        Scan and read files with N threads (0 = one per CPU)\n"
+            "  -i, --incremental   Reuse code blocks of unchanged files from the last\n"
+            "                      report (tracked in <output_file>" MANIFEST_SUFFIX ")\n"
+            "  -w, --watch         Keep the report up to date as files change\n"
+            "  -u, --io-uring[=N]  Read files with io_uring, N requests deep (default %d)\n"
+            "      --no-dedup      Write every copy of identical files in full\n"
+            "  -s, --shard-size N  Split the report into files of about N bytes\n"
+            "                      (e.g. 4M), written in parallel\n"
+            "      --from-git-index\n"
+            "                      List the files tracked in .git/index instead of\n"
+            "                      walking the directories\n"
+            "      --write-buffer N\n"
+            "                      Buffer N bytes of report output (default 1M)\n"
+            "      --sync          Flush reports to disk (fdatasync) before exiting\n"
+            "      --compress gzip|zstd\n"
+            "                      Compress reports while writing them (adds .gz or\n"
+            "                      .zst to the output file name)\n"
+            "      --index         Also write <output_file>" INDEX_SUFFIX ", listing where\n"
+            "                      each file's contents lie in the report\n"
+            "      --stats         Print peak memory, buffer reuse and file counts on exit\n"
+            "  -h, --help          Show this help\n",
+            prog_name, URING_DEFAULT_DEPTH);
 }
 
 /**
- * @brief Main entry point for the source-map utility.
+ * @brief Parses the value of --jobs.
+ *
+ * @param arg The option argument.
+ * @param jobs Receives the number of worker threads.
+ * @return 0 on success, -1 if the value is invalid.
  */
-int main(int argc, char *argv[])
+static int parse_jobs(const char *arg, int *jobs)
 {
-    // --- Argument Parsing ---
-    if (argc < 2) {
-        print_usage(argv[0]);
-        return 1;
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < 0 || value > MAX_JOBS)
+        return -1;
+
+    if (value == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        value = (cpus > 0) ? (cpus < MAX_JOBS ? cpus : MAX_JOBS) : 1;
+    }
+    *jobs = (int)value;
+    return 0;
+}
+
+/**
+ * @brief Parses the optional value of --io-uring.
+ *
+ * @param arg The option argument, or NULL for the default depth.
+ * @param depth Receives the queue depth.
+ * @return 0 on success, -1 if the value is invalid.
+ */
+static int parse_uring_depth(const char *arg, unsigned *depth)
+{
+    if (!arg) {
+        *depth = URING_DEFAULT_DEPTH;
+        return 0;
     }
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < URING_MIN_DEPTH || value > URING_MAX_DEPTH)
+        return -1;
+    *depth = (unsigned)value;
+    return 0;
+}
 
-    const char *language = argv[1];
-    const char *target_dir = (argc > 2) ? argv[2] : ".";
-    const char *output_file = (argc > 3) ? argv[3] : "output.md";
+/**
+ * @brief Prints the peak resident set size, the file buffer pool's
+ * counters and what the content scans found (for --stats).
+ */
+static void print_stats(const ReaderPoolStats *pool)
+{
+    struct rusage usage;
+    long peak_kib = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    ContentStats content;
+    get_content_stats(&content);
+    fprintf(stderr, "Peak RSS: %ld KiB\n", peak_kib);
+    fprintf(stderr, "File buffers: %zu allocated, %zu reused\n", pool->allocated, pool->reused);
+    fprintf(stderr,
+            "File bodies: %" PRIu64 " written (%" PRIu64 " lines, %" PRIu64
+            " not UTF-8), %" PRIu64 " binary skipped\n",
+            content.files, content.lines, content.not_utf8, content.binary);
+}
 
-    // --- Profile Loading ---
-    LanguageProfile *profile = load_language_profile(language);
-    if (!profile) {
-        return 1; // Error message already printed by load_language_profile
+/**
+ * @brief Parses the value of --write-buffer.
+ *
+ * @param arg The option argument (e.g., "4M").
+ * @param size Receives the buffer size in bytes.
+ * @return 0 on success, -1 if the value is invalid or out of range.
+ */
+static int parse_write_buffer(const char *arg, size_t *size)
+{
+    uint64_t value;
+    if (!reader_parse_size(arg, &value) || value < MD_BUFFER_MIN || value > MD_BUFFER_MAX)
+        return -1;
+    *size = (size_t)value;
+    return 0;
+}
+
+/**
+ * @brief Parses the value of --compress.
+ *
+ * @param arg The option argument ("gzip" or "zstd").
+ * @param compress Receives the compressor.
+ * @return 0 on success, -1 if the compressor is unknown.
+ */
+static int parse_compress(const char *arg, MdCompression *compress)
+{
+    if (strcmp(arg, "gzip") == 0)
+        *compress = MD_COMPRESS_GZIP;
+    else if (strcmp(arg, "zstd") == 0)
+        *compress = MD_COMPRESS_ZSTD;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief The files of an incremental run.
+ */
+typedef struct {
+    FragmentCache cache;
+    char *manifest_path;
+    char *temp_path; // The new report, renamed over the old one when complete
+} IncrementalRun;
+
+/**
+ * @brief Appends a suffix to a path.
+ *
+ * @return A newly allocated string, or NULL on failure.
+ */
+static char *path_with_suffix(const char *path, const char *suffix)
+{
+    size_t path_len = strlen(path);
+    size_t suffix_len = strlen(suffix);
+    char *joined = malloc(path_len + suffix_len + 1);
+    if (!joined)
+        return NULL;
+    memcpy(joined, path, path_len);
+    memcpy(joined + path_len, suffix, suffix_len + 1);
+    return joined;
+}
+
+/**
+ * @brief Names a compressed report after the output file, adding the
+ * compressor's suffix unless the name already ends with it.
+ *
+ * @return The name (to be freed), or NULL if out of memory.
+ */
+static char *compressed_path(const char *output_file, MdCompression compress)
+{
+    const char *suffix = compress == MD_COMPRESS_GZIP ? MD_GZIP_SUFFIX : MD_ZSTD_SUFFIX;
+    size_t path_len = strlen(output_file);
+    size_t suffix_len = strlen(suffix);
+    if (path_len > suffix_len && strcmp(output_file + path_len - suffix_len, suffix) == 0)
+        return strdup(output_file);
+    return path_with_suffix(output_file, suffix);
+}
+
+/**
+ * @brief Releases the state of an incremental run.
+ */
+static void incremental_free(IncrementalRun *run)
+{
+    if (run->cache.report_fd >= 0)
+        close(run->cache.report_fd);
+    manifest_free((Manifest *)run->cache.previous);
+    manifest_free(run->cache.current);
+    free(run->manifest_path);
+    free(run->temp_path);
+}
+
+/**
+ * @brief Opens the last report and loads its manifest.
+ *
+ * A missing report or manifest is not an error: every file is then read.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int incremental_begin(IncrementalRun *run, const char *output_file)
+{
+    memset(run, 0, sizeof(*run));
+    run->cache.report_fd = open(output_file, O_RDONLY | O_CLOEXEC);
+    run->manifest_path = path_with_suffix(output_file, MANIFEST_SUFFIX);
+    run->temp_path = path_with_suffix(output_file, REPORT_TEMP_SUFFIX);
+    if (!run->manifest_path || !run->temp_path)
+        return -1;
+
+    struct stat st;
+    uint64_t report_size = 0;
+    if (run->cache.report_fd >= 0 && fstat(run->cache.report_fd, &st) == 0)
+        report_size = (uint64_t)st.st_size;
+    run->cache.previous = manifest_load(run->manifest_path, report_size);
+    run->cache.current = manifest_create();
+    return run->cache.previous && run->cache.current ? 0 : -1;
+}
+
+/**
+ * @brief Moves the new report into place and saves its manifest.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int incremental_finish(IncrementalRun *run, const char *output_file)
+{
+    struct stat st;
+    if (stat(run->temp_path, &st) != 0 || rename(run->temp_path, output_file) != 0) {
+        remove(run->temp_path);
+        return -1;
     }
+    if (!manifest_save(run->cache.current, run->manifest_path, (uint64_t)st.st_size))
+        remove(run->manifest_path); // A stale manifest must not outlive its report
+    return 0;
+}
 
-    // --- Markdown File Init ---
-    MarkdownHandle *md = md_open_file(output_file);
-    if (!md) {
-        fprintf(stderr, "Error: Could not open output file '%s'.\n", output_file);
-        free_language_profile(profile);
-        return 1;
+/**
+ * @brief The reports requested on the command line, one per profile.
+ */
+typedef struct {
+    ReportSpec specs[FS_TREE_MAX_REPORTS];
+    LanguageProfile *profiles[FS_TREE_MAX_REPORTS];
+    char *paths[FS_TREE_MAX_REPORTS]; // Report names built for several profiles
+    int count;
+} ReportList;
+
+/**
+ * @brief Releases the profiles and names of the reports.
+ */
+static void free_reports(ReportList *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        free_language_profile(list->profiles[i]);
+        free(list->paths[i]);
     }
+    list->count = 0;
+}
 
-    // --- Report Generation ---
-    md_add_header(md, 1, profile->language_name);
+/**
+ * @brief Loads the comma-separated profiles given on the command line.
+ *
+ * A single profile writes `output_file`; several write one report each,
+ * named by report_variant_path().
+ *
+ * @param list Receives the reports.
+ * @param languages The profile names (e.g., "c,python").
+ * @param output_file The report path.
+ * @return 0 on success, -1 on failure (an error has been printed).
+ */
+static int load_reports(ReportList *list, const char *languages, const char *output_file)
+{
+    char names[FS_TREE_MAX_REPORTS][MAX_STR_LEN];
+    bool several = strchr(languages, ',') != NULL;
+    memset(list, 0, sizeof(*list));
+    for (const char *name = languages;; name++) {
+        size_t len = strcspn(name, ",");
+        if (len == 0 || len >= MAX_STR_LEN) {
+            fprintf(stderr, "Error: Invalid language profile list '%s'.\n", languages);
+            break;
+        }
+        if (list->count == FS_TREE_MAX_REPORTS) {
+            fprintf(stderr, "Error: At most %d language profiles can be exported at once.\n",
+                    FS_TREE_MAX_REPORTS);
+            break;
+        }
+        char *current = names[list->count];
+        memcpy(current, name, len);
+        current[len] = '\0';
+        bool listed = false;
+        for (int i = 0; i < list->count; i++)
+            listed = listed || strcmp(names[i], current) == 0;
+        if (listed) {
+            fprintf(stderr, "Error: Language profile '%s' is listed twice.\n", current);
+            break;
+        }
+
+        LanguageProfile *profile = load_language_profile(current);
+        if (!profile)
+            break; // Error message already printed by load_language_profile
+        char *path = several ? report_variant_path(output_file, current) : NULL;
+        if (several && !path) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            free_language_profile(profile);
+            break;
+        }
+        ReportSpec *spec = &list->specs[list->count];
+        spec->profile = profile;
+        spec->output_file = several ? path : output_file;
+        list->profiles[list->count] = profile;
+        list->paths[list->count] = path;
+        list->count++;
+
+        name += len;
+        if (*name == '\0')
+            return 0;
+    }
+    free_reports(list);
+    return -1;
+}
+
+/**
+ * @brief Picks the profiles for `auto` with detect_profiles().
+ *
+ * @param target_dir The project directory.
+ * @param max_count The most profiles to pick.
+ * @param out Where to print the choice (stderr when the report goes to
+ * stdout).
+ * @return The comma-separated profile names (newly allocated), or NULL on
+ * failure (an error has been printed).
+ */
+static char *detect_languages(const char *target_dir, size_t max_count, FILE *out)
+{
+    char *names[FS_TREE_MAX_REPORTS];
+    size_t count = detect_profiles(target_dir, max_count, names);
+    if (count == 0) {
+        fprintf(stderr, "Error: Could not detect a language profile for '%s'.\n", target_dir);
+        return NULL;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++)
+        length += strlen(names[i]) + 1;
+    char *languages = malloc(length);
+    if (languages) {
+        char *end = languages;
+        for (size_t i = 0; i < count; i++) {
+            size_t len = strlen(names[i]);
+            memcpy(end, names[i], len);
+            end += len;
+            *end++ = (i + 1 < count) ? ',' : '\0';
+        }
+        fprintf(out, "Detected language profiles: %s\n", languages);
+    }
+    else {
+        fprintf(stderr, "Error: Out of memory.\n");
+    }
+    for (size_t i = 0; i < count; i++)
+        free(names[i]);
+    return languages;
+}
+
+/**
+ * @brief Settings of one export, taken from the command line.
+ */
+typedef struct {
+    const char *target_dir;
+    const ReportSpec *reports; // One per profile (a single one when incremental or sharded)
+    int report_count;
+    ReadOptions read;
+    MarkdownOptions write;
+    bool incremental;
+    uint64_t shard_size; // 0 for a single report
+    bool from_git_index; // List tracked files instead of walking the directories
+    bool index;          // Write an index next to each report
+} ExportOptions;
+
+/**
+ * @brief Starts the index of a report, if the export writes one, or
+ * removes the one an earlier run left otherwise.
+ *
+ * @param opts The export settings.
+ * @param report The report path (the index is named after it).
+ * @param index Receives the index, or NULL if none is written.
+ * @return 0 on success, -1 on failure (an error has been printed).
+ */
+static int index_begin(const ExportOptions *opts, const char *report, ReportIndex **index)
+{
+    *index = NULL;
+    char *path = strcmp(report, REPORT_STDOUT) != 0 ? path_with_suffix(report, INDEX_SUFFIX) : NULL;
+    if (!opts->index) {
+        // An index left by an earlier run no longer matches the new report
+        if (path)
+            remove(path);
+        free(path);
+        return 0;
+    }
+    *index = path ? report_index_open(path) : NULL;
+    free(path);
+    if (!*index) {
+        fprintf(stderr, "Error: Could not create the index of '%s'.\n", report);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Closes a report, then its index (kept only if the report was
+ * written in full).
+ *
+ * @param md The report.
+ * @param index Its index, or NULL.
+ * @param report The report path.
+ * @return true on success, false if either could not be written (an error
+ * has been printed).
+ */
+static bool report_close(MarkdownHandle *md, ReportIndex *index, const char *report)
+{
+    uint64_t size = md_tell(md);
+    if (!md_close_file(md)) {
+        fprintf(stderr, "Error: Could not write output file '%s'.\n", report);
+        report_index_close(index, report, size, false);
+        return false;
+    }
+    if (!report_index_close(index, report, size, true)) {
+        fprintf(stderr, "Error: Could not write the index of '%s'.\n", report);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Scans the project, from the directories or from the git index.
+ *
+ * @return The tree, or NULL on failure (an error has been printed). The
+ * caller is responsible for freeing it with fs_tree_free().
+ */
+static FsTree *scan_project(const ExportOptions *opts)
+{
+    FsTree *tree;
+    if (opts->from_git_index) {
+        GitIndexStatus status;
+        tree = fs_tree_build_from_git_index(opts->target_dir, opts->reports, opts->report_count,
+                                            &status);
+        if (!tree && status == GIT_INDEX_SPLIT)
+            fprintf(stderr,
+                    "Error: The git index of '%s' is a split index, which is not supported "
+                    "(see `git update-index --no-split-index`).\n",
+                    opts->target_dir);
+        else if (!tree)
+            fprintf(stderr, "Error: Could not read the git index of '%s'.\n", opts->target_dir);
+        return tree;
+    }
+    tree = fs_tree_build(opts->target_dir, opts->reports, opts->report_count, opts->read.jobs);
+    if (!tree)
+        fprintf(stderr, "Error: Could not read directory '%s'.\n", opts->target_dir);
+    return tree;
+}
+
+/**
+ * @brief Writes the report title and directory tree, and opens the "File
+ * Contents" section.
+ */
+static void write_report_head(MarkdownHandle *md, const FsTree *tree, const char *title)
+{
+    md_add_header(md, 1, title);
 
     // 1. Directory Tree
     md_add_header(md, 2, "Directory Tree");
-    generate_directory_tree(md, target_dir, output_file);
+    generate_directory_tree(md, tree);
 
     // 2. File Contents
     md_add_header(md, 2, "File Contents");
-    process_project_files(md, target_dir, profile, output_file);
+}
+
+/**
+ * @brief Opens a report for writing: a new file, or a copy of stdout for
+ * REPORT_STDOUT.
+ *
+ * @return The handle, or NULL on failure.
+ */
+static MarkdownHandle *open_report(const char *path, const MarkdownOptions *opts)
+{
+    if (strcmp(path, REPORT_STDOUT) != 0)
+        return md_open_file(path, opts);
+    int fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    return fd >= 0 ? md_open_fd(fd, opts) : NULL;
+}
+
+/**
+ * @brief Writes the report of a scanned project.
+ *
+ * @param opts The export settings.
+ * @param tree The scanned project.
+ * @return 0 on success, 1 on failure (an error has been printed).
+ */
+static int write_report(const ExportOptions *opts, const FsTree *tree)
+{
+    const char *output_file = opts->reports[0].output_file;
+    const LanguageProfile *profile = opts->reports[0].profile;
+
+    // --- Incremental State ---
+    IncrementalRun run = {.cache.report_fd = -1};
+    if (opts->incremental && incremental_begin(&run, output_file) != 0) {
+        fprintf(stderr, "Error: Could not load the manifest of '%s'.\n", output_file);
+        incremental_free(&run);
+        return 1;
+    }
+
+    // --- Markdown File Init ---
+    const char *md_path = opts->incremental ? run.temp_path : output_file;
+    MarkdownHandle *md = open_report(md_path, &opts->write);
+    if (!md) {
+        fprintf(stderr, "Error: Could not open output file '%s'.\n", output_file);
+        incremental_free(&run);
+        return 1;
+    }
+
+    ReportIndex *index;
+    if (index_begin(opts, output_file, &index) != 0) {
+        md_close_file(md);
+        incremental_free(&run);
+        return 1;
+    }
+
+    // --- Report Generation ---
+    write_report_head(md, tree, profile->language_name);
+    FragmentCache *cache = opts->incremental ? &run.cache : NULL;
+    process_project_files(md, index, tree, profile, cache, &opts->read);
 
     // --- Cleanup ---
-    md_close_file(md);
-    free_language_profile(profile);
+    int status = 0;
+    if (!report_close(md, index, output_file)) {
+        if (opts->incremental)
+            remove(run.temp_path); // Keep the last complete report
+        status = 1;
+    }
+    else if (opts->incremental && incremental_finish(&run, output_file) != 0) {
+        fprintf(stderr, "Error: Could not replace output file '%s'.\n", output_file);
+        status = 1;
+    }
+    incremental_free(&run);
+    return status;
+}
 
-    printf("Export complete: %s\n", output_file);
-    return 0;
-}
\ No newline at end of file
+/**
+ * @brief Scans the project and writes the report.
+ *
+ * @param opts The export settings.
+ * @param tree_out Receives the scanned tree, or NULL to free it here. The
+ * caller is responsible for freeing it with fs_tree_free().
+ * @return 0 on success, 1 on failure (an error has been printed).
+ */
+static int export_report(const ExportOptions *opts, FsTree **tree_out)
+{
+    FsTree *tree = scan_project(opts);
+    if (!tree)
+        return 1;
+    int status = write_report(opts, tree);
+    if (tree_out && status == 0)
+        *tree_out = tree;
+    else
+        fs_tree_free(tree);
+    return status;
+}
+
+/**
+ * @brief Brings the tree of a watched project up to date after a batch of
+ * changes and writes the report again.
+ *
+ * Only the changed directories are scanned again, and only new directories
+ * are added to the watch; the whole project is scanned again if events were
+ * lost or the tree comes from the git index.
+ *
+ * @param opts The export settings.
+ * @param watcher The watcher, after watcher_wait().
+ * @param tree The tree, replaced when scanned again.
+ * @return 0 on success, 1 on failure (an error has been printed).
+ */
+static int update_report(const ExportOptions *opts, Watcher *watcher, FsTree **tree)
+{
+    size_t count;
+    const FsTreeChange *changes = watcher_changes(watcher, &count);
+    if (changes && !opts->from_git_index &&
+        fs_tree_rescan(*tree, changes, count, opts->reports, opts->report_count)) {
+        size_t added_count;
+        const FsNode *const *added = fs_tree_added(*tree, &added_count);
+        for (size_t i = 0; i < added_count; i++) {
+            if (!watcher_add(watcher, added[i])) {
+                fprintf(stderr, "Error: Could not watch '%s'.\n", opts->target_dir);
+                return 1;
+            }
+        }
+        return write_report(opts, *tree);
+    }
+
+    fs_tree_free(*tree);
+    *tree = NULL;
+    int status = export_report(opts, tree);
+    if (status == 0 && !watcher_sync(watcher, *tree)) {
+        fprintf(stderr, "Error: Could not watch '%s'.\n", opts->target_dir);
+        status = 1;
+    }
+    return status;
+}
+
+/**
+ * @brief One shard of a sharded export.
+ */
+typedef struct {
+    const FsTree *tree;
+    const LanguageProfile *profile;
+    const FileSpan *span;
+    char *path;
+    char *title; // "<language> (part i of n)"
+    const ExportOptions *opts;
+    bool failed; // The shard file (or its index) could not be created or written
+} ShardJob;
+
+/**
+ * @brief Worker callback: writes one shard, with its own title and copy of
+ * the directory tree.
+ */
+static void shard_task(WorkPool *pool, int worker, void *task, void *ctx)
+{
+    (void)pool;
+    (void)worker;
+    ShardJob *job = task;
+    const ReadOptions *read = ctx;
+
+    MarkdownHandle *md = md_open_file(job->path, &job->opts->write);
+    if (!md) {
+        fprintf(stderr, "Error: Could not open output file '%s'.\n", job->path);
+        job->failed = true;
+        return;
+    }
+    ReportIndex *index;
+    if (index_begin(job->opts, job->path, &index) != 0) {
+        md_close_file(md);
+        job->failed = true;
+        return;
+    }
+    write_report_head(md, job->tree, job->title);
+    process_file_span(md, index, job->span, job->profile, read);
+    job->failed = !report_close(md, index, job->path);
+}
+
+/**
+ * @brief Scans the project and writes the report as shards of about
+ * `shard_size` bytes, split at file boundaries and written concurrently
+ * (up to one per job).
+ *
+ * Shards left over from an earlier run that produced more of them are
+ * removed.
+ *
+ * @param opts The export settings.
+ * @return 0 on success, 1 on failure (an error has been printed).
+ */
+static int export_sharded(const ExportOptions *opts)
+{
+    const char *output_file = opts->reports[0].output_file;
+    const LanguageProfile *profile = opts->reports[0].profile;
+    FsTree *tree = scan_project(opts);
+    if (!tree)
+        return 1;
+
+    FileSpan *spans = NULL;
+    size_t count =
+        split_project_files(tree, profile, opts->shard_size, opts->read.dedup, &spans);
+    ShardJob *jobs = count ? calloc(count, sizeof(ShardJob)) : NULL;
+    int status = jobs ? 0 : 1;
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        ShardJob *job = &jobs[i];
+        int len = snprintf(NULL, 0, "%s (part %zu of %zu)", profile->language_name, i + 1, count);
+        job->tree = tree;
+        job->profile = profile;
+        job->span = &spans[i];
+        job->opts = opts;
+        job->path = report_shard_path(output_file, i + 1);
+        job->title = malloc((size_t)len + 1);
+        if (!job->path || !job->title) {
+            status = 1;
+            break;
+        }
+        snprintf(job->title, (size_t)len + 1, "%s (part %zu of %zu)", profile->language_name,
+                 i + 1, count);
+    }
+    if (status != 0)
+        fprintf(stderr, "Error: Out of memory while planning the shards.\n");
+
+    // Shards run side by side, so each one reads with a single thread
+    ReadOptions read = opts->read;
+    read.jobs = 1;
+    WorkPool *pool = status == 0 ? workpool_create(opts->read.jobs, shard_task, &read) : NULL;
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        if (pool)
+            workpool_push(pool, -1, &jobs[i]);
+        else
+            shard_task(NULL, 0, &jobs[i], &read);
+    }
+    if (pool) {
+        workpool_wait(pool);
+        workpool_destroy(pool);
+    }
+
+    for (size_t i = 0; status == 0 && i < count; i++)
+        if (jobs[i].failed)
+            status = 1; // Reported by the shard
+    if (status == 0)
+        report_remove_shards(output_file, count);
+    if (status == 0)
+        printf("Export complete: %s .. %s (%zu shards)\n", jobs[0].path, jobs[count - 1].path,
+               count);
+
+    for (size_t i = 0; jobs && i < count; i++) {
+        free(jobs[i].path);
+        free(jobs[i].title);
+    }
+    free(jobs);
+    free_file_spans(spans, count);
+    fs_tree_free(tree);
+    return status;
+}
+
+/**
+ * @brief Scans the project once and writes one report per profile, each
+ * file being read once for all the reports that include it.
+ *
+ * @param opts The export settings.
+ * @return 0 on success, 1 on failure (an error has been printed).
+ */
+static int export_reports(const ExportOptions *opts)
+{
+    FsTree *tree = scan_project(opts);
+    if (!tree)
+        return 1;
+
+    MarkdownHandle *mds[FS_TREE_MAX_REPORTS];
+    ReportIndex *indexes[FS_TREE_MAX_REPORTS];
+    int opened = 0;
+    int status = 0;
+    for (; opened < opts->report_count; opened++) {
+        const ReportSpec *report = &opts->reports[opened];
+        mds[opened] = md_open_file(report->output_file, &opts->write);
+        if (!mds[opened]) {
+            fprintf(stderr, "Error: Could not open output file '%s'.\n", report->output_file);
+            status = 1;
+            break;
+        }
+        if (index_begin(opts, report->output_file, &indexes[opened]) != 0) {
+            md_close_file(mds[opened]);
+            status = 1;
+            break;
+        }
+        write_report_head(mds[opened], tree, report->profile->language_name);
+    }
+    if (status == 0)
+        process_project_reports(mds, indexes, opts->reports, opts->report_count, tree,
+                                &opts->read);
+
+    bool processed = status == 0;
+    for (int i = 0; i < opened; i++) {
+        if (!processed) {
+            md_close_file(mds[i]);
+            report_index_close(indexes[i], opts->reports[i].output_file, 0, false);
+        }
+        else if (!report_close(mds[i], indexes[i], opts->reports[i].output_file)) {
+            status = 1;
+        }
+        else {
+            printf("Export complete: %s\n", opts->reports[i].output_file);
+        }
+    }
+    fs_tree_free(tree);
+    return status;
+}
+
+/**
+ * @brief Main entry point for the source-map utility.
+ */
+int main(int argc, char *argv[])
+{
+    // --- Argument Parsing ---
+    static const struct option long_options[] = {
+        {"jobs", required_argument, NULL, 'j'},
+        {"incremental", no_argument, NULL, 'i'},
+        {"watch", no_argument, NULL, 'w'},
+        {"io-uring", optional_argument, NULL, 'u'},
+        {"no-dedup", no_argument, NULL, OPT_NO_DEDUP},
+        {"shard-size", required_argument, NULL, 's'},
+        {"from-git-index", no_argument, NULL, OPT_FROM_GIT_INDEX},
+        {"write-buffer", required_argument, NULL, OPT_WRITE_BUFFER},
+        {"sync", no_argument, NULL, OPT_SYNC},
+        {"compress", required_argument, NULL, OPT_COMPRESS},
+        {"index", no_argument, NULL, OPT_INDEX},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int jobs = 1;
+    bool incremental = false;
+    bool watch = false;
+    unsigned uring_depth = 0;
+    bool dedup = true;
+    uint64_t shard_size = 0;
+    bool from_git_index = false;
+    bool stats = false;
+    bool index = false;
+    MarkdownOptions write = {0};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:iwu::s:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'j':
+                if (parse_jobs(optarg, &jobs) != 0) {
+                    fprintf(stderr, "Error: Invalid job count '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                incremental = true;
+                break;
+            case 'w':
+                watch = true;
+                break;
+            case 'u':
+                if (parse_uring_depth(optarg, &uring_depth) != 0) {
+                    fprintf(stderr, "Error: Invalid io_uring queue depth '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                if (!reader_parse_size(optarg, &shard_size) || shard_size == 0) {
+                    fprintf(stderr, "Error: Invalid shard size '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_NO_DEDUP:
+                dedup = false;
+                break;
+            case OPT_FROM_GIT_INDEX:
+                from_git_index = true;
+                break;
+            case OPT_WRITE_BUFFER:
+                if (parse_write_buffer(optarg, &write.buffer_size) != 0) {
+                    fprintf(stderr, "Error: Invalid write buffer size '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SYNC:
+                write.sync = true;
+                break;
+            case OPT_COMPRESS:
+                if (parse_compress(optarg, &write.compress) != 0) {
+                    fprintf(stderr, "Error: Unknown compressor '%s' (use gzip or zstd).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_INDEX:
+                index = true;
+                break;
+            case OPT_STATS:
+                stats = true;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (shard_size && (incremental || watch)) {
+        fprintf(stderr, "Error: --shard-size cannot be combined with --incremental or --watch.\n");
+        return 1;
+    }
+    if (write.compress != MD_COMPRESS_NONE && (incremental || watch)) {
+        fprintf(stderr, "Error: --compress cannot be combined with --incremental or --watch.\n");
+        return 1;
+    }
+    if (index && (incremental || watch)) {
+        fprintf(stderr, "Error: --index cannot be combined with --incremental or --watch.\n");
+        return 1;
+    }
+
+    const char *languages = argv[optind];
+    const char *target_dir = (argc > optind + 1) ? argv[optind + 1] : ".";
+    const char *output_file = (argc > optind + 2) ? argv[optind + 2] : "output.md";
+    if (strchr(languages, ',') && (shard_size || incremental || watch)) {
+        fprintf(stderr, "Error: --shard-size, --incremental and --watch take a single "
+                        "language profile.\n");
+        return 1;
+    }
+    bool streaming = strcmp(output_file, REPORT_STDOUT) == 0;
+    if (streaming && (shard_size || incremental || watch || index || strchr(languages, ','))) {
+        fprintf(stderr, "Error: A report streamed to stdout takes a single language profile, "
+                        "without --shard-size, --incremental, --watch or --index.\n");
+        return 1;
+    }
+    char *compressed = NULL;
+    if (write.compress != MD_COMPRESS_NONE && !streaming) {
+        compressed = compressed_path(output_file, write.compress);
+        if (!compressed)
+            return 1;
+        output_file = compressed;
+        signal(SIGPIPE, SIG_IGN); // A compressor exiting early fails the write instead
+    }
+
+    // --- Profile Loading ---
+    char *detected = NULL;
+    if (strcmp(languages, "auto") == 0) {
+        bool single = shard_size || incremental || watch || streaming;
+        detected = detect_languages(target_dir, single ? 1 : FS_TREE_MAX_REPORTS,
+                                    streaming ? stderr : stdout);
+        if (!detected) {
+            free(compressed);
+            return 1;
+        }
+        languages = detected;
+    }
+    ReportList reports;
+    int loaded = load_reports(&reports, languages, output_file);
+    free(detected);
+    if (loaded != 0) {
+        free(compressed);
+        return 1;
+    }
+
+    // --- Export ---
+    ExportOptions opts = {
+        .target_dir = target_dir,
+        .reports = reports.specs,
+        .report_count = reports.count,
+        .read = {.jobs = jobs, .uring_depth = uring_depth, .dedup = dedup},
+        .write = write,
+        .incremental = incremental || watch, // Watch mode only reads what changed
+        .shard_size = shard_size,
+        .from_git_index = from_git_index,
+        .index = index,
+    };
+    FsTree *tree = NULL;
+    int status;
+    if (shard_size) {
+        status = export_sharded(&opts); // Prints its own summary
+    }
+    else if (reports.count > 1) {
+        status = export_reports(&opts); // Prints its own summary
+    }
+    else {
+        status = export_report(&opts, watch ? &tree : NULL);
+        if (status == 0 && !streaming)
+            printf("Export complete: %s\n", output_file);
+    }
+
+    // --- Watch Loop ---
+    if (status == 0 && watch) {
+        Watcher *watcher = watcher_create(output_file);
+        if (!watcher || !watcher_sync(watcher, tree)) {
+            fprintf(stderr, "Error: Could not start watching '%s'.\n", target_dir);
+            status = 1;
+        }
+        // Each batch rescans the changed directories only, then rewrites the
+        // report with the code blocks of unchanged files copied from the
+        // previous report rather than read
+        while (status == 0 && watcher_wait(watcher)) {
+            status = update_report(&opts, watcher, &tree);
+            if (status == 0)
+                printf("Export updated: %s\n", output_file);
+            fflush(stdout);
+        }
+        watcher_free(watcher);
+    }
+
+    fs_tree_free(tree);
+    free_reports(&reports);
+    free(compressed);
+    ReaderPoolStats pool;
+    reader_pool_drain(&pool);
+    if (stats)
+        print_stats(&pool);
+    return status;
+}
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE // For getline() and memrchr()
+#include "manifest.h"
+#include "arena.h"
+#include "index.h"
+#include "markdown.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MANIFEST_MAGIC "source-map-manifest 3"
+
+/**
+ * @brief Internal representation of a manifest.
+ */
+struct Manifest {
+    ManifestEntry *entries; // Sorted by path once loaded
+    size_t count;
+    size_t cap;
+    Arena *strings; // Paths and tags
+};
+
+Manifest *manifest_create(void)
+{
+    Manifest *manifest = calloc(1, sizeof(Manifest));
+    if (!manifest)
+        return NULL;
+    manifest->strings = arena_create();
+    if (!manifest->strings) {
+        free(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+void manifest_free(Manifest *manifest)
+{
+    if (!manifest)
+        return;
+    arena_destroy(manifest->strings);
+    free(manifest->entries);
+    free(manifest);
+}
+
+bool manifest_add(Manifest *manifest, const ManifestEntry *entry)
+{
+    if (strpbrk(entry->path, "\t\n") || strpbrk(entry->tag, "\t\n"))
+        return true; // Not representable: the file is simply read next time
+
+    if (manifest->count == manifest->cap) {
+        size_t new_cap = manifest->cap ? manifest->cap * 2 : 64;
+        ManifestEntry *entries = realloc(manifest->entries, new_cap * sizeof(ManifestEntry));
+        if (!entries)
+            return false;
+        manifest->entries = entries;
+        manifest->cap = new_cap;
+    }
+
+    ManifestEntry *copy = &manifest->entries[manifest->count];
+    *copy = *entry;
+    copy->path = arena_strndup(manifest->strings, entry->path, strlen(entry->path));
+    copy->tag = arena_strndup(manifest->strings, entry->tag, strlen(entry->tag));
+    if (!copy->path || !copy->tag)
+        return false;
+    manifest->count++;
+    return true;
+}
+
+/**
+ * @brief Parses one unsigned field terminated by a tab.
+ *
+ * @return A pointer past the tab, or NULL if the field is malformed.
+ */
+static char *parse_field(char *field, uint64_t *value, int base)
+{
+    char *end;
+    unsigned long long parsed = strtoull(field, &end, base);
+    if (end == field || *end != '\t')
+        return NULL;
+    *value = (uint64_t)parsed;
+    return end + 1;
+}
+
+/**
+ * @brief Parses an entry line: ino, size, mtime, hash, offset, length, tag
+ * and path, separated by tabs.
+ *
+ * @return true on success, false if the line is malformed.
+ */
+static bool parse_entry(char *line, ManifestEntry *entry)
+{
+    uint64_t mtime;
+    char *field = parse_field(line, &entry->ino, 10);
+    field = field ? parse_field(field, &entry->size, 10) : NULL;
+    field = field ? parse_field(field, &mtime, 10) : NULL;
+    field = field ? parse_field(field, &entry->hash, 16) : NULL;
+    field = field ? parse_field(field, &entry->offset, 10) : NULL;
+    field = field ? parse_field(field, &entry->length, 10) : NULL;
+    char *tab = field ? strchr(field, '\t') : NULL;
+    if (!tab)
+        return false;
+    *tab = '\0';
+    entry->mtime_ns = (int64_t)mtime;
+    entry->tag = field;
+    entry->path = tab + 1;
+    return true;
+}
+
+/**
+ * @brief Orders entries by path for manifest_find().
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const ManifestEntry *)a)->path, ((const ManifestEntry *)b)->path);
+}
+
+Manifest *manifest_load(const char *path, uint64_t report_size)
+{
+    Manifest *manifest = manifest_create();
+    if (!manifest)
+        return NULL;
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return manifest;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len = getline(&line, &line_cap, file);
+    char expected[64];
+    snprintf(expected, sizeof(expected), MANIFEST_MAGIC " %" PRIu64 "\n", report_size);
+    bool valid = len > 0 && strcmp(line, expected) == 0;
+
+    while (valid && (len = getline(&line, &line_cap, file)) > 0) {
+        if (line[len - 1] != '\n') {
+            valid = false; // Truncated by an interrupted write
+            break;
+        }
+        line[len - 1] = '\0';
+        ManifestEntry entry;
+        if (!parse_entry(line, &entry) || entry.offset + entry.length > report_size) {
+            valid = false;
+            break;
+        }
+        if (!manifest_add(manifest, &entry)) {
+            valid = false;
+            break;
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (!valid)
+        manifest->count = 0; // Stale or damaged: start over
+    qsort(manifest->entries, manifest->count, sizeof(ManifestEntry), compare_entries);
+    return manifest;
+}
+
+const ManifestEntry *manifest_find(const Manifest *manifest, const char *path)
+{
+    if (!manifest || manifest->count == 0)
+        return NULL;
+    ManifestEntry key = {.path = path};
+    return bsearch(&key, manifest->entries, manifest->count, sizeof(ManifestEntry),
+                   compare_entries);
+}
+
+bool manifest_save(const Manifest *manifest, const char *path, uint64_t report_size)
+{
+    size_t path_len = strlen(path);
+    char *temp = malloc(path_len + sizeof(REPORT_TEMP_SUFFIX));
+    if (!temp)
+        return false;
+    memcpy(temp, path, path_len);
+    memcpy(temp + path_len, REPORT_TEMP_SUFFIX, sizeof(REPORT_TEMP_SUFFIX));
+
+    FILE *file = fopen(temp, "w");
+    if (!file) {
+        free(temp);
+        return false;
+    }
+    fprintf(file, MANIFEST_MAGIC " %" PRIu64 "\n", report_size);
+    for (size_t i = 0; i < manifest->count; i++) {
+        const ManifestEntry *entry = &manifest->entries[i];
+        fprintf(file, "%" PRIu64 "\t%" PRIu64 "\t%" PRId64 "\t%" PRIx64 "\t%" PRIu64 "\t%" PRIu64
+                      "\t%s\t%s\n",
+                entry->ino, entry->size, entry->mtime_ns, entry->hash, entry->offset,
+                entry->length, entry->tag, entry->path);
+    }
+
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok && rename(temp, path) == 0;
+    if (!ok)
+        remove(temp);
+    free(temp);
+    return ok;
+}
+
+/**
+ * @brief Splits a report's file name at its extension ("output" and ".md"
+ * for "output.md"; a leading dot does not start an extension). A
+ * compression suffix is part of the extension ("output" and ".md.gz").
+ *
+ * @return The length of the stem.
+ */
+static size_t report_stem_length(const char *base)
+{
+    const char *ext = strrchr(base, '.');
+    if (!ext || ext == base)
+        return strlen(base);
+    size_t len = (size_t)(ext - base);
+    if (strcmp(ext, MD_GZIP_SUFFIX) != 0 && strcmp(ext, MD_ZSTD_SUFFIX) != 0)
+        return len;
+    const char *inner = memrchr(base, '.', len);
+    return inner && inner != base ? (size_t)(inner - base) : len;
+}
+
+/**
+ * @brief Matches the start of a file name against a shard name of the
+ * report ("output.001.md" for "output.md").
+ *
+ * @param name The file name.
+ * @param base The report's file name.
+ * @param number Receives the shard number (may be NULL).
+ * @return A pointer past the matched part, or NULL if the name does not
+ * start with a shard name.
+ */
+static const char *match_shard_name(const char *name, const char *base, size_t *number)
+{
+    size_t stem_len = report_stem_length(base);
+    if (strncmp(name, base, stem_len) != 0 || name[stem_len] != '.')
+        return NULL;
+    const char *digits = name + stem_len + 1;
+    const char *end = digits;
+    while (*end >= '0' && *end <= '9')
+        end++;
+    const char *ext = base + stem_len;
+    if (end == digits || strncmp(end, ext, strlen(ext)) != 0)
+        return NULL;
+    if (number)
+        *number = strtoul(digits, NULL, 10);
+    return end + strlen(ext);
+}
+
+/**
+ * @brief Checks what follows the report's name in a companion file name:
+ * nothing, the manifest or index suffix, the temporary suffix, or both.
+ */
+static bool is_report_suffix(const char *suffix)
+{
+    if (strncmp(suffix, MANIFEST_SUFFIX, strlen(MANIFEST_SUFFIX)) == 0)
+        suffix += strlen(MANIFEST_SUFFIX);
+    else if (strncmp(suffix, INDEX_SUFFIX, strlen(INDEX_SUFFIX)) == 0)
+        suffix += strlen(INDEX_SUFFIX);
+    return *suffix == '\0' || strcmp(suffix, REPORT_TEMP_SUFFIX) == 0;
+}
+
+bool manifest_is_report_file(const char *name, const char *output_file)
+{
+    const char *base = strrchr(output_file, '/');
+    base = base ? base + 1 : output_file;
+    size_t len = strlen(base);
+    if (strncmp(name, base, len) == 0 && is_report_suffix(name + len))
+        return true;
+    const char *rest = match_shard_name(name, base, NULL);
+    return rest && is_report_suffix(rest);
+}
+
+void report_remove_shards(const char *output_file, size_t count)
+{
+    const char *base = strrchr(output_file, '/');
+    base = base ? base + 1 : output_file;
+    size_t dir_len = (size_t)(base - output_file);
+    char *dir_path = dir_len ? strndup(output_file, dir_len) : strdup(".");
+    DIR *dir = dir_path ? opendir(dir_path) : NULL;
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        size_t number;
+        const char *rest = match_shard_name(entry->d_name, base, &number);
+        if (!rest || number <= count || !is_report_suffix(rest))
+            continue;
+        int len = snprintf(NULL, 0, "%s/%s", dir_path, entry->d_name);
+        char *path = malloc((size_t)len + 1);
+        if (path) {
+            snprintf(path, (size_t)len + 1, "%s/%s", dir_path, entry->d_name);
+            remove(path);
+            free(path);
+        }
+    }
+    if (dir)
+        closedir(dir);
+    free(dir_path);
+}
+
+char *report_variant_path(const char *output_file, const char *variant)
+{
+    const char *base = strrchr(output_file, '/');
+    base = base ? base + 1 : output_file;
+    size_t stem_len = (size_t)(base - output_file) + report_stem_length(base);
+    const char *ext = output_file + stem_len;
+
+    int len = snprintf(NULL, 0, "%.*s.%s%s", (int)stem_len, output_file, variant, ext);
+    char *path = len < 0 ? NULL : malloc((size_t)len + 1);
+    if (path)
+        snprintf(path, (size_t)len + 1, "%.*s.%s%s", (int)stem_len, output_file, variant, ext);
+    return path;
+}
+
+char *report_shard_path(const char *output_file, size_t index)
+{
+    char number[24];
+    snprintf(number, sizeof(number), "%03zu", index);
+    return report_variant_path(output_file, number);
+}
+
+void manifest_stamp(ManifestEntry *entry, const struct stat *st)
+{
+    entry->ino = (uint64_t)st->st_ino;
+    entry->size = (uint64_t)st->st_size;
+    entry->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
@@ -1,61 +1,473 @@
+#define _GNU_SOURCE // For copy_file_range(), IOV_MAX and environ
 #include "markdown.h"
+#include "hash.h"
+#include "scan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define COPY_CHUNK_SIZE (1 << 30) // Per-call request for the in-kernel copies
+#define COPY_BUFFER_SIZE 65536    // Fixed buffer for the read()/write() fallback
+#define MAX_PIECES 8              // Pieces of one md_write_pieces() call
+#define FENCE_PIECE 32            // Backticks written per piece of a fence
 
 /**
  * @brief Internal representation of a Markdown file handle.
+ *
+ * Output is gathered in a buffer of its own. A piece that does not fit is
+ * not copied: it goes out in a single writev() with the buffered bytes.
  */
 struct MarkdownHandle {
-    FILE *file;
+    int fd;           // The file, or the pipe to the compressor
+    int file_fd;      // With a compressor: the file it writes (-1 otherwise)
+    pid_t compressor; // The compressor process (0 if none)
+    char *buf;
+    size_t cap;
+    size_t len;            // Bytes buffered
+    uint64_t written;      // Bytes handed to the file so far
+    uint64_t block_offset; // Body of the last code block: its position
+    uint64_t block_length; // and its length
+    bool sync;             // fdatasync() on close
+    bool failed;           // A write failed: further output is dropped
 };
 
-MarkdownHandle *md_open_file(const char *filename)
+/**
+ * @brief Starts a compressor reading from a new pipe and writing to a file.
+ *
+ * @param file_fd The compressed file.
+ * @param compress The compressor.
+ * @param pid Receives the compressor's process ID.
+ * @return The write end of the pipe, or -1 on failure.
+ */
+static int spawn_compressor(int file_fd, MdCompression compress, pid_t *pid)
+{
+    static char *const gzip_argv[] = {"gzip", "-c", NULL};
+    static char *const zstd_argv[] = {"zstd", "-q", "-c", NULL};
+    char *const *argv = compress == MD_COMPRESS_GZIP ? gzip_argv : zstd_argv;
+
+    // Both ends are close-on-exec, so compressors started by other threads
+    // never hold this pipe open
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+        return -1;
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err == 0) {
+        posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, file_fd, STDOUT_FILENO);
+        err = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    close(pipe_fds[0]);
+    if (err != 0) {
+        close(pipe_fds[1]);
+        return -1;
+    }
+    return pipe_fds[1];
+}
+
+MarkdownHandle *md_open_fd(int fd, const MarkdownOptions *opts)
 {
+    size_t cap = opts && opts->buffer_size ? opts->buffer_size : MD_BUFFER_DEFAULT;
+    MdCompression compress = opts ? opts->compress : MD_COMPRESS_NONE;
     MarkdownHandle *handle = malloc(sizeof(MarkdownHandle));
-    if (!handle)
+    char *buf = handle ? malloc(cap) : NULL;
+    if (!buf) {
+        free(handle);
+        close(fd);
         return NULL;
+    }
 
-    handle->file = fopen(filename, "w");
-    if (!handle->file) {
+    handle->fd = fd;
+    handle->file_fd = -1;
+    handle->compressor = 0;
+    if (compress != MD_COMPRESS_NONE) {
+        handle->fd = spawn_compressor(fd, compress, &handle->compressor);
+        handle->file_fd = fd;
+        if (handle->fd < 0)
+            close(fd);
+    }
+    if (handle->fd < 0) {
+        free(buf);
         free(handle);
         return NULL;
     }
+    handle->buf = buf;
+    handle->cap = cap;
+    handle->len = 0;
+    handle->written = 0;
+    handle->block_offset = 0;
+    handle->block_length = 0;
+    handle->sync = opts && opts->sync;
+    handle->failed = false;
+    return handle;
+}
+
+MarkdownHandle *md_open_file(const char *filename, const MarkdownOptions *opts)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return NULL;
+    MarkdownHandle *handle = md_open_fd(fd, opts);
+    if (!handle)
+        unlink(filename);
     return handle;
 }
 
-void md_close_file(MarkdownHandle *handle)
+/**
+ * @brief Writes every byte of an iovec array, retrying short writes.
+ *
+ * @return true on success, false on a write error.
+ */
+static bool writev_all(int fd, struct iovec *iov, int count)
 {
-    if (handle) {
-        if (handle->file) {
-            fclose(handle->file);
+    while (count > 0) {
+        ssize_t put = writev(fd, iov, count > IOV_MAX ? IOV_MAX : count);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return false;
+        // Skip what went out, possibly stopping inside an entry
+        size_t done = (size_t)put;
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
         }
-        free(handle);
     }
+    return true;
 }
 
-void md_add_header(MarkdownHandle *handle, int level, const char *text)
+/**
+ * @brief Appends pieces to the output: copied into the buffer if they fit,
+ * otherwise written along with the buffered bytes in one writev().
+ */
+static void md_write_pieces(MarkdownHandle *handle, const struct iovec *pieces, int count)
 {
-    if (!handle || !handle->file)
+    if (handle->failed)
         return;
-    for (int i = 0; i < level; i++) {
-        fputc('#', handle->file);
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += pieces[i].iov_len;
+
+    if (total <= handle->cap - handle->len) {
+        for (int i = 0; i < count; i++) {
+            memcpy(handle->buf + handle->len, pieces[i].iov_base, pieces[i].iov_len);
+            handle->len += pieces[i].iov_len;
+        }
+        return;
+    }
+
+    struct iovec iov[MAX_PIECES + 1];
+    iov[0] = (struct iovec){.iov_base = handle->buf, .iov_len = handle->len};
+    memcpy(iov + 1, pieces, (size_t)count * sizeof(struct iovec));
+    handle->failed = !writev_all(handle->fd, iov, count + 1);
+    handle->written += handle->len + total;
+    handle->len = 0;
+}
+
+/**
+ * @brief Appends one piece to the output.
+ */
+static void md_write(MarkdownHandle *handle, const char *data, size_t length)
+{
+    struct iovec piece = {.iov_base = (void *)data, .iov_len = length};
+    md_write_pieces(handle, &piece, 1);
+}
+
+/**
+ * @brief Writes out the buffered bytes, so the descriptor can be written
+ * to directly.
+ *
+ * @return true on success, false if a write failed (now or earlier).
+ */
+static bool md_flush(MarkdownHandle *handle)
+{
+    if (!handle->failed && handle->len > 0) {
+        struct iovec iov = {.iov_base = handle->buf, .iov_len = handle->len};
+        handle->failed = !writev_all(handle->fd, &iov, 1);
+        handle->written += handle->len;
+        handle->len = 0;
     }
-    fprintf(handle->file, " %s\n\n", text);
+    return !handle->failed;
+}
+
+/**
+ * @brief Waits for the compressor to finish the file.
+ *
+ * @return true if it exited successfully.
+ */
+static bool wait_compressor(pid_t pid)
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool md_close_file(MarkdownHandle *handle)
+{
+    if (!handle)
+        return false;
+    bool ok = md_flush(handle);
+    if (handle->compressor) {
+        // Closing the pipe is the compressor's end of input
+        if (close(handle->fd) != 0)
+            ok = false;
+        if (!wait_compressor(handle->compressor))
+            ok = false;
+        handle->fd = handle->file_fd;
+    }
+    // A pipe or terminal cannot be synced (EINVAL): there is nothing to flush
+    if (ok && handle->sync)
+        ok = fdatasync(handle->fd) == 0 || errno == EINVAL;
+    if (close(handle->fd) != 0)
+        ok = false;
+    free(handle->buf);
+    free(handle);
+    return ok;
+}
+
+void md_add_header(MarkdownHandle *handle, int level, const char *text)
+{
+    md_add_header_len(handle, level, text, text ? strlen(text) : 0);
+}
+
+void md_add_header_len(MarkdownHandle *handle, int level, const char *text, size_t length)
+{
+    static const char hashes[] = "######";
+    if (!handle || level < 1 || level > (int)sizeof(hashes) - 1)
+        return;
+    struct iovec pieces[] = {
+        {.iov_base = (void *)hashes, .iov_len = (size_t)level},
+        {.iov_base = " ", .iov_len = 1},
+        {.iov_base = (void *)text, .iov_len = length},
+        {.iov_base = "\n\n", .iov_len = 2},
+    };
+    md_write_pieces(handle, pieces, 4);
+}
+
+/**
+ * @brief Writes all but the last backticks of a fence, and returns a piece
+ * of the rest (a fence is seldom longer than one piece).
+ */
+static struct iovec md_fence_piece(MarkdownHandle *handle, size_t fence)
+{
+    static const char backticks[FENCE_PIECE + 1] = "````````````````````````````````";
+    if (fence < SCAN_FENCE_MIN)
+        fence = SCAN_FENCE_MIN;
+    for (; fence > FENCE_PIECE; fence -= FENCE_PIECE)
+        md_write(handle, backticks, FENCE_PIECE);
+    return (struct iovec){.iov_base = (void *)backticks, .iov_len = fence};
 }
 
 void md_add_code_block(MarkdownHandle *handle, const char *language_tag, const char *content)
 {
-    if (!handle || !handle->file)
+    size_t length = content ? strlen(content) : 0;
+    ContentScan scan;
+    content_scan(&scan, content, length);
+    md_add_code_block_len(handle, language_tag, content, length, content_scan_fence(&scan));
+}
+
+void md_add_code_block_len(MarkdownHandle *handle, const char *language_tag, const char *content,
+                           size_t length, size_t fence)
+{
+    if (!handle)
         return;
-    fprintf(handle->file, "```%s\n", language_tag ? language_tag : "");
-    fprintf(handle->file, "%s\n", content);
-    fprintf(handle->file, "```\n\n");
+    const char *tag = language_tag ? language_tag : "";
+    struct iovec pieces[] = {
+        md_fence_piece(handle, fence),
+        {.iov_base = (void *)tag, .iov_len = strlen(tag)},
+        {.iov_base = "\n", .iov_len = 1},
+        {.iov_base = (void *)content, .iov_len = length},
+        {.iov_base = "\n", .iov_len = 1},
+    };
+    md_write_pieces(handle, pieces, 5);
+    handle->block_offset = md_tell(handle) - length - 1;
+    handle->block_length = length;
+
+    struct iovec closing[] = {
+        md_fence_piece(handle, fence),
+        {.iov_base = "\n\n", .iov_len = 2},
+    };
+    md_write_pieces(handle, closing, 2);
+}
+
+/**
+ * @brief Writes a whole buffer to a descriptor, retrying short writes.
+ *
+ * @return true on success, false on a write error.
+ */
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t put = write(fd, buf, len);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return false;
+        buf += put;
+        len -= (size_t)put;
+    }
+    return true;
+}
+
+/**
+ * @brief Copies everything from in_fd's current offset to EOF into out_fd.
+ *
+ * Tries copy_file_range() (in-kernel, reflink-capable), then sendfile()
+ * (which also handles pipes and sockets), then a fixed-size buffer. Each
+ * step continues from where the previous one stopped, since all three
+ * advance the descriptors' own offsets. An in-kernel copy that returns 0
+ * before moving anything is not trusted as EOF: pseudo-files report a size
+ * of zero, and only read() is authoritative for them. Bytes that must be
+ * hashed only take the buffered path.
+ *
+ * @param copied Incremented by the bytes written to out_fd.
+ * @param hash Receives the bytes copied (may be NULL).
+ * @return true on success, false on a read or write error.
+ */
+static bool copy_fd(int in_fd, int out_fd, uint64_t *copied, HashState *hash)
+{
+    ssize_t got = -1;
+    bool moved = false;
+    while (!hash && (got = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE, 0)) != 0) {
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+            break;
+        *copied += (uint64_t)got;
+        moved = true;
+    }
+    if (got == 0 && moved)
+        return true;
+
+    while (!hash && (got = sendfile(out_fd, in_fd, NULL, COPY_CHUNK_SIZE)) != 0) {
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+            break;
+        *copied += (uint64_t)got;
+        moved = true;
+    }
+    if (got == 0 && moved)
+        return true;
+
+    char buf[COPY_BUFFER_SIZE];
+    for (;;) {
+        got = read(in_fd, buf, sizeof(buf));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return got == 0;
+        if (!write_all(out_fd, buf, (size_t)got))
+            return false;
+        if (hash)
+            hash_update(hash, buf, (size_t)got);
+        *copied += (uint64_t)got;
+    }
+}
+
+bool md_add_code_block_fd(MarkdownHandle *handle, const char *language_tag, int fd, size_t fence,
+                          uint64_t *hash)
+{
+    if (!handle)
+        return false;
+    const char *tag = language_tag ? language_tag : "";
+    struct iovec pieces[] = {
+        md_fence_piece(handle, fence),
+        {.iov_base = (void *)tag, .iov_len = strlen(tag)},
+        {.iov_base = "\n", .iov_len = 1},
+    };
+    md_write_pieces(handle, pieces, 3);
+
+    // The body bypasses the buffer: flush the fence first
+    bool ok = md_flush(handle);
+    handle->block_offset = handle->written;
+    HashState state;
+    if (hash)
+        hash_init(&state);
+    ok = ok && copy_fd(fd, handle->fd, &handle->written, hash ? &state : NULL);
+    if (hash)
+        *hash = hash_final(&state);
+    handle->block_length = handle->written - handle->block_offset;
+
+    md_write(handle, "\n", 1);
+    struct iovec closing[] = {
+        md_fence_piece(handle, fence),
+        {.iov_base = "\n\n", .iov_len = 2},
+    };
+    md_write_pieces(handle, closing, 2);
+    return ok;
+}
+
+bool md_add_raw_range(MarkdownHandle *handle, int fd, uint64_t offset, uint64_t length)
+{
+    if (!handle || !md_flush(handle))
+        return false;
+    off_t in_off = (off_t)offset;
+
+    while (length > 0) {
+        size_t want = length < COPY_CHUNK_SIZE ? (size_t)length : COPY_CHUNK_SIZE;
+        ssize_t got = copy_file_range(fd, &in_off, handle->fd, NULL, want, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break; // Not supported here (or truncated): finish with pread()
+        handle->written += (uint64_t)got;
+        length -= (uint64_t)got;
+    }
+
+    char buf[COPY_BUFFER_SIZE];
+    while (length > 0) {
+        size_t want = length < sizeof(buf) ? (size_t)length : sizeof(buf);
+        ssize_t got = pread(fd, buf, want, in_off);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        if (!write_all(handle->fd, buf, (size_t)got)) {
+            handle->failed = true;
+            return false;
+        }
+        handle->written += (uint64_t)got;
+        in_off += got;
+        length -= (uint64_t)got;
+    }
+    return true;
+}
+
+void md_last_block(MarkdownHandle *handle, uint64_t *offset, uint64_t *length)
+{
+    *offset = handle ? handle->block_offset : 0;
+    *length = handle ? handle->block_length : 0;
+}
+
+uint64_t md_tell(MarkdownHandle *handle)
+{
+    return handle ? handle->written + handle->len : 0;
 }
 
 void md_add_raw_text(MarkdownHandle *handle, const char *text)
 {
-    if (!handle || !handle->file)
-        return;
-    // Use fprintf for raw text to handle potential '%' characters safely
-    fprintf(handle->file, "%s", text);
-}
\ No newline at end of file
+    if (handle && text)
+        md_write(handle, text, strlen(text));
+}
+
+void md_add_raw_text_len(MarkdownHandle *handle, const char *text, size_t length)
+{
+    if (handle)
+        md_write(handle, text, length);
+}
@@ -0,0 +1,232 @@
+#include "reader.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief The process-wide pool of file buffers. Idle buffers are linked
+ * through their first bytes.
+ */
+static struct {
+    pthread_mutex_t lock;
+    void *idle[READER_POOL_CLASSES];
+    size_t idle_count[READER_POOL_CLASSES];
+    ReaderPoolStats stats;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief Finds the smallest size class holding `size` bytes.
+ *
+ * @return The class, or -1 if `size` exceeds the largest one.
+ */
+static int pool_class(size_t size)
+{
+    for (int c = 0; c < READER_POOL_CLASSES; c++)
+        if (size <= (size_t)1 << (READER_POOL_MIN_SHIFT + c))
+            return c;
+    return -1;
+}
+
+char *reader_buffer_acquire(size_t size, size_t *capacity)
+{
+    int c = pool_class(size);
+    if (c < 0)
+        return NULL;
+    *capacity = (size_t)1 << (READER_POOL_MIN_SHIFT + c);
+
+    pthread_mutex_lock(&pool.lock);
+    char *buffer = pool.idle[c];
+    if (buffer) {
+        memcpy(&pool.idle[c], buffer, sizeof(void *));
+        pool.idle_count[c]--;
+        pool.stats.reused++;
+    }
+    else {
+        pool.stats.allocated++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return buffer ? buffer : malloc(*capacity);
+}
+
+void reader_buffer_release(char *buffer, size_t capacity)
+{
+    int c = buffer ? pool_class(capacity) : -1;
+    if (c < 0)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    bool kept = pool.idle_count[c] < READER_POOL_CLASS_BYTES / capacity;
+    if (kept) {
+        memcpy(buffer, &pool.idle[c], sizeof(void *));
+        pool.idle[c] = buffer;
+        pool.idle_count[c]++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    if (!kept)
+        free(buffer);
+}
+
+void reader_pool_drain(ReaderPoolStats *stats)
+{
+    pthread_mutex_lock(&pool.lock);
+    for (int c = 0; c < READER_POOL_CLASSES; c++) {
+        while (pool.idle[c]) {
+            void *buffer = pool.idle[c];
+            memcpy(&pool.idle[c], buffer, sizeof(void *));
+            free(buffer);
+        }
+        pool.idle_count[c] = 0;
+    }
+    if (stats)
+        *stats = pool.stats;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Reads a whole file into `data`, which has room for `capacity`
+ * bytes and a terminator.
+ *
+ * @return The bytes read, or -1 if the file could not be read or grew past
+ * the buffer.
+ */
+static ssize_t read_whole(int fd, char *data, size_t capacity)
+{
+    // A file filling the buffer is probed for growth
+    size_t len = 0;
+    ssize_t got = 1;
+    while (got != 0) {
+        char probe;
+        bool full = len == capacity;
+        got = full ? read(fd, &probe, 1) : read(fd, data + len, capacity - len);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 || (full && got > 0))
+            return -1;
+        len += (size_t)got;
+    }
+    data[len] = '\0';
+    return (ssize_t)len;
+}
+
+BodyMode reader_select_mode(uint64_t size)
+{
+    if (size <= READER_BUFFER_MAX)
+        return BODY_BUFFER;
+    if (size <= READER_HEAP_MAX)
+        return BODY_HEAP;
+    return BODY_STREAM;
+}
+
+bool reader_load(FileBody *body, int fd, uint64_t size)
+{
+    body->mode = BODY_NONE;
+    body->data = NULL;
+    body->length = 0;
+    body->capacity = 0;
+
+    switch (reader_select_mode(size)) {
+        case BODY_BUFFER: {
+            size_t capacity;
+            char *data = reader_buffer_acquire((size_t)size + 1, &capacity);
+            ssize_t got = data ? read_whole(fd, data, capacity - 1) : -1;
+            if (got >= 0) {
+                body->mode = BODY_BUFFER;
+                body->data = data;
+                body->length = (size_t)got;
+                body->capacity = capacity;
+                break;
+            }
+            reader_buffer_release(data, capacity);
+
+            // The file grew (or a read failed): read it again by its new size,
+            // into the heap or as a stream, so that memory stays bounded
+            struct stat st;
+            if (lseek(fd, 0, SEEK_SET) != 0 || fstat(fd, &st) != 0)
+                return false;
+            size = (uint64_t)st.st_size;
+            if (size > READER_HEAP_MAX)
+                break;
+        }
+            // Fall through
+        case BODY_HEAP: {
+            char *data = malloc((size_t)size + 1);
+            ssize_t got = data ? read_whole(fd, data, (size_t)size) : -1;
+            if (got >= 0) {
+                body->mode = BODY_HEAP;
+                body->data = data;
+                body->length = (size_t)got;
+                break;
+            }
+            free(data);
+            if (lseek(fd, 0, SEEK_SET) != 0)
+                return false;
+            break; // Stream instead of growing a large heap copy
+        }
+        default:
+            break;
+    }
+
+    if (body->mode != BODY_NONE) {
+        content_scan(&body->scan, body->data, body->length);
+        return true;
+    }
+    body->mode = BODY_STREAM;
+    body->length = (size_t)size;
+    if (!content_scan_fd(&body->scan, fd, SCAN_STREAM_PROBE))
+        content_scan(&body->scan, NULL, 0); // Unreadable: the copy will fail too
+    return true;
+}
+
+void reader_release(FileBody *body)
+{
+    if (body->mode == BODY_BUFFER && body->capacity)
+        reader_buffer_release((char *)body->data, body->capacity);
+    else if (body->mode == BODY_BUFFER || body->mode == BODY_HEAP)
+        free((void *)body->data);
+    body->mode = BODY_NONE;
+    body->data = NULL;
+    body->length = 0;
+    body->capacity = 0;
+}
+
+bool reader_parse_size(const char *str, uint64_t *size)
+{
+    if (!str || *str < '0' || *str > '9')
+        return false;
+
+    errno = 0;
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno != 0)
+        return false;
+
+    unsigned shift = 0;
+    switch (*end) {
+        case '\0':
+            break;
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return false;
+    }
+    if (shift && end[1] != '\0')
+        return false;
+    if (value > (UINT64_MAX >> shift))
+        return false;
+
+    *size = (uint64_t)value << shift;
+    return true;
+}
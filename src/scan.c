@@ -0,0 +1,269 @@
+#define _XOPEN_SOURCE 700 // For pread()
+#include "scan.h"
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#define SCAN_BLOCK 64              // Bytes per set of masks (one bit each)
+#define SCAN_READ_SIZE (64 * 1024) // Chunk of content_scan_fd()
+
+/**
+ * @brief One bit per byte of a block, for each kind of byte the scan
+ * looks for.
+ */
+typedef struct {
+    uint64_t nul;
+    uint64_t newline;
+    uint64_t backtick;
+    uint64_t high; // Non-ASCII
+} BlockMasks;
+
+typedef void (*MaskFn)(const unsigned char *block, BlockMasks *masks);
+
+/**
+ * @brief Builds the masks of up to a block of bytes one at a time (the
+ * fallback, and the tail of every buffer).
+ */
+static void masks_scalar(const unsigned char *p, size_t n, BlockMasks *m)
+{
+    *m = (BlockMasks){0};
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        m->nul |= p[i] == '\0' ? bit : 0;
+        m->newline |= p[i] == '\n' ? bit : 0;
+        m->backtick |= p[i] == '`' ? bit : 0;
+        m->high |= p[i] >= 0x80 ? bit : 0;
+    }
+}
+
+static void masks_block_scalar(const unsigned char *p, BlockMasks *m)
+{
+    masks_scalar(p, SCAN_BLOCK, m);
+}
+
+#ifdef SCAN_X86
+static uint64_t movemask16(__m128i v)
+{
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(v);
+}
+
+static void masks_block_sse2(const unsigned char *p, BlockMasks *m)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i backtick = _mm_set1_epi8('`');
+    *m = (BlockMasks){0};
+    for (int i = 0; i < SCAN_BLOCK / 16; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+        int shift = i * 16;
+        m->nul |= movemask16(_mm_cmpeq_epi8(v, zero)) << shift;
+        m->newline |= movemask16(_mm_cmpeq_epi8(v, newline)) << shift;
+        m->backtick |= movemask16(_mm_cmpeq_epi8(v, backtick)) << shift;
+        m->high |= movemask16(v) << shift;
+    }
+}
+
+__attribute__((target("avx2"))) static uint64_t movemask32(__m256i v)
+{
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(v);
+}
+
+__attribute__((target("avx2"))) static void masks_block_avx2(const unsigned char *p,
+                                                               BlockMasks *m)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i backtick = _mm256_set1_epi8('`');
+    *m = (BlockMasks){0};
+    for (int i = 0; i < SCAN_BLOCK / 32; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i * 32));
+        int shift = i * 32;
+        m->nul |= movemask32(_mm256_cmpeq_epi8(v, zero)) << shift;
+        m->newline |= movemask32(_mm256_cmpeq_epi8(v, newline)) << shift;
+        m->backtick |= movemask32(_mm256_cmpeq_epi8(v, backtick)) << shift;
+        m->high |= movemask32(v) << shift;
+    }
+}
+#endif
+
+static MaskFn masks_block = masks_block_scalar;
+static pthread_once_t masks_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Picks the widest mask builder the CPU supports.
+ */
+static void masks_select(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    masks_block = __builtin_cpu_supports("avx2") ? masks_block_avx2 : masks_block_sse2;
+#endif
+}
+
+/**
+ * @brief Advances the UTF-8 validator over one byte.
+ */
+static void utf8_step(ContentScan *scan, unsigned char c)
+{
+    if (scan->utf8_need > 0) {
+        if (c < scan->utf8_lo || c > scan->utf8_hi) {
+            scan->utf8_valid = false;
+            return;
+        }
+        scan->utf8_need--;
+        scan->utf8_lo = 0x80;
+        scan->utf8_hi = 0xBF;
+        return;
+    }
+    if (c < 0x80)
+        return;
+
+    // The lead byte sets the length, and bounds the first continuation
+    // byte against overlong forms, surrogates and code points past U+10FFFF
+    scan->utf8_lo = 0x80;
+    scan->utf8_hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        scan->utf8_need = 1;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+        scan->utf8_need = 2;
+        if (c == 0xE0)
+            scan->utf8_lo = 0xA0;
+        else if (c == 0xED)
+            scan->utf8_hi = 0x9F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        scan->utf8_need = 3;
+        if (c == 0xF0)
+            scan->utf8_lo = 0x90;
+        else if (c == 0xF4)
+            scan->utf8_hi = 0x8F;
+    }
+    else {
+        scan->utf8_valid = false;
+    }
+}
+
+/**
+ * @brief Extends the backtick runs over a block's mask of `n` bytes.
+ */
+static void scan_backticks(ContentScan *scan, uint64_t mask, size_t n)
+{
+    size_t end = 0; // Where the last run seen ended
+    while (mask) {
+        size_t start = (size_t)__builtin_ctzll(mask);
+        if (start != end)
+            scan->run = 0; // Not a continuation of the previous run
+        uint64_t ones = mask >> start;
+        size_t len = ~ones ? (size_t)__builtin_ctzll(~ones) : SCAN_BLOCK - start;
+        scan->run += len;
+        if (scan->run > scan->longest_run)
+            scan->longest_run = scan->run;
+        end = start + len;
+        mask = end < SCAN_BLOCK ? mask & (~(uint64_t)0 << end) : 0;
+    }
+    if (end != n)
+        scan->run = 0;
+}
+
+/**
+ * @brief Folds a block of `n` bytes into the scan.
+ */
+static void scan_block(ContentScan *scan, const unsigned char *p, size_t n, const BlockMasks *m)
+{
+    if (m->nul && scan->offset < SCAN_BINARY_PROBE &&
+        scan->offset + (uint64_t)__builtin_ctzll(m->nul) < SCAN_BINARY_PROBE) {
+        scan->binary = true;
+        return;
+    }
+
+    scan->lines += (uint64_t)__builtin_popcountll(m->newline);
+    scan_backticks(scan, m->backtick, n);
+    if (scan->utf8_valid && (m->high || scan->utf8_need > 0)) {
+        size_t i = scan->utf8_need > 0 ? 0 : (size_t)__builtin_ctzll(m->high);
+        for (; i < n && scan->utf8_valid; i++)
+            utf8_step(scan, p[i]);
+    }
+    scan->partial_line = p[n - 1] != '\n';
+    scan->offset += n;
+}
+
+void content_scan_init(ContentScan *scan)
+{
+    *scan = (ContentScan){.utf8_valid = true};
+    pthread_once(&masks_once, masks_select);
+}
+
+void content_scan_update(ContentScan *scan, const char *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    BlockMasks masks;
+    while (length >= SCAN_BLOCK && !scan->binary) {
+        masks_block(p, &masks);
+        scan_block(scan, p, SCAN_BLOCK, &masks);
+        p += SCAN_BLOCK;
+        length -= SCAN_BLOCK;
+    }
+    if (length > 0 && !scan->binary) {
+        masks_scalar(p, length, &masks);
+        scan_block(scan, p, length, &masks);
+    }
+}
+
+void content_scan_finish(ContentScan *scan)
+{
+    if (scan->partial_line)
+        scan->lines++;
+    scan->partial_line = false;
+    if (scan->utf8_need > 0)
+        scan->utf8_valid = false;
+}
+
+void content_scan(ContentScan *scan, const char *data, size_t length)
+{
+    content_scan_init(scan);
+    content_scan_update(scan, data, length);
+    content_scan_finish(scan);
+}
+
+bool content_scan_fd(ContentScan *scan, int fd, uint64_t limit)
+{
+    char buf[SCAN_READ_SIZE];
+    content_scan_init(scan);
+    while (!scan->binary) {
+        // One byte past the limit tells a longer file from one that ends there
+        uint64_t left = limit + 1 - scan->offset;
+        size_t want = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+        ssize_t got = pread(fd, buf, want, (off_t)scan->offset);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+            return false;
+        if (got == 0)
+            break;
+        if (scan->offset + (uint64_t)got > limit) {
+            content_scan_update(scan, buf, (size_t)(limit - scan->offset));
+            if (!scan->binary) {
+                scan->partial = true;
+                scan->lines = 0;
+                scan->partial_line = false;
+                scan->utf8_need = 0; // A sequence cut at the limit is not an error
+            }
+            return true;
+        }
+        content_scan_update(scan, buf, (size_t)got);
+    }
+    content_scan_finish(scan);
+    return true;
+}
+
+size_t content_scan_fence(const ContentScan *scan)
+{
+    size_t least = scan->partial ? SCAN_STREAM_FENCE : SCAN_FENCE_MIN;
+    return scan->longest_run >= least ? scan->longest_run + 1 : least;
+}
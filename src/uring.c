@@ -0,0 +1,157 @@
+#define _GNU_SOURCE // For syscall()
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Internal representation of a ring: the kernel-shared queues.
+ */
+struct Uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit; // Entries handed out since the last submission
+    unsigned popped;    // Completions popped so far
+
+    void *sq_map; // Mappings, released by uring_destroy()
+    size_t sq_map_size;
+    void *cq_map; // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    size_t sqes_size;
+};
+
+Uring *uring_create(unsigned depth)
+{
+#ifdef __NR_io_uring_setup
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (!ring)
+        return NULL;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->cq_map_size > ring->sq_map_size)
+        ring->sq_map_size = ring->cq_map_size;
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = single ? ring->sq_map
+                          : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+    char *cq = ring->cq_map;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+#else
+    (void)depth;
+    return NULL;
+#endif
+}
+
+void uring_destroy(Uring *ring)
+{
+    if (!ring)
+        return;
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map && ring->sq_map != MAP_FAILED)
+        munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    free(ring);
+}
+
+struct io_uring_sqe *uring_get_sqe(Uring *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->to_submit;
+    if (tail - head >= ring->sq_entries)
+        return NULL;
+
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->to_submit++;
+    return sqe;
+}
+
+bool uring_submit_and_wait(Uring *ring, unsigned wait_nr)
+{
+    // Publish the new entries before the kernel can see the tail move
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->to_submit, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->to_submit;
+    ring->to_submit = 0;
+
+    for (;;) {
+        long ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                           wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret > 0 && (unsigned)ret < to_submit) {
+            to_submit -= (unsigned)ret; // Partially consumed: submit the rest
+            continue;
+        }
+        if (ret >= 0)
+            return ret > 0 || to_submit == 0;
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+bool uring_next_cqe(Uring *ring, uint64_t *user_data, int32_t *res)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    ring->popped++;
+    return true;
+}
+
+unsigned uring_in_flight(const Uring *ring)
+{
+    // The kernel moves the head past every entry it takes, which then
+    // always posts a completion (even when it fails)
+    return __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) - ring->popped;
+}
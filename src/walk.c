@@ -0,0 +1,416 @@
+#define _GNU_SOURCE // For fdopendir(), openat() and the DT_* constants
+#include "walk.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Directories kept open at once; beyond this, parents are read into memory
+// and closed until the walk climbs back to them.
+#define WALK_MAX_OPEN_DIRS 64
+#define READ_CHUNK_SIZE 65536
+
+/**
+ * @brief One directory on the walker's explicit stack.
+ */
+typedef struct {
+    DIR *dir;        // Open stream, or NULL once the entries are buffered
+    int fd;          // Directory descriptor, or -1 while closed
+    char *buffered;  // Remaining entries: d_type byte, name, NUL (repeated)
+    size_t buffered_len;
+    size_t buffered_pos;
+    size_t path_len; // Length of this directory's path in the buffer
+    dev_t dev;
+    ino_t ino;
+} WalkFrame;
+
+/**
+ * @brief Internal representation of a directory walker.
+ */
+struct DirWalk {
+    WalkFrame *frames;
+    size_t depth;
+    size_t cap;
+    size_t open_dirs; // Frames currently holding a descriptor
+
+    char *path; // Growable buffer holding the current entry's full path
+    size_t path_len;
+    size_t path_cap;
+
+    size_t name_off; // Offset of the last entry's name in path
+    WalkKind last_kind;
+    bool has_last;
+};
+
+/**
+ * @brief Ensures the path buffer can hold at least `need` bytes.
+ */
+static bool path_reserve(DirWalk *walk, size_t need)
+{
+    if (need <= walk->path_cap)
+        return true;
+    size_t new_cap = walk->path_cap ? walk->path_cap : 256;
+    while (new_cap < need)
+        new_cap *= 2;
+    char *path = realloc(walk->path, new_cap);
+    if (!path)
+        return false;
+    walk->path = path;
+    walk->path_cap = new_cap;
+    return true;
+}
+
+/**
+ * @brief Returns the descriptor and name to use for the last entry of a
+ * frame: the directory descriptor and the bare name, or AT_FDCWD and the
+ * full path if the directory could not be kept open.
+ */
+static int frame_base(const DirWalk *walk, const WalkFrame *frame, const char **ref)
+{
+    if (frame->fd >= 0) {
+        *ref = walk->path + walk->name_off;
+        return frame->fd;
+    }
+    *ref = walk->path;
+    return AT_FDCWD;
+}
+
+/**
+ * @brief Reads the rest of a frame's directory stream into memory and
+ * closes it, freeing a descriptor for a deeper level.
+ */
+static void frame_buffer(DirWalk *walk, WalkFrame *frame)
+{
+    size_t cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(frame->dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (frame->buffered_len + len + 2 > cap) {
+            size_t new_cap = cap ? cap * 2 : 1024;
+            while (new_cap < frame->buffered_len + len + 2)
+                new_cap *= 2;
+            char *buf = realloc(frame->buffered, new_cap);
+            if (!buf)
+                break; // Keep what fits; the rest of the directory is skipped
+            frame->buffered = buf;
+            cap = new_cap;
+        }
+        frame->buffered[frame->buffered_len++] = (char)WALK_DTYPE(entry);
+        memcpy(frame->buffered + frame->buffered_len, entry->d_name, len + 1);
+        frame->buffered_len += len + 1;
+    }
+    closedir(frame->dir);
+    frame->dir = NULL;
+    frame->fd = -1;
+    walk->open_dirs--;
+}
+
+/**
+ * @brief Produces the next raw entry of a frame.
+ *
+ * @return false when the directory is exhausted.
+ */
+static bool frame_next(WalkFrame *frame, const char **name, unsigned char *d_type)
+{
+    if (frame->dir) {
+        struct dirent *entry = readdir(frame->dir);
+        if (!entry)
+            return false;
+        *name = entry->d_name;
+        *d_type = WALK_DTYPE(entry);
+        return true;
+    }
+    if (frame->buffered_pos >= frame->buffered_len)
+        return false;
+    *d_type = (unsigned char)frame->buffered[frame->buffered_pos++];
+    *name = frame->buffered + frame->buffered_pos;
+    frame->buffered_pos += strlen(*name) + 1;
+    return true;
+}
+
+/**
+ * @brief Pushes an opened directory onto the stack.
+ *
+ * Once more than WALK_MAX_OPEN_DIRS directories are open, the parent is
+ * buffered and closed; it is reopened through ".." when the walk returns.
+ */
+static bool push_frame(DirWalk *walk, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    // Refuse to enter a directory that is already on the stack
+    for (size_t i = 0; i < walk->depth; i++) {
+        if (walk->frames[i].dev == st.st_dev && walk->frames[i].ino == st.st_ino) {
+            close(fd);
+            return false;
+        }
+    }
+
+    if (walk->depth == walk->cap) {
+        size_t new_cap = walk->cap ? walk->cap * 2 : 16;
+        WalkFrame *frames = realloc(walk->frames, new_cap * sizeof(WalkFrame));
+        if (!frames) {
+            close(fd);
+            return false;
+        }
+        walk->frames = frames;
+        walk->cap = new_cap;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return false;
+    }
+
+    WalkFrame *frame = &walk->frames[walk->depth++];
+    memset(frame, 0, sizeof(*frame));
+    frame->dir = dir;
+    frame->fd = fd;
+    frame->path_len = walk->path_len;
+    frame->dev = st.st_dev;
+    frame->ino = st.st_ino;
+    walk->open_dirs++;
+
+    if (walk->open_dirs > WALK_MAX_OPEN_DIRS && walk->depth > 1 &&
+        walk->frames[walk->depth - 2].dir)
+        frame_buffer(walk, &walk->frames[walk->depth - 2]);
+    return true;
+}
+
+/**
+ * @brief Reopens a closed frame, preferring ".." of its child (no path
+ * lookup, no PATH_MAX limit) and falling back to the full path.
+ *
+ * The identity is checked so a symlinked child cannot lead elsewhere.
+ */
+static void reopen_frame(DirWalk *walk, WalkFrame *frame, int child_fd)
+{
+    int fd = -1;
+    struct stat st;
+    if (child_fd >= 0)
+        fd = openat(child_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 && (fstat(fd, &st) != 0 || st.st_dev != frame->dev || st.st_ino != frame->ino)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        walk->path[frame->path_len] = '\0';
+        fd = open(walk->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0 &&
+            (fstat(fd, &st) != 0 || st.st_dev != frame->dev || st.st_ino != frame->ino)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) {
+        frame->fd = fd;
+        walk->open_dirs++;
+    }
+}
+
+/**
+ * @brief Pops the top frame, reopening its parent first if it was closed.
+ */
+static void pop_frame(DirWalk *walk)
+{
+    WalkFrame *frame = &walk->frames[walk->depth - 1];
+    if (walk->depth > 1 && walk->frames[walk->depth - 2].fd < 0)
+        reopen_frame(walk, &walk->frames[walk->depth - 2], frame->fd);
+
+    if (frame->dir)
+        closedir(frame->dir);
+    else if (frame->fd >= 0)
+        close(frame->fd);
+    if (frame->fd >= 0)
+        walk->open_dirs--;
+    free(frame->buffered);
+    walk->depth--;
+}
+
+DirWalk *dirwalk_open(const char *root)
+{
+    DirWalk *walk = calloc(1, sizeof(DirWalk));
+    if (!walk)
+        return NULL;
+
+    size_t len = strlen(root);
+    if (!path_reserve(walk, len + 1)) {
+        free(walk);
+        return NULL;
+    }
+    memcpy(walk->path, root, len + 1);
+    walk->path_len = len;
+
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || !push_frame(walk, fd)) {
+        free(walk->path);
+        free(walk->frames);
+        free(walk);
+        return NULL;
+    }
+    return walk;
+}
+
+void dirwalk_close(DirWalk *walk)
+{
+    if (!walk)
+        return;
+    while (walk->depth > 0)
+        pop_frame(walk);
+    free(walk->frames);
+    free(walk->path);
+    free(walk);
+}
+
+bool dirwalk_next(DirWalk *walk, WalkEntry *entry)
+{
+    walk->has_last = false;
+    while (walk->depth > 0) {
+        WalkFrame *frame = &walk->frames[walk->depth - 1];
+        const char *name;
+        unsigned char d_type;
+        if (!frame_next(frame, &name, &d_type)) {
+            pop_frame(walk);
+            continue;
+        }
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        // Build "<dir>/<name>" in place of the previous sibling
+        size_t name_len = strlen(name);
+        if (!path_reserve(walk, frame->path_len + name_len + 2))
+            continue;
+        walk->path[frame->path_len] = '/';
+        memcpy(walk->path + frame->path_len + 1, name, name_len + 1);
+        walk->path_len = frame->path_len + 1 + name_len;
+        walk->name_off = frame->path_len + 1;
+
+        const char *ref;
+        int base = frame_base(walk, frame, &ref);
+        if (!walk_resolve_kind(base, ref, d_type, &walk->last_kind))
+            continue;
+
+        walk->has_last = true;
+        entry->path = walk->path;
+        entry->path_len = walk->path_len;
+        entry->name = walk->path + walk->name_off;
+        entry->depth = (int)walk->depth - 1;
+        entry->kind = walk->last_kind;
+        return true;
+    }
+    return false;
+}
+
+bool dirwalk_descend(DirWalk *walk)
+{
+    if (!walk->has_last || walk->last_kind != WALK_DIR || walk->depth == 0)
+        return false;
+    walk->has_last = false;
+
+    const char *ref;
+    int base = frame_base(walk, &walk->frames[walk->depth - 1], &ref);
+    int fd = openat(base, ref, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    return push_frame(walk, fd);
+}
+
+int dirwalk_open_file(DirWalk *walk)
+{
+    if (!walk->has_last || walk->depth == 0)
+        return -1;
+    const char *ref;
+    int base = frame_base(walk, &walk->frames[walk->depth - 1], &ref);
+    return openat(base, ref, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+}
+
+bool dirwalk_stat(DirWalk *walk, struct stat *st)
+{
+    if (!walk->has_last || walk->depth == 0)
+        return false;
+    const char *ref;
+    int base = frame_base(walk, &walk->frames[walk->depth - 1], &ref);
+    return fstatat(base, ref, st, 0) == 0;
+}
+
+int dirwalk_dir_fd(const DirWalk *walk)
+{
+    if (!walk->has_last || walk->depth == 0)
+        return -1;
+    return walk->frames[walk->depth - 1].fd;
+}
+
+bool walk_resolve_kind(int dirfd, const char *name, unsigned char d_type, WalkKind *kind)
+{
+    switch (d_type) {
+        case DT_DIR:
+            *kind = WALK_DIR;
+            return true;
+        case DT_REG:
+            *kind = WALK_FILE;
+            return true;
+        case DT_LNK:
+        case DT_UNKNOWN:
+            break; // Needs a stat (symlinks are followed)
+        default:
+            *kind = WALK_OTHER;
+            return true;
+    }
+
+    struct stat st;
+    if (fstatat(dirfd, name, &st, 0) != 0)
+        return false;
+    if (S_ISDIR(st.st_mode))
+        *kind = WALK_DIR;
+    else if (S_ISREG(st.st_mode))
+        *kind = WALK_FILE;
+    else
+        *kind = WALK_OTHER;
+    return true;
+}
+
+char *walk_read_fd(int fd, size_t *length)
+{
+    struct stat st;
+    size_t cap = READ_CHUNK_SIZE;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        cap = (size_t)st.st_size + 1; // +1 so EOF is seen without growing
+
+    char *buf = malloc(cap);
+    if (!buf)
+        return NULL;
+
+    size_t len = 0;
+    for (;;) {
+        if (len + 1 >= cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t got = read(fd, buf + len, cap - len - 1);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0) {
+            free(buf);
+            return NULL;
+        }
+        if (got == 0)
+            break;
+        len += (size_t)got;
+    }
+    buf[len] = '\0';
+    if (length)
+        *length = len;
+    return buf;
+}
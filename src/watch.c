@@ -0,0 +1,267 @@
+#define _GNU_SOURCE // For clock_gettime() and the inotify flags
+#include "watch.h"
+#include "gitignore.h"
+#include "manifest.h"
+#include "walk.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WATCH_QUIET_MS 200      // A batch ends after this long without events...
+#define WATCH_MAX_DELAY_MS 2000 // ...or this long after its first event
+#define WATCH_BUFFER_SIZE 65536
+#define WATCH_MAX_CHANGES 1024 // Beyond this many changed directories, rescan everything
+
+#define WATCH_EVENTS                                                                               \
+    (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |              \
+     IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// Events that change a file's content or metadata, but not the tree listing
+#define WATCH_CONTENT_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)
+
+/**
+ * @brief Internal representation of a watcher.
+ */
+struct Watcher {
+    int fd;
+    const char *output_file;
+    const FsNode **dirs; // Indexed by watch descriptor; NULL: not in the tree
+    size_t dirs_cap;
+    char *path; // Scratch buffer for directory paths
+    size_t path_cap;
+    FsTreeChange *changes; // Directories changed by the last batch
+    size_t change_count;
+    size_t change_cap;
+    bool changed_all; // Events were lost (or too many to record)
+    bool warned;      // The watch limit was reached
+};
+
+Watcher *watcher_create(const char *output_file)
+{
+    Watcher *watcher = calloc(1, sizeof(Watcher));
+    if (!watcher)
+        return NULL;
+    watcher->fd = inotify_init1(IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        free(watcher);
+        return NULL;
+    }
+    watcher->output_file = output_file;
+    return watcher;
+}
+
+void watcher_free(Watcher *watcher)
+{
+    if (!watcher)
+        return;
+    close(watcher->fd); // Removes every watch
+    free(watcher->dirs);
+    free(watcher->path);
+    free(watcher->changes);
+    free(watcher);
+}
+
+/**
+ * @brief Maps a watch descriptor to its directory, growing the table.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool watcher_map(Watcher *watcher, int wd, const FsNode *dir)
+{
+    if ((size_t)wd >= watcher->dirs_cap) {
+        size_t new_cap = watcher->dirs_cap ? watcher->dirs_cap : 256;
+        while (new_cap <= (size_t)wd)
+            new_cap *= 2;
+        const FsNode **dirs = realloc(watcher->dirs, new_cap * sizeof(*dirs));
+        if (!dirs)
+            return false;
+        memset(dirs + watcher->dirs_cap, 0, (new_cap - watcher->dirs_cap) * sizeof(*dirs));
+        watcher->dirs = dirs;
+        watcher->dirs_cap = new_cap;
+    }
+    watcher->dirs[wd] = dir;
+    return true;
+}
+
+/**
+ * @brief Watches the non-ignored directories of a subtree.
+ *
+ * @return true on success, false on allocation failure.
+ */
+static bool watch_subtree(Watcher *watcher, const FsNode *dir)
+{
+    const FsNode *end = fs_node_next(dir, false);
+    for (const FsNode *node = dir; node != end; node = fs_node_next(node, true)) {
+        if (node->kind != WALK_DIR || (node->flags & FS_NODE_IGNORED))
+            continue;
+        if (fs_node_path(node, &watcher->path, &watcher->path_cap) == (size_t)-1)
+            return false;
+
+        // Adding a watch to a directory already watched returns its descriptor
+        int wd = inotify_add_watch(watcher->fd, watcher->path, WATCH_EVENTS);
+        if (wd < 0) {
+            if (errno == ENOSPC && !watcher->warned) {
+                fprintf(stderr, "Warning: inotify watch limit reached; some directories are "
+                                "not watched.\n");
+                watcher->warned = true;
+            }
+            continue;
+        }
+        if (!watcher_map(watcher, wd, node))
+            return false;
+    }
+    return true;
+}
+
+bool watcher_sync(Watcher *watcher, const FsTree *tree)
+{
+    if (watcher->dirs)
+        memset(watcher->dirs, 0, watcher->dirs_cap * sizeof(*watcher->dirs));
+    return watch_subtree(watcher, fs_tree_root(tree));
+}
+
+bool watcher_add(Watcher *watcher, const FsNode *dir)
+{
+    return watch_subtree(watcher, dir);
+}
+
+/**
+ * @brief Records a changed directory of the current batch.
+ */
+static void watcher_record(Watcher *watcher, const FsNode *dir, bool subtree)
+{
+    if (watcher->changed_all)
+        return;
+    // Most recent first: events come in bursts per directory
+    for (size_t i = watcher->change_count; i-- > 0;) {
+        if (watcher->changes[i].dir == dir) {
+            watcher->changes[i].subtree |= subtree;
+            return;
+        }
+    }
+    if (watcher->change_count == watcher->change_cap) {
+        size_t new_cap = watcher->change_cap ? watcher->change_cap * 2 : 16;
+        FsTreeChange *changes = new_cap <= WATCH_MAX_CHANGES
+                                    ? realloc(watcher->changes, new_cap * sizeof(*changes))
+                                    : NULL;
+        if (!changes) {
+            watcher->changed_all = true;
+            return;
+        }
+        watcher->changes = changes;
+        watcher->change_cap = new_cap;
+    }
+    watcher->changes[watcher->change_count++] = (FsTreeChange){.dir = dir, .subtree = subtree};
+}
+
+/**
+ * @brief Decides whether an event can change the report, and records the
+ * directory it changes if so.
+ */
+static bool event_is_relevant(Watcher *watcher, const struct inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW) {
+        watcher->changed_all = true; // Events were lost: assume anything changed
+        return true;
+    }
+    if (event->wd < 0 || (event->mask & IN_IGNORED))
+        return false;
+
+    const FsNode *dir =
+        (size_t)event->wd < watcher->dirs_cap ? watcher->dirs[event->wd] : NULL;
+    if (!dir || (dir->flags & FS_NODE_REMOVED)) {
+        // Left the tree (now ignored, or replaced): stop watching it
+        inotify_rm_watch(watcher->fd, event->wd);
+        return false;
+    }
+    if (event->len == 0) {
+        watcher_record(watcher, dir, true); // The directory itself was deleted or moved
+        return true;
+    }
+    if (manifest_is_report_file(event->name, watcher->output_file))
+        return false;
+    if (strcmp(event->name, GITIGNORE_FILE) == 0) {
+        // Changes which files belong in the report, exported or not
+        watcher_record(watcher, dir, true);
+        return true;
+    }
+
+    for (const FsNode *child = dir->children; child; child = child->next) {
+        if (strcmp(child->name, event->name) != 0)
+            continue;
+        if (child->flags & (FS_NODE_IGNORED | FS_NODE_OUTPUT))
+            return false;
+        // Content changes only matter for files whose content is exported
+        if (!(event->mask & ~WATCH_CONTENT_EVENTS & ~IN_ISDIR) && child->kind != WALK_DIR &&
+            !(child->flags & FS_NODE_ALLOWED))
+            return false;
+        break;
+    }
+    watcher_record(watcher, dir, false); // Possibly a new entry
+    return true;
+}
+
+/**
+ * @brief Reads the monotonic clock in milliseconds.
+ */
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool watcher_wait(Watcher *watcher)
+{
+    alignas(struct inotify_event) char buf[WATCH_BUFFER_SIZE];
+    bool pending = false;
+    long long first = 0;
+    watcher->change_count = 0;
+    watcher->changed_all = false;
+
+    for (;;) {
+        int timeout = -1;
+        if (pending) {
+            long long left = WATCH_MAX_DELAY_MS - (now_ms() - first);
+            if (left <= 0)
+                return true;
+            timeout = left < WATCH_QUIET_MS ? (int)left : WATCH_QUIET_MS;
+        }
+
+        struct pollfd pfd = {.fd = watcher->fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+            return false;
+        if (ready == 0)
+            return true; // Quiet for WATCH_QUIET_MS: the batch is complete
+
+        ssize_t len = read(watcher->fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return false;
+
+        const struct inotify_event *event;
+        for (char *p = buf; p < buf + len; p += sizeof(*event) + event->len) {
+            event = (const struct inotify_event *)p;
+            if (event_is_relevant(watcher, event) && !pending) {
+                pending = true;
+                first = now_ms();
+            }
+        }
+    }
+}
+
+const FsTreeChange *watcher_changes(const Watcher *watcher, size_t *count)
+{
+    *count = watcher->change_count;
+    return watcher->changed_all ? NULL : watcher->changes;
+}
@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+#include "workpool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define DEQUE_INITIAL_CAP 64
+
+/**
+ * @brief A growable ring buffer of tasks owned by one worker.
+ *
+ * The owner pushes and pops at the bottom; thieves take from the top.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    void **tasks;
+    size_t cap;
+    size_t top;   // Index of the oldest task
+    size_t count; // Number of queued tasks
+} TaskDeque;
+
+typedef struct {
+    WorkPool *pool;
+    int index;
+} WorkerArg;
+
+/**
+ * @brief Internal representation of a work-stealing pool.
+ */
+struct WorkPool {
+    WorkFn fn;
+    void *ctx;
+    int threads; // Number of deques; workers steal from all of them
+    int started; // Number of worker threads actually running
+    pthread_t *tids;
+    WorkerArg *args;
+    TaskDeque *deques;
+
+    pthread_mutex_t lock; // Protects the counters below
+    pthread_cond_t work;  // Signalled when a task is queued
+    pthread_cond_t idle;  // Signalled when pending drops to zero
+    size_t queued;        // Tasks sitting in a deque
+    size_t pending;       // Tasks queued or running
+    bool shutdown;
+};
+
+/**
+ * @brief Appends a task at the bottom of a deque, growing it if needed.
+ *
+ * @return true on success, false if the deque could not grow.
+ */
+static bool deque_push(TaskDeque *dq, void *task)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap) {
+        size_t new_cap = dq->cap ? dq->cap * 2 : DEQUE_INITIAL_CAP;
+        void **tasks = malloc(new_cap * sizeof(void *));
+        if (!tasks) {
+            pthread_mutex_unlock(&dq->lock);
+            return false;
+        }
+        // Unwrap the ring into the new buffer
+        for (size_t i = 0; i < dq->count; i++)
+            tasks[i] = dq->tasks[(dq->top + i) % dq->cap];
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->cap = new_cap;
+        dq->top = 0;
+    }
+    dq->tasks[(dq->top + dq->count) % dq->cap] = task;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+    return true;
+}
+
+/**
+ * @brief Takes the newest task (owner side) or the oldest task (thief side).
+ *
+ * @param dq The deque.
+ * @param steal true to take from the top, false to take from the bottom.
+ * @return The task, or NULL if the deque is empty.
+ */
+static void *deque_take(TaskDeque *dq, bool steal)
+{
+    void *task = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        if (steal) {
+            task = dq->tasks[dq->top];
+            dq->top = (dq->top + 1) % dq->cap;
+        }
+        else {
+            task = dq->tasks[(dq->top + dq->count - 1) % dq->cap];
+        }
+        dq->count--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return task;
+}
+
+/**
+ * @brief Finds the next task for a worker: its own deque first, then a steal.
+ */
+static void *find_task(WorkPool *pool, int self)
+{
+    void *task = deque_take(&pool->deques[self], false);
+    for (int i = 1; !task && i < pool->threads; i++)
+        task = deque_take(&pool->deques[(self + i) % pool->threads], true);
+
+    if (task) {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return task;
+}
+
+/**
+ * @brief Worker thread loop: run tasks until the pool shuts down.
+ */
+static void *worker_main(void *arg)
+{
+    WorkerArg *wa = arg;
+    WorkPool *pool = wa->pool;
+
+    for (;;) {
+        void *task = find_task(pool, wa->index);
+        if (task) {
+            pool->fn(pool, wa->index, task, pool->ctx);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0)
+                pthread_cond_broadcast(&pool->idle);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        bool done = pool->shutdown && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (done)
+            break;
+    }
+    return NULL;
+}
+
+WorkPool *workpool_create(int threads, WorkFn fn, void *ctx)
+{
+    if (threads < 1 || !fn)
+        return NULL;
+
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (!pool)
+        return NULL;
+
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->tids = calloc((size_t)threads, sizeof(pthread_t));
+    pool->args = calloc((size_t)threads, sizeof(WorkerArg));
+    pool->deques = calloc((size_t)threads, sizeof(TaskDeque));
+    if (!pool->tids || !pool->args || !pool->deques) {
+        free(pool->tids);
+        free(pool->args);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    // The deques must all exist before any worker starts stealing
+    pool->threads = threads;
+    for (int i = 0; i < threads; i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].index = i;
+        if (pthread_create(&pool->tids[i], NULL, worker_main, &pool->args[i]) != 0)
+            break; // Run with the workers we managed to start
+        pool->started++;
+    }
+
+    if (pool->started == 0) {
+        workpool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void workpool_push(WorkPool *pool, int worker, void *task)
+{
+    if (!pool || !task)
+        return;
+
+    int target = (worker >= 0 && worker < pool->started) ? worker : 0;
+
+    // Count the task before it is visible: a thief may take and finish it
+    // before deque_push() returns
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!deque_push(&pool->deques[target], task)) {
+        // Out of memory: run the task inline rather than dropping it
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool, target, task, pool->ctx);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void workpool_wait(WorkPool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void workpool_destroy(WorkPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->started; i++)
+        pthread_join(pool->tids[i], NULL);
+
+    for (int i = 0; i < pool->threads; i++) {
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->tids);
+    free(pool->args);
+    free(pool->deques);
+    free(pool);
+}
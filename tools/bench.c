@@ -0,0 +1,920 @@
+/*
+ * Benchmarks source-map on a synthetic project.
+ *
+ * Usage: bench [options] <exporter>
+ *
+ * Generates a deterministic project tree (the same options and seed always
+ * give the same bytes), then exports it with the C profile in each mode,
+ * first with the tree's files evicted from the page cache before every run
+ * (cold; --drop-caches drops the whole machine's caches instead),
+ * then after an untimed run has loaded it (warm). Progress goes to stderr;
+ * stdout gets one JSON object per mode and cache state:
+ *
+ *   {"label":...,"tree":...,"mode":"parallel","cache":"cold","evict":...,
+ *    "runs":3,"files":...,"output_bytes":...,"seconds":...,
+ *    "seconds_min":...,"seconds_max":...,"files_per_s":...,"mb_per_s":...,
+ *    "peak_rss_kib":...,"tree_files":...,"tree_bytes":...}
+ *
+ * "seconds" is the median wall time of the runs, "files" the file bodies the
+ * exporter wrote (from --stats), "mb_per_s" report bytes (10^6) per second
+ * and "peak_rss_kib" the largest maximum resident set size of any run.
+ *
+ * With --uring-depths, the io_uring mode runs once per queue depth
+ * ("io_uring-64", ...), to compare the I/O backends against each other.
+ *
+ * The tree is kept in the work directory and only generated again when the
+ * options that shape it change.
+ */
+#define _GNU_SOURCE // For wait4(), nftw() and posix_fadvise()
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_RUNS 100
+#define BENCH_MAX_DEPTHS 16 // Entries of --uring-depths
+// Queue depths --io-uring=N accepts (URING_MIN_DEPTH and URING_MAX_DEPTH in include/uring.h)
+#define BENCH_MIN_URING_DEPTH 2
+#define BENCH_MAX_URING_DEPTH 4096
+#define BENCH_CHUNK (64 * 1024) // Bytes of a file generated at a time
+
+/**
+ * @brief The options that shape the generated tree.
+ */
+typedef struct {
+    uint64_t seed;
+    unsigned depth;    // Directory levels below the root
+    unsigned fanout;   // Subdirectories per directory
+    unsigned files;    // Files per directory
+    uint64_t min_size; // Smallest file
+    uint64_t max_size; // Largest file
+    unsigned skew;     // Sizes lean towards min_size as this grows (1 = uniform)
+    unsigned rules;    // Decoy patterns in the root .gitignore
+    unsigned ignored;  // Percentage of files the .gitignore excludes
+    unsigned binary;   // Percentage of C files with NUL bytes
+} TreeParams;
+
+/**
+ * @brief What was generated.
+ */
+typedef struct {
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t bytes;
+} TreeTotals;
+
+/**
+ * @brief One way of running the exporter.
+ */
+typedef struct {
+    const char *name;
+    const char *args[4]; // Options before the profile (NULL-terminated)
+    bool to_stdout;      // Stream the report through a pipe instead of a file
+} BenchMode;
+
+static const BenchMode bench_modes[] = {
+    {"serial", {"-j", "1", NULL}, false},
+    {"parallel", {"-j", "0", NULL}, false},
+    {"io_uring", {"-u", "-j", "0", NULL}, false},
+    {"stdout", {"-j", "0", NULL}, true},
+};
+
+#define BENCH_MODE_COUNT (sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+/**
+ * @brief The outcome of one run of the exporter.
+ */
+typedef struct {
+    double seconds;
+    long peak_rss_kib;
+    uint64_t files;
+    uint64_t output_bytes;
+} RunResult;
+
+/**
+ * @brief Returns the next number of a splitmix64 sequence.
+ */
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Returns a number in [0, 1) from the sequence.
+ */
+static double rng_unit(uint64_t *state)
+{
+    return (double)(rng_next(state) >> 11) / (double)(UINT64_C(1) << 53);
+}
+
+/**
+ * @brief Picks a file size: min_size + (max_size - min_size) * u^skew.
+ */
+static uint64_t pick_size(const TreeParams *params, uint64_t *rng)
+{
+    double u = rng_unit(rng);
+    double scaled = 1.0;
+    for (unsigned i = 0; i < params->skew; i++)
+        scaled *= u;
+    return params->min_size + (uint64_t)(scaled * (double)(params->max_size - params->min_size));
+}
+
+/**
+ * @brief Writes `size` bytes of C-like source, or of an object-file-like
+ * blob when `binary` is set.
+ */
+static int write_file(const char *path, uint64_t size, bool binary, uint64_t *rng)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    static char chunk[BENCH_CHUNK + 256];
+    uint64_t written = 0;
+    unsigned line = 0;
+    while (written < size) {
+        size_t fill = 0;
+        if (binary) {
+            for (; fill < BENCH_CHUNK; fill += 8) {
+                uint64_t word = rng_next(rng) & 0x00FF00FF00FF00FFULL; // Every other byte NUL
+                memcpy(chunk + fill, &word, 8);
+            }
+            if (written == 0)
+                memcpy(chunk, "\177ELF", 4);
+        }
+        else {
+            while (fill < BENCH_CHUNK) {
+                uint64_t r = rng_next(rng);
+                int n;
+                if (line % 8 == 0)
+                    n = sprintf(chunk + fill, "/* Block %u: %016" PRIx64 " */\n", line, r);
+                else if (line % 8 == 7)
+                    n = sprintf(chunk + fill, "\n");
+                else
+                    n = sprintf(chunk + fill,
+                                "static int fn_%u(int x) { return x * %u + %u; } // %" PRIx64 "\n",
+                                line, (unsigned)(r % 97), (unsigned)(r >> 32) % 1000, r >> 40);
+                fill += (size_t)n;
+                line++;
+            }
+        }
+        size_t take = size - written < fill ? (size_t)(size - written) : fill;
+        if (fwrite(chunk, 1, take, file) != take)
+            break;
+        written += take;
+    }
+    return fclose(file) == 0 && written == size ? 0 : -1;
+}
+
+/**
+ * @brief Generates a directory, its files and (below `depth`) its
+ * subdirectories.
+ *
+ * A file is, in order of the dice: ignored by the root .gitignore
+ * (gen_N.c), binary (N.c with NUL bytes, which the exporter lists but
+ * skips), outside the profile (notes_N.txt, one in ten of the rest) or a
+ * C source or header.
+ */
+static int generate_dir(const char *path, unsigned level, const TreeParams *params,
+                        uint64_t *rng, TreeTotals *totals)
+{
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Cannot create '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    totals->dirs++;
+
+    char child[4096];
+    for (unsigned i = 0; i < params->files; i++) {
+        unsigned dice = (unsigned)(rng_next(rng) % 100);
+        bool binary = false;
+        if (dice < params->ignored) {
+            snprintf(child, sizeof(child), "%s/gen_%u.c", path, i);
+        }
+        else if (dice < params->ignored + params->binary) {
+            snprintf(child, sizeof(child), "%s/blob_%u.c", path, i);
+            binary = true;
+        }
+        else if (rng_next(rng) % 10 == 0) {
+            snprintf(child, sizeof(child), "%s/notes_%u.txt", path, i);
+        }
+        else {
+            snprintf(child, sizeof(child), "%s/unit_%u.%s", path, i,
+                     rng_next(rng) % 4 == 0 ? "h" : "c");
+        }
+
+        uint64_t size = pick_size(params, rng);
+        if (write_file(child, size, binary, rng) != 0) {
+            fprintf(stderr, "Error: Cannot write '%s'.\n", child);
+            return -1;
+        }
+        totals->files++;
+        totals->bytes += size;
+    }
+
+    if (level >= params->depth)
+        return 0;
+    for (unsigned i = 0; i < params->fanout; i++) {
+        snprintf(child, sizeof(child), "%s/dir_%u", path, i);
+        if (generate_dir(child, level + 1, params, rng, totals) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the root .gitignore: `rules` patterns that match nothing
+ * (in the shapes real projects use) and the one that ignores gen_*.c.
+ */
+static int write_gitignore(const char *tree, const TreeParams *params)
+{
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/.gitignore", tree) >= (int)sizeof(path))
+        return -1;
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+    for (unsigned i = 0; i < params->rules; i++) {
+        switch (i % 5) {
+            case 0:
+                fprintf(file, "*.decoy%u\n", i);
+                break;
+            case 1:
+                fprintf(file, "decoy_%u/\n", i);
+                break;
+            case 2:
+                fprintf(file, "/vendor_%u/**\n", i);
+                break;
+            case 3:
+                fprintf(file, "cache_%u_*.tmp\n", i);
+                break;
+            default:
+                fprintf(file, "!keep_%u.decoy%u\n", i, i - 4);
+                break;
+        }
+    }
+    fputs("gen_*.c\n", file);
+    return fclose(file);
+}
+
+/**
+ * @brief Removes one entry of a tree (nftw() callback, depth first).
+ */
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+/**
+ * @brief Describes the tree options in one line (also the tree's stamp).
+ */
+static void describe_params(const TreeParams *params, char *out, size_t size)
+{
+    snprintf(out, size,
+             "seed=%" PRIu64 " depth=%u fanout=%u files=%u size=%" PRIu64 "-%" PRIu64
+             " skew=%u rules=%u ignored=%u%% binary=%u%%",
+             params->seed, params->depth, params->fanout, params->files, params->min_size,
+             params->max_size, params->skew, params->rules, params->ignored, params->binary);
+}
+
+/**
+ * @brief Generates the tree in `tree`, unless the stamp next to it shows it
+ * was already generated with the same options.
+ */
+static int prepare_tree(const char *tree, const char *stamp, const TreeParams *params,
+                        TreeTotals *totals)
+{
+    char description[256], line[256];
+    describe_params(params, description, sizeof(description));
+
+    FILE *file = fopen(stamp, "r");
+    if (file) {
+        bool same = fgets(line, sizeof(line), file) && strcspn(line, "\n") == strlen(description) &&
+                    strncmp(line, description, strlen(description)) == 0 &&
+                    fscanf(file, "%" SCNu64 " %" SCNu64 " %" SCNu64, &totals->files,
+                           &totals->dirs, &totals->bytes) == 3;
+        fclose(file);
+        if (same) {
+            fprintf(stderr, "bench: reusing %s (%s)\n", tree, description);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "bench: generating %s (%s)\n", tree, description);
+    remove(stamp);
+    if (nftw(tree, remove_entry, 64, FTW_DEPTH | FTW_PHYS) != 0 && errno != ENOENT) {
+        fprintf(stderr, "Error: Cannot remove '%s': %s\n", tree, strerror(errno));
+        return -1;
+    }
+
+    uint64_t rng = params->seed;
+    *totals = (TreeTotals){0};
+    if (generate_dir(tree, 0, params, &rng, totals) != 0 || write_gitignore(tree, params) != 0)
+        return -1;
+
+    file = fopen(stamp, "w");
+    if (!file)
+        return -1;
+    fprintf(file, "%s\n%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", description, totals->files,
+            totals->dirs, totals->bytes);
+    return fclose(file);
+}
+
+/**
+ * @brief Drops one file's pages from the page cache (nftw() callback).
+ */
+static int evict_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)ftw;
+    if (type != FTW_F)
+        return 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    return 0;
+}
+
+/**
+ * @brief Evicts the tree from the page cache.
+ *
+ * Asks the kernel to drop each file's pages, which leaves the directory
+ * entries and inodes cached. With `drop_all` (--drop-caches, root only),
+ * every cache of the machine is dropped through /proc/sys/vm/drop_caches
+ * instead.
+ *
+ * @return How: "drop_caches" or "fadvise".
+ */
+static const char *evict_tree(const char *tree, bool drop_all)
+{
+    sync();
+    int fd = drop_all ? open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC) : -1;
+    if (fd >= 0) {
+        bool dropped = write(fd, "3", 1) == 1;
+        close(fd);
+        if (dropped)
+            return "drop_caches";
+    }
+    nftw(tree, evict_entry, 64, FTW_PHYS);
+    return "fadvise";
+}
+
+/**
+ * @brief Reads the number of file bodies written from the --stats output.
+ */
+static uint64_t parse_files(const char *log)
+{
+    uint64_t files = 0;
+    char line[512];
+    FILE *file = fopen(log, "r");
+    if (!file)
+        return 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "File bodies: %" SCNu64 " written", &files) == 1)
+            break;
+    fclose(file);
+    return files;
+}
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Runs the exporter once, timing it from fork to exit.
+ *
+ * Its stderr goes to `log`. A streamed report is read (and counted) from a
+ * pipe, the way a consumer would; otherwise stdout goes to /dev/null.
+ *
+ * @return 0 on success, -1 if the exporter could not run or failed.
+ */
+static int run_once(const char *exporter, const BenchMode *mode, const char *profile,
+                    const char *tree, const char *report, const char *log, RunResult *result)
+{
+    const char *argv[12];
+    int argc = 0;
+    argv[argc++] = exporter;
+    for (int i = 0; mode->args[i]; i++)
+        argv[argc++] = mode->args[i];
+    argv[argc++] = "--stats";
+    argv[argc++] = profile;
+    argv[argc++] = tree;
+    argv[argc++] = mode->to_stdout ? "-" : report;
+    argv[argc] = NULL;
+
+    remove(report);
+    int pipe_fds[2] = {-1, -1};
+    if (mode->to_stdout && pipe(pipe_fds) != 0)
+        return -1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        int err = open(log, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        int out = mode->to_stdout ? pipe_fds[1] : open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (err < 0 || out < 0 || dup2(err, STDERR_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0)
+            _exit(127);
+        if (mode->to_stdout)
+            close(pipe_fds[0]);
+        execv(exporter, (char *const *)argv);
+        _exit(127);
+    }
+
+    uint64_t streamed = 0;
+    if (mode->to_stdout) {
+        close(pipe_fds[1]);
+        static char buf[BENCH_CHUNK];
+        ssize_t got;
+        while ((got = read(pipe_fds[0], buf, sizeof(buf))) != 0) {
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0)
+                break;
+            streamed += (uint64_t)got;
+        }
+        close(pipe_fds[0]);
+    }
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR)
+            return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+
+    struct stat st;
+    result->seconds = elapsed(&start, &end);
+    result->peak_rss_kib = usage.ru_maxrss;
+    result->files = parse_files(log);
+    result->output_bytes =
+        mode->to_stdout ? streamed : stat(report, &st) == 0 ? (uint64_t)st.st_size : 0;
+    return 0;
+}
+
+static int compare_seconds(const void *a, const void *b)
+{
+    double x = ((const RunResult *)a)->seconds, y = ((const RunResult *)b)->seconds;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Writes a JSON string, escaping quotes, backslashes and control
+ * characters.
+ */
+static void write_json_string(FILE *file, const char *str)
+{
+    putc('"', file);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putc('\\', file);
+            putc(*p, file);
+        }
+        else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        }
+        else {
+            putc(*p, file);
+        }
+    }
+    putc('"', file);
+}
+
+/**
+ * @brief Context shared by every phase.
+ */
+typedef struct {
+    const char *exporter;
+    const char *profile;
+    const char *label;
+    const char *tree;
+    const char *report;
+    const char *log;
+    const TreeParams *params;
+    const TreeTotals *totals;
+    unsigned runs;
+    bool drop_caches; // Evict with /proc/sys/vm/drop_caches (--drop-caches)
+} Bench;
+
+/**
+ * @brief Runs one mode `runs` times, cold or warm, and prints its result
+ * line.
+ *
+ * @return 0 on success, -1 if a run failed.
+ */
+static int run_phase(const Bench *bench, const BenchMode *mode, bool cold)
+{
+    RunResult results[BENCH_MAX_RUNS];
+    const char *evict = "none";
+    if (!cold && run_once(bench->exporter, mode, bench->profile, bench->tree, bench->report,
+                          bench->log, &results[0]) != 0)
+        goto failed; // Untimed, to load the tree
+
+    long peak_rss_kib = 0;
+    for (unsigned i = 0; i < bench->runs; i++) {
+        if (cold)
+            evict = evict_tree(bench->tree, bench->drop_caches);
+        if (run_once(bench->exporter, mode, bench->profile, bench->tree, bench->report,
+                     bench->log, &results[i]) != 0)
+            goto failed;
+        if (results[i].peak_rss_kib > peak_rss_kib)
+            peak_rss_kib = results[i].peak_rss_kib;
+    }
+
+    RunResult last = results[bench->runs - 1];
+    qsort(results, bench->runs, sizeof(RunResult), compare_seconds);
+    double median = bench->runs % 2 ? results[bench->runs / 2].seconds
+                                    : (results[bench->runs / 2 - 1].seconds +
+                                       results[bench->runs / 2].seconds) /
+                                          2;
+    double rate = median > 0 ? 1 / median : 0;
+
+    char description[256];
+    describe_params(bench->params, description, sizeof(description));
+    fputs("{\"label\":", stdout);
+    write_json_string(stdout, bench->label);
+    fputs(",\"tree\":", stdout);
+    write_json_string(stdout, description);
+    printf(",\"mode\":\"%s\",\"cache\":\"%s\",\"evict\":\"%s\",\"runs\":%u", mode->name,
+           cold ? "cold" : "warm", evict, bench->runs);
+    printf(",\"files\":%" PRIu64 ",\"output_bytes\":%" PRIu64, last.files, last.output_bytes);
+    printf(",\"seconds\":%.6f,\"seconds_min\":%.6f,\"seconds_max\":%.6f", median,
+           results[0].seconds, results[bench->runs - 1].seconds);
+    printf(",\"files_per_s\":%.1f,\"mb_per_s\":%.2f,\"peak_rss_kib\":%ld", last.files * rate,
+           last.output_bytes / 1e6 * rate, peak_rss_kib);
+    printf(",\"tree_files\":%" PRIu64 ",\"tree_bytes\":%" PRIu64 "}\n", bench->totals->files,
+           bench->totals->bytes);
+    fflush(stdout);
+
+    fprintf(stderr, "bench: %-12s %s  %8.3f s  %10.0f files/s  %8.1f MB/s  %7ld KiB\n",
+            mode->name, cold ? "cold" : "warm", median, last.files * rate,
+            last.output_bytes / 1e6 * rate, peak_rss_kib);
+    return 0;
+
+failed:
+    fprintf(stderr, "Error: %s failed in mode %s (see %s).\n", bench->exporter, mode->name,
+            bench->log);
+    return -1;
+}
+
+/**
+ * @brief Parses a size with an optional K/M/G suffix.
+ */
+static int parse_size(const char *arg, uint64_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (end == arg || errno != 0 || *arg == '-')
+        return -1;
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k')
+        shift = 10;
+    else if (*end == 'M' || *end == 'm')
+        shift = 20;
+    else if (*end == 'G' || *end == 'g')
+        shift = 30;
+    if (shift)
+        end++;
+    if (*end != '\0' || value > (UINT64_MAX >> shift))
+        return -1;
+    *size = (uint64_t)value << shift;
+    return 0;
+}
+
+/**
+ * @brief Parses a number within [min, max].
+ */
+static int parse_uint(const char *arg, unsigned min, unsigned max, unsigned *out)
+{
+    uint64_t value;
+    if (parse_size(arg, &value) != 0 || value < min || value > max)
+        return -1;
+    *out = (unsigned)value;
+    return 0;
+}
+
+/**
+ * @brief Parses a comma-separated list of io_uring queue depths.
+ *
+ * @return The number of depths, or -1 if the list is invalid.
+ */
+static int parse_depths(const char *arg, unsigned depths[BENCH_MAX_DEPTHS])
+{
+    int count = 0;
+    char item[32];
+    while (*arg) {
+        size_t len = strcspn(arg, ",");
+        if (count == BENCH_MAX_DEPTHS || len == 0 || len >= sizeof(item))
+            return -1;
+        memcpy(item, arg, len);
+        item[len] = '\0';
+        unsigned *depth = &depths[count++];
+        if (parse_uint(item, BENCH_MIN_URING_DEPTH, BENCH_MAX_URING_DEPTH, depth) != 0)
+            return -1;
+        arg += len + (arg[len] == ',');
+    }
+    return count > 0 ? count : -1;
+}
+
+/**
+ * @brief Marks the modes named in a comma-separated list.
+ */
+static int parse_modes(const char *arg, bool selected[BENCH_MODE_COUNT])
+{
+    memset(selected, 0, BENCH_MODE_COUNT * sizeof(bool));
+    while (*arg) {
+        size_t len = strcspn(arg, ",");
+        size_t i = 0;
+        while (i < BENCH_MODE_COUNT &&
+               (strlen(bench_modes[i].name) != len || strncmp(bench_modes[i].name, arg, len) != 0))
+            i++;
+        if (i == BENCH_MODE_COUNT)
+            return -1;
+        selected[i] = true;
+        arg += len + (arg[len] == ',');
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog_name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <exporter>\n"
+            "\n"
+            "Generates a synthetic project and exports it cold and warm in each mode,\n"
+            "printing one JSON object per mode and cache state.\n"
+            "\n"
+            "Options:\n"
+            "  --dir DIR            Work directory (default build/bench-data)\n"
+            "  --label TEXT         Recorded in every result (e.g. the version)\n"
+            "  --profile NAME       Language profile to export with (default c)\n"
+            "  --modes LIST         serial,parallel,io_uring,stdout (default all)\n"
+            "  --runs N             Timed runs per mode and cache state (default 3)\n"
+            "  --uring-depths LIST  Run the io_uring mode at each queue depth (e.g.\n"
+            "                       8,64,256; 2 to 4096) instead of the exporter's default\n"
+            "  --cold-only, --warm-only\n"
+            "                       Skip the other cache state\n"
+            "  --drop-caches        Make the cache cold by dropping every cache of the\n"
+            "                       machine (/proc/sys/vm/drop_caches, as root) rather\n"
+            "                       than evicting the tree's files one by one\n"
+            "Tree:\n"
+            "  --seed N             Seed of the generator (default 1)\n"
+            "  --depth N            Directory levels below the root (default 3)\n"
+            "  --fanout N           Subdirectories per directory (default 4)\n"
+            "  --files N            Files per directory (default 24)\n"
+            "  --min-size N         Smallest file, K/M suffixes allowed (default 128)\n"
+            "  --max-size N         Largest file (default 64K)\n"
+            "  --size-skew N        Sizes lean towards --min-size as N grows; 1 is\n"
+            "                       uniform (default 3)\n"
+            "  --gitignore-rules N  Decoy patterns in the root .gitignore (default 200)\n"
+            "  --ignored PERCENT    Files the .gitignore excludes (default 10)\n"
+            "  --binary PERCENT     C files with NUL bytes (default 5)\n",
+            prog_name);
+}
+
+enum {
+    OPT_DIR = 256,
+    OPT_LABEL,
+    OPT_PROFILE,
+    OPT_MODES,
+    OPT_RUNS,
+    OPT_URING_DEPTHS,
+    OPT_COLD_ONLY,
+    OPT_WARM_ONLY,
+    OPT_DROP_CACHES,
+    OPT_SEED,
+    OPT_DEPTH,
+    OPT_FANOUT,
+    OPT_FILES,
+    OPT_MIN_SIZE,
+    OPT_MAX_SIZE,
+    OPT_SIZE_SKEW,
+    OPT_RULES,
+    OPT_IGNORED,
+    OPT_BINARY,
+};
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"dir", required_argument, NULL, OPT_DIR},
+        {"label", required_argument, NULL, OPT_LABEL},
+        {"profile", required_argument, NULL, OPT_PROFILE},
+        {"modes", required_argument, NULL, OPT_MODES},
+        {"runs", required_argument, NULL, OPT_RUNS},
+        {"uring-depths", required_argument, NULL, OPT_URING_DEPTHS},
+        {"cold-only", no_argument, NULL, OPT_COLD_ONLY},
+        {"warm-only", no_argument, NULL, OPT_WARM_ONLY},
+        {"drop-caches", no_argument, NULL, OPT_DROP_CACHES},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"depth", required_argument, NULL, OPT_DEPTH},
+        {"fanout", required_argument, NULL, OPT_FANOUT},
+        {"files", required_argument, NULL, OPT_FILES},
+        {"min-size", required_argument, NULL, OPT_MIN_SIZE},
+        {"max-size", required_argument, NULL, OPT_MAX_SIZE},
+        {"size-skew", required_argument, NULL, OPT_SIZE_SKEW},
+        {"gitignore-rules", required_argument, NULL, OPT_RULES},
+        {"ignored", required_argument, NULL, OPT_IGNORED},
+        {"binary", required_argument, NULL, OPT_BINARY},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    TreeParams params = {
+        .seed = 1,
+        .depth = 3,
+        .fanout = 4,
+        .files = 24,
+        .min_size = 128,
+        .max_size = 64 * 1024,
+        .skew = 3,
+        .rules = 200,
+        .ignored = 10,
+        .binary = 5,
+    };
+    const char *dir = "build/bench-data";
+    const char *label = "";
+    const char *profile = "c";
+    bool selected[BENCH_MODE_COUNT];
+    memset(selected, 1, sizeof(selected));
+    unsigned runs = 3;
+    unsigned depths[BENCH_MAX_DEPTHS];
+    int depth_count = 0; // The exporter's default depth only
+    bool cold = true, warm = true;
+    bool drop_caches = false;
+
+    int opt;
+    int bad = 0;
+    while (!bad && (opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case OPT_DIR:
+                dir = optarg;
+                break;
+            case OPT_LABEL:
+                label = optarg;
+                break;
+            case OPT_PROFILE:
+                profile = optarg;
+                break;
+            case OPT_MODES:
+                bad = parse_modes(optarg, selected);
+                break;
+            case OPT_RUNS:
+                bad = parse_uint(optarg, 1, BENCH_MAX_RUNS, &runs);
+                break;
+            case OPT_URING_DEPTHS:
+                depth_count = parse_depths(optarg, depths);
+                bad = depth_count < 0;
+                break;
+            case OPT_COLD_ONLY:
+                warm = false;
+                break;
+            case OPT_WARM_ONLY:
+                cold = false;
+                break;
+            case OPT_DROP_CACHES:
+                drop_caches = true;
+                break;
+            case OPT_SEED:
+                bad = parse_size(optarg, &params.seed);
+                break;
+            case OPT_DEPTH:
+                bad = parse_uint(optarg, 0, 16, &params.depth);
+                break;
+            case OPT_FANOUT:
+                bad = parse_uint(optarg, 0, 1000, &params.fanout);
+                break;
+            case OPT_FILES:
+                bad = parse_uint(optarg, 0, 100000, &params.files);
+                break;
+            case OPT_MIN_SIZE:
+                bad = parse_size(optarg, &params.min_size);
+                break;
+            case OPT_MAX_SIZE:
+                bad = parse_size(optarg, &params.max_size);
+                break;
+            case OPT_SIZE_SKEW:
+                bad = parse_uint(optarg, 1, 16, &params.skew);
+                break;
+            case OPT_RULES:
+                bad = parse_uint(optarg, 0, 1000000, &params.rules);
+                break;
+            case OPT_IGNORED:
+                bad = parse_uint(optarg, 0, 100, &params.ignored);
+                break;
+            case OPT_BINARY:
+                bad = parse_uint(optarg, 0, 100, &params.binary);
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+        if (bad)
+            fprintf(stderr, "Error: Invalid value '%s'.\n", optarg);
+    }
+    if (bad || optind != argc - 1) {
+        if (!bad)
+            print_usage(argv[0]);
+        return 1;
+    }
+    if (params.min_size > params.max_size || params.ignored + params.binary > 100) {
+        fprintf(stderr, "Error: Need --min-size <= --max-size and --ignored + --binary <= 100.\n");
+        return 1;
+    }
+    if (drop_caches && access("/proc/sys/vm/drop_caches", W_OK) != 0) {
+        fprintf(stderr, "Error: --drop-caches needs write access to /proc/sys/vm/drop_caches.\n");
+        return 1;
+    }
+    if (!cold && !warm) {
+        fprintf(stderr, "Error: --cold-only and --warm-only cannot be combined.\n");
+        return 1;
+    }
+
+    const char *exporter = argv[optind];
+    if (access(exporter, X_OK) != 0) {
+        fprintf(stderr, "Error: Cannot run '%s': %s\n", exporter, strerror(errno));
+        return 1;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Cannot create '%s': %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    char tree[4096], stamp[4096], report[4096], log[4096];
+    snprintf(tree, sizeof(tree), "%s/tree", dir);
+    snprintf(stamp, sizeof(stamp), "%s/tree.params", dir);
+    snprintf(report, sizeof(report), "%s/report.md", dir);
+    snprintf(log, sizeof(log), "%s/stderr.log", dir);
+
+    TreeTotals totals;
+    if (prepare_tree(tree, stamp, &params, &totals) != 0) {
+        fprintf(stderr, "Error: Cannot generate the tree in '%s'.\n", tree);
+        return 1;
+    }
+    fprintf(stderr, "bench: %" PRIu64 " files in %" PRIu64 " directories, %.1f MB\n",
+            totals.files, totals.dirs, totals.bytes / 1e6);
+
+    Bench bench = {
+        .exporter = exporter,
+        .profile = profile,
+        .label = label,
+        .tree = tree,
+        .report = report,
+        .log = log,
+        .params = &params,
+        .totals = &totals,
+        .runs = runs,
+        .drop_caches = drop_caches,
+    };
+    int status = 0;
+    for (size_t i = 0; i < BENCH_MODE_COUNT; i++) {
+        if (!selected[i])
+            continue;
+        bool by_depth = strcmp(bench_modes[i].name, "io_uring") == 0 && depth_count > 0;
+        for (int d = 0; d < (by_depth ? depth_count : 1); d++) {
+            BenchMode mode = bench_modes[i];
+            char name[32], depth_arg[32];
+            if (by_depth) {
+                snprintf(name, sizeof(name), "io_uring-%u", depths[d]);
+                snprintf(depth_arg, sizeof(depth_arg), "--io-uring=%u", depths[d]);
+                mode.name = name;
+                mode.args[0] = depth_arg;
+            }
+            if (cold && run_phase(&bench, &mode, true) != 0)
+                status = 1;
+            if (warm && run_phase(&bench, &mode, false) != 0)
+                status = 1;
+        }
+    }
+    remove(report);
+    return status;
+}
@@ -0,0 +1,92 @@
+# Generates the built-in profile table (see include/profiles.h) from the
+# language profiles in config/.
+#
+# Usage: awk -f tools/profiles.awk config/*.ini > profiles.c
+#
+# Lines are read the way iniparser_load() reads them: a UTF-8 BOM is
+# skipped, blank lines and ';' or '#' comments are ignored, "[Section]"
+# starts a section, and "key = value" pairs are trimmed and stored as
+# "Section:key".
+
+function trim(s) {
+    sub(/^[ \t\f\v]+/, "", s)
+    sub(/[ \t\f\v]+$/, "", s)
+    return s
+}
+
+# Quotes a string as a C literal (byte by byte: gsub() replacements with
+# backslashes differ between awk implementations)
+function quote(s,    out, c, i) {
+    out = ""
+    for (i = 1; i <= length(s); i++) {
+        c = substr(s, i, 1)
+        if (c == "\\" || c == "\"")
+            out = out "\\" c
+        else if (c == "\t")
+            out = out "\\t"
+        else
+            out = out c
+    }
+    return "\"" out "\""
+}
+
+function close_profile() {
+    if (count == "")
+        return
+    if (count == 0)
+        print "    {NULL, NULL},"
+    print "};"
+    print ""
+    counts[profiles] = count
+}
+
+BEGIN {
+    print "// Generated by tools/profiles.awk from config/*.ini. Do not edit."
+    print "#include \"profiles.h\""
+    print "#include <stddef.h>"
+    print ""
+    profiles = 0
+    count = ""
+}
+
+FNR == 1 {
+    close_profile()
+    name = FILENAME
+    sub(/^.*\//, "", name)
+    sub(/\.ini$/, "", name)
+    names[++profiles] = name
+    section = ""
+    count = 0
+    printf "static const ProfileSetting settings_%d[] = {\n", profiles
+    sub(/^\357\273\277/, "")
+}
+
+{
+    sub(/\r$/, "")
+    line = trim($0)
+    if (line == "" || line ~ /^[;#]/)
+        next
+    if (line ~ /^\[.*\]$/) {
+        section = trim(substr(line, 2, length(line) - 2))
+        next
+    }
+    eq = index(line, "=")
+    if (eq == 0)
+        next
+    key = trim(substr(line, 1, eq - 1))
+    value = trim(substr(line, eq + 1))
+    printf "    {%s, %s},\n", quote(section ":" key), quote(value)
+    count++
+}
+
+END {
+    close_profile()
+    print "const BuiltinProfile builtin_profiles[] = {"
+    for (i = 1; i <= profiles; i++)
+        printf "    {%s, settings_%d, %d},\n", quote(names[i]), i, counts[i]
+    if (profiles == 0)
+        print "    {NULL, NULL, 0},"
+    print "};"
+    print ""
+    printf "const size_t builtin_profile_count = %d;\n", profiles
+}